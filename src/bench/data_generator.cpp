@@ -0,0 +1,311 @@
+﻿#include <bench/data_generator.h>
+
+#include <utils/err.h>
+#include <utils/fs/fs.h>
+#include <utils/log/log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace Bench
+{
+  namespace
+  {
+    const std::uint64_t BLOCK_SIZE = 1 << 20;
+    const std::uint64_t ZIPF_RANKS = 1 << 20;
+    const double ZIPF_EXPONENT = 1.1;
+    const std::uint64_t DUPLICATES_RANKS = 100;
+    const std::size_t NUMBER_WIDTH = 16;
+    // Block lines are numbered below the step, so numbers of consecutive blocks do not overlap.
+    const std::uint64_t BLOCK_NUMBERS_STEP = 1 << 24;
+    const std::size_t MIXED_SHORT_LENGTH = 16;
+    const std::size_t MIXED_LONG_LENGTH_FACTOR = 32;
+    const char* const ALPHANUMERIC = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    const std::size_t ALPHANUMERIC_SIZE = 62;
+
+    // A fast generator with good enough statistics, a seed is a stream.
+    class SplitMix64
+    {
+      std::uint64_t m_state;
+
+    public:
+      explicit SplitMix64(std::uint64_t seed)
+        : m_state(seed)
+      {
+      }
+
+      std::uint64_t Next()
+      {
+        auto z = (m_state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+      }
+
+      // In [0, count).
+      std::uint64_t Next(std::uint64_t count)
+      {
+        return Next() % count;
+      }
+
+      // In [0, 1).
+      double NextReal()
+      {
+        return (Next() >> 11) * (1.0 / (1ULL << 53));
+      }
+    };
+
+    std::uint64_t Combine(std::uint64_t seed, std::uint64_t value)
+    {
+      return SplitMix64(seed ^ (value * 0xd6e8feb86659fd93ULL)).Next();
+    }
+
+    void AppendAlphanumeric(SplitMix64& random, std::size_t length, std::string& line)
+    {
+      for (std::size_t i = 0; i != length; ++i)
+      {
+        line += ALPHANUMERIC[random.Next(ALPHANUMERIC_SIZE)];
+      }
+    }
+
+    void AppendNumber(std::uint64_t number, std::string& line)
+    {
+      char buffer[NUMBER_WIDTH + 1];
+      for (std::size_t i = NUMBER_WIDTH; i != 0; --i)
+      {
+        buffer[i - 1] = static_cast<char>('0' + number % 10);
+        number /= 10;
+      }
+      line.append(buffer, NUMBER_WIDTH);
+    }
+
+    class BlockGenerator
+    {
+      const DataParams m_params;
+      // Distributions of the same seed use different random streams.
+      const std::uint64_t m_seed;
+      std::vector<double> m_zipfCdf;
+      std::string m_prefix;
+
+    public:
+      explicit BlockGenerator(const DataParams& params)
+        : m_params(params)
+        , m_seed(Combine(params.seed, static_cast<std::uint64_t>(params.distribution)))
+      {
+        ERR_THROW_IF(m_params.maxLineLength == 0, "Invalid argument (max line length is 0).");
+        ERR_THROW_IF((m_params.distribution == Distribution::SORTED || m_params.distribution == Distribution::REVERSE_SORTED) && m_params.maxLineLength < NUMBER_WIDTH,
+          "Invalid argument (max line length should be >= " + std::to_string(NUMBER_WIDTH) + " for sorted lines).");
+
+        if (m_params.distribution == Distribution::ZIPF)
+        {
+          m_zipfCdf.resize(ZIPF_RANKS);
+          double sum = 0;
+          for (std::uint64_t rank = 0; rank != ZIPF_RANKS; ++rank)
+          {
+            sum += 1.0 / std::pow(static_cast<double>(rank + 1), ZIPF_EXPONENT);
+            m_zipfCdf[rank] = sum;
+          }
+          for (auto& value : m_zipfCdf)
+          {
+            value /= sum;
+          }
+        }
+        if (m_params.distribution == Distribution::SHARED_PREFIX)
+        {
+          SplitMix64 random(Combine(m_seed, ~0ULL));
+          AppendAlphanumeric(random, (std::max)(std::size_t(1), m_params.maxLineLength * 3 / 4), m_prefix);
+        }
+      }
+
+      // Lines are appended up to the size, the last one may exceed it.
+      std::uint64_t Generate(std::uint64_t blockIndex, std::uint64_t blocksCount, std::uint64_t size, std::string& block) const
+      {
+        SplitMix64 random(Combine(m_seed, blockIndex));
+        block.clear();
+        std::uint64_t lines = 0;
+        while (block.size() < size)
+        {
+          AppendLine(random, blockIndex, blocksCount, lines, block);
+          block += '\n';
+          ++lines;
+        }
+        return lines;
+      }
+
+    private:
+      void AppendLine(SplitMix64& random, std::uint64_t blockIndex, std::uint64_t blocksCount, std::uint64_t lineIndex, std::string& line) const
+      {
+        const auto maxLength = m_params.maxLineLength;
+        switch (m_params.distribution)
+        {
+          case Distribution::UNIFORM:
+            AppendAlphanumeric(random, 1 + random.Next(maxLength), line);
+            break;
+          case Distribution::ZIPF:
+          {
+            const auto rank = std::lower_bound(m_zipfCdf.begin(), m_zipfCdf.end(), random.NextReal()) - m_zipfCdf.begin();
+            AppendWord(static_cast<std::uint64_t>(rank), line);
+            break;
+          }
+          case Distribution::SORTED:
+            AppendNumber(blockIndex * BLOCK_NUMBERS_STEP + lineIndex, line);
+            AppendAlphanumeric(random, random.Next(maxLength - NUMBER_WIDTH + 1), line);
+            break;
+          case Distribution::REVERSE_SORTED:
+            AppendNumber((blocksCount - blockIndex) * BLOCK_NUMBERS_STEP - lineIndex, line);
+            AppendAlphanumeric(random, random.Next(maxLength - NUMBER_WIDTH + 1), line);
+            break;
+          case Distribution::DUPLICATES:
+            AppendWord(random.Next(DUPLICATES_RANKS), line);
+            break;
+          case Distribution::SHARED_PREFIX:
+            line += m_prefix;
+            AppendAlphanumeric(random, 1 + random.Next((std::max)(std::size_t(1), maxLength - m_prefix.size())), line);
+            break;
+          case Distribution::MIXED_LENGTH:
+          {
+            const auto longLine = random.Next(10) == 0;
+            AppendAlphanumeric(random, 1 + random.Next(longLine ? maxLength * MIXED_LONG_LENGTH_FACTOR : MIXED_SHORT_LENGTH), line);
+            break;
+          }
+          default:
+            ERR_THROW("Unexpected distribution.");
+        }
+      }
+
+      // The same rank gives the same word of 8 to 24 chars.
+      void AppendWord(std::uint64_t rank, std::string& line) const
+      {
+        SplitMix64 random(Combine(m_seed ^ 0x5bd1e995ULL, rank));
+        AppendAlphanumeric(random, 8 + random.Next(17), line);
+      }
+    };
+
+    // Blocks are passed to the consumer in their order. Returns the lines count.
+    template <typename Consumer>
+    std::uint64_t GenerateBlocks(const DataParams& params, std::size_t threadsCount, Consumer consumer)
+    {
+      ERR_THROW_IF(threadsCount == 0, "Invalid argument (threads count is 0).");
+      const BlockGenerator generator(params);
+      const auto blocksCount = (params.size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+      std::uint64_t lines = 0;
+      std::vector<std::string> blocks(threadsCount);
+      std::vector<std::uint64_t> blockLines(threadsCount);
+      std::vector<std::exception_ptr> errors(threadsCount);
+      for (std::uint64_t firstBlock = 0; firstBlock < blocksCount; firstBlock += threadsCount)
+      {
+        const auto batchSize = static_cast<std::size_t>((std::min)(static_cast<std::uint64_t>(threadsCount), blocksCount - firstBlock));
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i != batchSize; ++i)
+        {
+          threads.emplace_back([&, i]()
+          {
+            try
+            {
+              const auto blockIndex = firstBlock + i;
+              const auto blockSize = (std::min)(BLOCK_SIZE, params.size - blockIndex * BLOCK_SIZE);
+              blockLines[i] = generator.Generate(blockIndex, blocksCount, blockSize, blocks[i]);
+            }
+            catch (...)
+            {
+              errors[i] = std::current_exception();
+            }
+          });
+        }
+        for (auto& thread : threads)
+        {
+          thread.join();
+        }
+        for (std::size_t i = 0; i != batchSize; ++i)
+        {
+          if (errors[i])
+          {
+            std::rethrow_exception(errors[i]);
+          }
+          consumer(blocks[i]);
+          lines += blockLines[i];
+        }
+      }
+      return lines;
+    }
+  }
+
+  std::vector<Distribution> GetAllDistributions()
+  {
+    return {
+      Distribution::UNIFORM,
+      Distribution::ZIPF,
+      Distribution::SORTED,
+      Distribution::REVERSE_SORTED,
+      Distribution::DUPLICATES,
+      Distribution::SHARED_PREFIX,
+      Distribution::MIXED_LENGTH,
+    };
+  }
+
+  std::string GetDistributionName(Distribution distribution)
+  {
+    switch (distribution)
+    {
+      case Distribution::UNIFORM        : return "uniform";
+      case Distribution::ZIPF           : return "zipf";
+      case Distribution::SORTED         : return "sorted";
+      case Distribution::REVERSE_SORTED : return "reverse";
+      case Distribution::DUPLICATES     : return "duplicates";
+      case Distribution::SHARED_PREFIX  : return "prefix";
+      case Distribution::MIXED_LENGTH   : return "mixed";
+    }
+    ERR_THROW("Unexpected distribution.");
+    return std::string();
+  }
+
+  Distribution ParseDistribution(const std::string& name)
+  {
+    for (const auto distribution : GetAllDistributions())
+    {
+      if (GetDistributionName(distribution) == name)
+      {
+        return distribution;
+      }
+    }
+    ERR_THROW_TYPED(std::invalid_argument, "Bad distribution (value = '" + name + "').");
+    return Distribution::UNIFORM;
+  }
+
+  std::uint64_t GenerateDataFile(const std::string& filePath, const DataParams& params, std::size_t threadsCount)
+  {
+    Utils::Log::ScopedInfoLog generateScope("GenerateDataFile");
+    LOG_I("file = '%s', distribution = %s, size = %s, max line length = %s, seed = %s",
+      filePath.c_str(),
+      GetDistributionName(params.distribution).c_str(),
+      std::to_string(params.size).c_str(),
+      std::to_string(params.maxLineLength).c_str(),
+      std::to_string(params.seed).c_str());
+
+    const auto file = Utils::Fs::OpenFile(filePath, "wb");
+    const auto lines = GenerateBlocks(params, threadsCount, [&](const std::string& block)
+    {
+      ERR_THROW_IF(fwrite(block.data(), block.size(), 1, file.get()) != 1, "Failed to write file (path = '" + filePath + "').");
+    });
+
+    LOG_I("lines = %s", std::to_string(lines).c_str());
+    return lines;
+  }
+
+  std::string GenerateData(const DataParams& params, std::size_t threadsCount)
+  {
+    std::string data;
+    data.reserve(static_cast<std::size_t>(params.size + params.maxLineLength * MIXED_LONG_LENGTH_FACTOR + 1));
+    GenerateBlocks(params, threadsCount, [&](const std::string& block)
+    {
+      data += block;
+    });
+    return data;
+  }
+}
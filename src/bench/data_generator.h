@@ -0,0 +1,48 @@
+﻿#ifndef __BENCH_DATA_GENERATOR_H__
+#define __BENCH_DATA_GENERATOR_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Bench
+{
+  enum class Distribution
+  {
+    // Random alphanumeric lines of random lengths up to the max one, as tests/generate_data_file.py writes.
+    UNIFORM,
+    // Words of a Zipf distributed rank, a few words make most of the lines.
+    ZIPF,
+    // Increasing fixed width numbers followed by random tails.
+    SORTED,
+    // Decreasing fixed width numbers followed by random tails.
+    REVERSE_SORTED,
+    // Words of a few distinct ranks.
+    DUPLICATES,
+    // A long common prefix followed by short random tails.
+    SHARED_PREFIX,
+    // Mostly short lines with a few very long ones.
+    MIXED_LENGTH,
+  };
+
+  std::vector<Distribution> GetAllDistributions();
+  std::string GetDistributionName(Distribution distribution);
+  Distribution ParseDistribution(const std::string& name);
+
+  struct DataParams
+  {
+    Distribution distribution;
+    std::uint64_t size;
+    std::size_t maxLineLength;
+    std::uint64_t seed;
+  };
+
+  // The file content depends on the params only, the data is generated in blocks
+  // of their own random streams, so the threads count does not change it.
+  // Returns the lines count.
+  std::uint64_t GenerateDataFile(const std::string& filePath, const DataParams& params, std::size_t threadsCount);
+  // The same data in memory.
+  std::string GenerateData(const DataParams& params, std::size_t threadsCount);
+}
+
+#endif
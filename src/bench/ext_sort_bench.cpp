@@ -0,0 +1,324 @@
+﻿#include <predef.h>
+
+#include <bench/data_generator.h>
+
+#include <utils/arg.h>
+#include <utils/err.h>
+#include <utils/fs/fs.h>
+#include <utils/log/log.h>
+#include <utils/log/log_registry.h>
+#include <utils/process.h>
+#include <utils/str_conv.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Generates datasets of several distributions and sorts them by the ExternalSort binary
+// with every combination of the memory budgets and the workers counts.
+namespace
+{
+  const char* const ARG_USAGE_REQUEST       = "?";
+  const char* const ARG_APP                 = "app";
+  const char* const ARG_DATA_DIR_PATH       = "data_dir";
+  const char* const ARG_RESULTS_FILE_PATH   = "results";
+  const char* const ARG_RESULTS_FORMAT      = "results_format";
+  const char* const ARG_DISTRIBUTIONS       = "distributions";
+  const char* const ARG_SIZE_MB             = "size_Mb";
+  const char* const ARG_MAX_LINE_LENGTH     = "max_line_length";
+  const char* const ARG_SEED                = "seed";
+  const char* const ARG_GENERATOR_THREADS   = "generator_threads";
+  const char* const ARG_MEMORY_MB           = "memory_Mb";
+  const char* const ARG_WORKERS             = "workers";
+  const char* const ARG_REPEATS             = "repeats";
+  const char* const ARG_VERIFY              = "verify";
+  const char* const ARG_APP_PATH            = "app_path";
+
+  const char* const DEFAULT_DATA_DIR_PATH     = "./bench_data/";
+  const char* const DEFAULT_RESULTS_FILE_PATH = "bench_results.csv";
+  const char* const DEFAULT_RESULTS_FORMAT    = "csv";
+  const char* const DEFAULT_DISTRIBUTIONS     = "uniform,zipf,sorted,reverse,duplicates,prefix,mixed";
+  const char* const DEFAULT_SIZE_MB           = "64";
+  const char* const DEFAULT_MAX_LINE_LENGTH   = "128";
+  const char* const DEFAULT_SEED              = "1";
+  const char* const DEFAULT_GENERATOR_THREADS = "0";
+  const char* const DEFAULT_MEMORY_MB         = "4,16,64";
+  const char* const DEFAULT_WORKERS           = "0,2";
+  const char* const DEFAULT_REPEATS           = "1";
+  const char* const DEFAULT_VERIFY            = "1";
+
+  struct BenchResult
+  {
+    std::string distribution;
+    std::uint64_t size;
+    std::uint64_t lines;
+    std::size_t memoryMb;
+    std::size_t workers;
+    std::size_t repeat;
+    double sortSeconds;
+    bool verified;
+  };
+
+  void LogUsage(const std::string& appName)
+  {
+    std::ostringstream oss;
+    oss << "Usage:" << std::endl;
+    oss << "  " << appName << " [" << ARG_APP << "] [" << ARG_DATA_DIR_PATH << "] [" << ARG_RESULTS_FILE_PATH << "] [" << ARG_RESULTS_FORMAT << "]"
+        << " [" << ARG_DISTRIBUTIONS << "] [" << ARG_SIZE_MB << "] [" << ARG_MAX_LINE_LENGTH << "] [" << ARG_SEED << "] [" << ARG_GENERATOR_THREADS << "]"
+        << " [" << ARG_MEMORY_MB << "] [" << ARG_WORKERS << "] [" << ARG_REPEATS << "] [" << ARG_VERIFY << "]" << std::endl;
+    oss << "  " << ARG_APP               << " - path to the ExternalSort binary (default value is the one next to this binary)." << std::endl;
+    oss << "  " << ARG_DATA_DIR_PATH     << " - path to a directory for the datasets, existing datasets are reused (default value is '" << DEFAULT_DATA_DIR_PATH << "')." << std::endl;
+    oss << "  " << ARG_RESULTS_FILE_PATH << " - results file path, the results are appended (default value is '" << DEFAULT_RESULTS_FILE_PATH << "')." << std::endl;
+    oss << "  " << ARG_RESULTS_FORMAT    << " - csv or json: a row or a JSON object per line (default value is '" << DEFAULT_RESULTS_FORMAT << "')." << std::endl;
+    oss << "  " << ARG_DISTRIBUTIONS     << " - comma separated distributions: uniform, zipf, sorted, reverse, duplicates, prefix, mixed (default value is '" << DEFAULT_DISTRIBUTIONS << "')." << std::endl;
+    oss << "  " << ARG_SIZE_MB           << " - dataset size in Mb (default value is '" << DEFAULT_SIZE_MB << "')." << std::endl;
+    oss << "  " << ARG_MAX_LINE_LENGTH   << " - max line length (default value is '" << DEFAULT_MAX_LINE_LENGTH << "')." << std::endl;
+    oss << "  " << ARG_SEED              << " - seed of the datasets, the same seed gives the same datasets (default value is '" << DEFAULT_SEED << "')." << std::endl;
+    oss << "  " << ARG_GENERATOR_THREADS << " - count of threads generating the datasets, 0 means the count of hardware threads (default value is '" << DEFAULT_GENERATOR_THREADS << "')." << std::endl;
+    oss << "  " << ARG_MEMORY_MB         << " - comma separated memory budgets in Mb (default value is '" << DEFAULT_MEMORY_MB << "')." << std::endl;
+    oss << "  " << ARG_WORKERS           << " - comma separated counts of worker processes (default value is '" << DEFAULT_WORKERS << "')." << std::endl;
+    oss << "  " << ARG_REPEATS           << " - count of runs of every configuration (default value is '" << DEFAULT_REPEATS << "')." << std::endl;
+    oss << "  " << ARG_VERIFY            << " - set to 1 to verify every result by the verify mode, the verification time is not measured (default value is '" << DEFAULT_VERIFY << "')." << std::endl;
+    Utils::Log::GetLogger().Add(oss.str().c_str(), Utils::Log::LOG_LEVEL_INFO);
+  }
+
+  std::vector<std::string> SplitList(const std::string& value)
+  {
+    std::vector<std::string> items;
+    std::istringstream iss(value);
+    std::string item;
+    while (std::getline(iss, item, ','))
+    {
+      if (!item.empty())
+      {
+        items.push_back(item);
+      }
+    }
+    ERR_THROW_IF(items.empty(), "Empty list (value = '" + value + "').");
+    return items;
+  }
+
+  template <typename T>
+  std::vector<T> ParseList(const std::string& value)
+  {
+    std::vector<T> result;
+    for (const auto& item : SplitList(value))
+    {
+      result.push_back(Utils::FromString<T>(item));
+    }
+    return result;
+  }
+
+  std::string GetDefaultAppPath(const std::string& benchPath)
+  {
+    std::string dirPath;
+    for (auto pos = benchPath.size(); pos != 0; --pos)
+    {
+      if (Utils::Fs::IsPathSeparator(benchPath[pos - 1]))
+      {
+        dirPath = benchPath.substr(0, pos);
+        break;
+      }
+    }
+    #ifdef PREDEF_OS_WINDOWS
+      return dirPath + "ExternalSort.exe";
+    #else
+      return dirPath.empty() ? "./ExternalSort" : dirPath + "ExternalSort";
+    #endif
+  }
+
+  // Runs the binary, its log is dropped.
+  void Execute(const std::vector<std::string>& args)
+  {
+    const auto process = Utils::StartChildProcess(args);
+    std::string line;
+    while (process->ReadLine(line))
+    {
+    }
+    process->Wait();
+  }
+
+  void WriteResult(const std::string& filePath, const std::string& format, const BenchResult& result)
+  {
+    const auto csv = format == "csv";
+    const auto writeHeader = csv && !Utils::Fs::IsExists(filePath);
+    std::ofstream file(filePath, std::ios::app);
+    ERR_THROW_IF_NOT(file, "Failed to open the results file (path = '" + filePath + "').");
+
+    const auto mbPerSecond = result.sortSeconds > 0 ? result.size / result.sortSeconds / (1 << 20) : 0.0;
+    if (csv)
+    {
+      if (writeHeader)
+      {
+        file << "distribution,size_bytes,lines,memory_Mb,workers,repeat,sort_seconds,Mb_per_second,verified" << std::endl;
+      }
+      file << result.distribution << ',' << result.size << ',' << result.lines << ',' << result.memoryMb << ',' << result.workers << ','
+           << result.repeat << ',' << std::fixed << std::setprecision(3) << result.sortSeconds << ',' << mbPerSecond << ',' << (result.verified ? 1 : 0) << std::endl;
+    }
+    else
+    {
+      file << "{\"distribution\": \"" << result.distribution << "\", \"size_bytes\": " << result.size << ", \"lines\": " << result.lines
+           << ", \"memory_Mb\": " << result.memoryMb << ", \"workers\": " << result.workers << ", \"repeat\": " << result.repeat
+           << ", \"sort_seconds\": " << std::fixed << std::setprecision(3) << result.sortSeconds << ", \"Mb_per_second\": " << mbPerSecond
+           << ", \"verified\": " << (result.verified ? "true" : "false") << "}" << std::endl;
+    }
+    ERR_THROW_IF_NOT(file, "Failed to write the results file (path = '" + filePath + "').");
+  }
+
+  void Run(Utils::Arguments args)
+  {
+    const auto appName = args.GetArgument(ARG_APP_PATH);
+    if (args.HasArgument(ARG_USAGE_REQUEST))
+    {
+      LogUsage(appName);
+      return;
+    }
+
+    args.SetDefault(ARG_APP               , GetDefaultAppPath(appName));
+    args.SetDefault(ARG_DATA_DIR_PATH     , DEFAULT_DATA_DIR_PATH);
+    args.SetDefault(ARG_RESULTS_FILE_PATH , DEFAULT_RESULTS_FILE_PATH);
+    args.SetDefault(ARG_RESULTS_FORMAT    , DEFAULT_RESULTS_FORMAT);
+    args.SetDefault(ARG_DISTRIBUTIONS     , DEFAULT_DISTRIBUTIONS);
+    args.SetDefault(ARG_SIZE_MB           , DEFAULT_SIZE_MB);
+    args.SetDefault(ARG_MAX_LINE_LENGTH   , DEFAULT_MAX_LINE_LENGTH);
+    args.SetDefault(ARG_SEED              , DEFAULT_SEED);
+    args.SetDefault(ARG_GENERATOR_THREADS , DEFAULT_GENERATOR_THREADS);
+    args.SetDefault(ARG_MEMORY_MB         , DEFAULT_MEMORY_MB);
+    args.SetDefault(ARG_WORKERS           , DEFAULT_WORKERS);
+    args.SetDefault(ARG_REPEATS           , DEFAULT_REPEATS);
+    args.SetDefault(ARG_VERIFY            , DEFAULT_VERIFY);
+
+    const auto appPath          = args.GetArgument<std::string>(ARG_APP);
+    const auto dataDirPath      = args.GetArgument<std::string>(ARG_DATA_DIR_PATH);
+    const auto resultsFilePath  = args.GetArgument<std::string>(ARG_RESULTS_FILE_PATH);
+    const auto resultsFormat    = args.GetArgument<std::string>(ARG_RESULTS_FORMAT);
+    std::vector<Bench::Distribution> distributions;
+    for (const auto& name : SplitList(args.GetArgument<std::string>(ARG_DISTRIBUTIONS)))
+    {
+      distributions.push_back(Bench::ParseDistribution(name));
+    }
+    const auto sizeMb           = args.GetArgument<std::uint64_t>(ARG_SIZE_MB);
+    const auto maxLineLength    = args.GetArgument<std::size_t>(ARG_MAX_LINE_LENGTH);
+    const auto seed             = args.GetArgument<std::uint64_t>(ARG_SEED);
+    auto generatorThreads       = args.GetArgument<std::size_t>(ARG_GENERATOR_THREADS);
+    const auto memoryBudgetsMb  = ParseList<std::size_t>(args.GetArgument<std::string>(ARG_MEMORY_MB));
+    const auto workersCounts    = ParseList<std::size_t>(args.GetArgument<std::string>(ARG_WORKERS));
+    const auto repeats          = args.GetArgument<std::size_t>(ARG_REPEATS);
+    const auto verify           = args.GetArgument<bool>(ARG_VERIFY);
+
+    ERR_THROW_IF_NOT(Utils::Fs::IsExists(appPath), "ExternalSort binary not exists (path = '" + appPath + "').");
+    ERR_THROW_IF(resultsFormat != "csv" && resultsFormat != "json", "Bad " + std::string(ARG_RESULTS_FORMAT) + " (value = '" + resultsFormat + "').");
+    ERR_THROW_IF(sizeMb == 0, std::string(ARG_SIZE_MB) + " should be >= 1.");
+    ERR_THROW_IF(repeats == 0, std::string(ARG_REPEATS) + " should be >= 1.");
+    if (generatorThreads == 0)
+    {
+      generatorThreads = (std::max)(1u, std::thread::hardware_concurrency());
+    }
+
+    Utils::Fs::EnsureDirExists(dataDirPath);
+    const auto tempDirPath = Utils::Fs::AppendPath(dataDirPath, "temp");
+    const auto outputFilePath = Utils::Fs::AppendPath(dataDirPath, "sorted.txt");
+
+    for (const auto distribution : distributions)
+    {
+      const auto distributionName = Bench::GetDistributionName(distribution);
+      Bench::DataParams params;
+      params.distribution = distribution;
+      params.size = sizeMb << 20;
+      params.maxLineLength = maxLineLength;
+      params.seed = seed;
+
+      // The lines count is kept next to the dataset, so the dataset is generated once.
+      const auto dataFilePath = Utils::Fs::AppendPath(dataDirPath,
+        distributionName + "_" + std::to_string(sizeMb) + "Mb_" + std::to_string(maxLineLength) + "_" + std::to_string(seed) + ".txt");
+      const auto linesFilePath = dataFilePath + ".lines";
+      std::uint64_t lines = 0;
+      if (Utils::Fs::IsExists(dataFilePath) && Utils::Fs::IsExists(linesFilePath))
+      {
+        std::ifstream(linesFilePath) >> lines;
+      }
+      else
+      {
+        lines = Bench::GenerateDataFile(dataFilePath, params, generatorThreads);
+        std::ofstream(linesFilePath) << lines;
+      }
+
+      for (const auto memoryMb : memoryBudgetsMb)
+      {
+        for (const auto workers : workersCounts)
+        {
+          for (std::size_t repeat = 0; repeat != repeats; ++repeat)
+          {
+            Utils::Log::ScopedInfoLog runScope("Bench run: " + distributionName + ", memory = " + std::to_string(memoryMb) + "Mb, workers = " + std::to_string(workers) + ", repeat = " + std::to_string(repeat));
+            if (Utils::Fs::IsExists(outputFilePath))
+            {
+              Utils::Fs::RemoveFile(outputFilePath);
+            }
+
+            const auto startTime = std::chrono::steady_clock::now();
+            Execute({
+              appPath,
+              "input=" + dataFilePath,
+              "output=" + outputFilePath,
+              "temp_dir=" + tempDirPath,
+              "max_memory_usage_Mb=" + std::to_string(memoryMb),
+              "workers=" + std::to_string(workers),
+            });
+            const auto sortTime = std::chrono::steady_clock::now() - startTime;
+
+            BenchResult result;
+            result.distribution = distributionName;
+            result.size = Utils::Fs::GetSize(dataFilePath);
+            result.lines = lines;
+            result.memoryMb = memoryMb;
+            result.workers = workers;
+            result.repeat = repeat;
+            result.sortSeconds = std::chrono::duration<double>(sortTime).count();
+            result.verified = false;
+            if (verify)
+            {
+              Execute({
+                appPath,
+                "mode=verify",
+                "input=" + outputFilePath,
+                "checksum_input=" + dataFilePath,
+                "max_memory_usage_Mb=" + std::to_string(memoryMb),
+              });
+              result.verified = true;
+            }
+            LOG_I("Sort time = %.3f sec", result.sortSeconds);
+            WriteResult(resultsFilePath, resultsFormat, result);
+          }
+        }
+      }
+    }
+
+    if (Utils::Fs::IsExists(outputFilePath))
+    {
+      Utils::Fs::RemoveFile(outputFilePath);
+    }
+    LOG_I("DONE");
+    LOG_I("RESULTS: %s", resultsFilePath.c_str());
+  }
+}
+
+int main(int argc, char** argv)
+{
+  int result = -1;
+  try
+  {
+    Run(Utils::Arguments(argc, argv));
+    result = 0;
+  }
+  catch (...)
+  {
+    Utils::Log::LogCurrentException("FAILED");
+  }
+  return result;
+}
@@ -0,0 +1,191 @@
+﻿#include <predef.h>
+
+#include <utils/arg.h>
+#include <utils/err.h>
+#include <utils/log/log.h>
+#include <utils/log/log_registry.h>
+#include <utils/log/loggers/threadsafe_logger.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Measures the messages per second of the threadsafe loggers with concurrent producer threads.
+namespace
+{
+  const char* const ARG_USAGE_REQUEST  = "?";
+  const char* const ARG_LOGGERS        = "loggers";
+  const char* const ARG_THREADS        = "threads";
+  const char* const ARG_MESSAGES       = "messages";
+  const char* const ARG_MESSAGE_LENGTH = "message_length";
+  const char* const ARG_REPEATS        = "repeats";
+  const char* const ARG_APP_PATH       = "app_path";
+
+  const char* const DEFAULT_LOGGERS        = "async,sync";
+  const char* const DEFAULT_THREADS        = "16";
+  const char* const DEFAULT_MESSAGES       = "100000";
+  const char* const DEFAULT_MESSAGE_LENGTH = "64";
+  const char* const DEFAULT_REPEATS        = "3";
+
+  using Clock = std::chrono::steady_clock;
+
+  // Counts the messages, so the measurement does not depend on the output and the loss of a message is detected.
+  class CountingLogger : public Utils::Log::Logger
+  {
+    std::atomic<std::size_t>& m_messages;
+
+  public:
+    explicit CountingLogger(std::atomic<std::size_t>& messages)
+      : m_messages(messages)
+    {
+    }
+
+    virtual void Add(const char*, Utils::Log::Level) override
+    {
+      ++m_messages;
+    }
+
+    virtual void Add(const char*, Utils::Log::Level, const char*, unsigned) override
+    {
+      ++m_messages;
+    }
+
+    virtual void PushIndent() override
+    {
+    }
+
+    virtual void PopIndent() override
+    {
+    }
+  };
+
+  struct LoggerResult
+  {
+    // The producers are done, the async logger may still process the messages.
+    double producersSeconds;
+    // All the messages are processed.
+    double totalSeconds;
+  };
+
+  void LogUsage(const std::string& appName)
+  {
+    std::ostringstream oss;
+    oss << "Usage:" << std::endl;
+    oss << "  " << appName << " [" << ARG_LOGGERS << "] [" << ARG_THREADS << "] [" << ARG_MESSAGES << "] [" << ARG_MESSAGE_LENGTH << "] [" << ARG_REPEATS << "]" << std::endl;
+    oss << "  " << ARG_LOGGERS        << " - comma separated loggers: async, sync (default value is '" << DEFAULT_LOGGERS << "')." << std::endl;
+    oss << "  " << ARG_THREADS        << " - count of producer threads (default value is '" << DEFAULT_THREADS << "')." << std::endl;
+    oss << "  " << ARG_MESSAGES       << " - count of messages of every thread (default value is '" << DEFAULT_MESSAGES << "')." << std::endl;
+    oss << "  " << ARG_MESSAGE_LENGTH << " - message length (default value is '" << DEFAULT_MESSAGE_LENGTH << "')." << std::endl;
+    oss << "  " << ARG_REPEATS        << " - count of runs of every logger, the best time is reported (default value is '" << DEFAULT_REPEATS << "')." << std::endl;
+    Utils::Log::GetLogger().Add(oss.str().c_str(), Utils::Log::LOG_LEVEL_INFO);
+  }
+
+  std::unique_ptr<Utils::Log::Logger> CreateLogger(const std::string& name, std::unique_ptr<Utils::Log::Logger> target)
+  {
+    if (name == "async")
+    {
+      return Utils::Log::CreateThreadsafeAsyncLogger(std::move(target));
+    }
+    if (name == "sync")
+    {
+      return Utils::Log::CreateThreadsafeSyncLogger(std::move(target));
+    }
+    ERR_THROW("Unknown logger (name = '" + name + "').");
+    return nullptr;
+  }
+
+  LoggerResult RunLogger(const std::string& name, std::size_t threadsCount, std::size_t messages, const std::string& message)
+  {
+    std::atomic<std::size_t> processed(0);
+    auto logger = CreateLogger(name, std::make_unique<CountingLogger>(processed));
+
+    const auto startTime = Clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i != threadsCount; ++i)
+    {
+      threads.emplace_back([&logger, &message, messages]()
+      {
+        for (std::size_t j = 0; j != messages; ++j)
+        {
+          logger->Add(message.c_str(), Utils::Log::LOG_LEVEL_INFO);
+        }
+      });
+    }
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+    const auto producersTime = Clock::now();
+    logger.reset();
+    const auto endTime = Clock::now();
+
+    ERR_THROW_IF(processed != threadsCount * messages, "Lost messages (logger = '" + name + "', processed = " + std::to_string(processed) + ").");
+    return LoggerResult{ std::chrono::duration<double>(producersTime - startTime).count(), std::chrono::duration<double>(endTime - startTime).count() };
+  }
+
+  void Run(Utils::Arguments args)
+  {
+    const auto appName = args.GetArgument(ARG_APP_PATH);
+    if (args.HasArgument(ARG_USAGE_REQUEST))
+    {
+      LogUsage(appName);
+      return;
+    }
+
+    args.SetDefault(ARG_LOGGERS        , DEFAULT_LOGGERS);
+    args.SetDefault(ARG_THREADS        , DEFAULT_THREADS);
+    args.SetDefault(ARG_MESSAGES       , DEFAULT_MESSAGES);
+    args.SetDefault(ARG_MESSAGE_LENGTH , DEFAULT_MESSAGE_LENGTH);
+    args.SetDefault(ARG_REPEATS        , DEFAULT_REPEATS);
+
+    const auto loggers       = args.GetArgument<std::string>(ARG_LOGGERS);
+    const auto threadsCount  = args.GetArgument<std::size_t>(ARG_THREADS);
+    const auto messages      = args.GetArgument<std::size_t>(ARG_MESSAGES);
+    const auto messageLength = args.GetArgument<std::size_t>(ARG_MESSAGE_LENGTH);
+    const auto repeats       = args.GetArgument<std::size_t>(ARG_REPEATS);
+
+    ERR_THROW_IF(threadsCount == 0, std::string(ARG_THREADS) + " should be >= 1.");
+    ERR_THROW_IF(messages == 0, std::string(ARG_MESSAGES) + " should be >= 1.");
+    ERR_THROW_IF(repeats == 0, std::string(ARG_REPEATS) + " should be >= 1.");
+
+    const std::string message(messageLength, 'x');
+    const auto totalMessages = static_cast<double>(threadsCount * messages);
+    LOG_I("threads = %s, messages per thread = %s, message length = %s",
+          std::to_string(threadsCount).c_str(), std::to_string(messages).c_str(), std::to_string(messageLength).c_str());
+
+    std::istringstream names(loggers);
+    std::string name;
+    while (std::getline(names, name, ','))
+    {
+      LoggerResult best = RunLogger(name, threadsCount, messages, message);
+      for (std::size_t repeat = 1; repeat < repeats; ++repeat)
+      {
+        const auto result = RunLogger(name, threadsCount, messages, message);
+        if (result.totalSeconds < best.totalSeconds)
+        {
+          best = result;
+        }
+      }
+      LOG_I("%-6s : %12.0f messages/s, producers %12.0f messages/s", name.c_str(), totalMessages / best.totalSeconds, totalMessages / best.producersSeconds);
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  int result = -1;
+  try
+  {
+    Run(Utils::Arguments(argc, argv));
+    result = 0;
+  }
+  catch (...)
+  {
+    Utils::Log::LogCurrentException("FAILED");
+  }
+  return result;
+}
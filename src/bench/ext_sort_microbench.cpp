@@ -0,0 +1,330 @@
+﻿#include <predef.h>
+
+#include <bench/data_generator.h>
+
+#include <ext_sort/ext_sort_utils.h>
+#include <ext_sort/merged_records_enumerator.h>
+#include <ext_sort/records.h>
+#include <ext_sort/strings_chunks_enumerator.h>
+#include <ext_sort/types.h>
+
+#include <utils/arg.h>
+#include <utils/err.h>
+#include <utils/fs/fs.h>
+#include <utils/log/log.h>
+#include <utils/log/log_registry.h>
+#include <utils/merge_sort.h>
+#include <utils/str_conv.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Times the hot kernels of the sort on synthetic in-memory lines, so there is no disk in the measurements.
+namespace
+{
+  const char* const ARG_USAGE_REQUEST       = "?";
+  const char* const ARG_KERNELS             = "kernels";
+  const char* const ARG_DISTRIBUTION        = "distribution";
+  const char* const ARG_SIZE_MB             = "size_Mb";
+  const char* const ARG_MAX_LINE_LENGTH     = "max_line_length";
+  const char* const ARG_SEED                = "seed";
+  const char* const ARG_FAN_IN              = "fan_in";
+  const char* const ARG_REPEATS             = "repeats";
+  const char* const ARG_RESULTS_FILE_PATH   = "results";
+  const char* const ARG_APP_PATH            = "app_path";
+
+  const char* const DEFAULT_KERNELS           = "merge_sort,compare,scan,merge,stable_merge";
+  const char* const DEFAULT_DISTRIBUTION      = "uniform";
+  const char* const DEFAULT_SIZE_MB           = "64";
+  const char* const DEFAULT_MAX_LINE_LENGTH   = "128";
+  const char* const DEFAULT_SEED              = "1";
+  const char* const DEFAULT_FAN_IN            = "16";
+  const char* const DEFAULT_REPEATS           = "5";
+  const char* const DEFAULT_RESULTS_FILE_PATH = "";
+
+  using Clock = std::chrono::steady_clock;
+
+  // Results of the kernels are accumulated here, so the compiler keeps the computations.
+  volatile std::size_t g_sink = 0;
+  std::size_t g_comparisons = 0;
+
+  struct CountingLess
+  {
+    bool operator () (const ExtSort::CharsChunk& lhs, const ExtSort::CharsChunk& rhs) const
+    {
+      ++g_comparisons;
+      return lhs < rhs;
+    }
+  };
+
+  struct CountingLineRecords : public ExtSort::LineRecords
+  {
+    using Less = CountingLess;
+  };
+
+  struct KernelResult
+  {
+    std::string kernel;
+    double bestSeconds;
+    std::size_t lines;
+    std::size_t bytes;
+    // Comparisons of a run, 0 for kernels without comparisons.
+    std::size_t comparisons;
+  };
+
+  void LogUsage(const std::string& appName)
+  {
+    std::ostringstream oss;
+    oss << "Usage:" << std::endl;
+    oss << "  " << appName << " [" << ARG_KERNELS << "] [" << ARG_DISTRIBUTION << "] [" << ARG_SIZE_MB << "] [" << ARG_MAX_LINE_LENGTH << "]"
+        << " [" << ARG_SEED << "] [" << ARG_FAN_IN << "] [" << ARG_REPEATS << "] [" << ARG_RESULTS_FILE_PATH << "]" << std::endl;
+    oss << "  " << ARG_KERNELS           << " - comma separated kernels: merge_sort (Utils::MergeSort of lines), compare (CharsChunk operator < of adjacent lines), scan (delimiter scan of the chunks enumerator), merge (multimap merge of " << ARG_FAN_IN << " sorted runs), stable_merge (the merge which orders equal lines by their runs as stable=1 does) (default value is '" << DEFAULT_KERNELS << "')." << std::endl;
+    oss << "  " << ARG_DISTRIBUTION      << " - distribution of the lines: uniform, zipf, sorted, reverse, duplicates, prefix, mixed (default value is '" << DEFAULT_DISTRIBUTION << "')." << std::endl;
+    oss << "  " << ARG_SIZE_MB           << " - data size in Mb (default value is '" << DEFAULT_SIZE_MB << "')." << std::endl;
+    oss << "  " << ARG_MAX_LINE_LENGTH   << " - max line length (default value is '" << DEFAULT_MAX_LINE_LENGTH << "')." << std::endl;
+    oss << "  " << ARG_SEED              << " - seed of the data (default value is '" << DEFAULT_SEED << "')." << std::endl;
+    oss << "  " << ARG_FAN_IN            << " - count of runs merged by the merge kernel (default value is '" << DEFAULT_FAN_IN << "')." << std::endl;
+    oss << "  " << ARG_REPEATS           << " - count of runs of every kernel, the best time is reported (default value is '" << DEFAULT_REPEATS << "')." << std::endl;
+    oss << "  " << ARG_RESULTS_FILE_PATH << " - CSV file the results are appended to, empty means the log only (default value is '" << DEFAULT_RESULTS_FILE_PATH << "')." << std::endl;
+    Utils::Log::GetLogger().Add(oss.str().c_str(), Utils::Log::LOG_LEVEL_INFO);
+  }
+
+  // Runs the kernel the count of times and returns the best time.
+  template <typename Kernel>
+  double Measure(std::size_t repeats, Kernel kernel)
+  {
+    double bestSeconds = 0;
+    for (std::size_t repeat = 0; repeat != repeats; ++repeat)
+    {
+      const auto startTime = Clock::now();
+      kernel();
+      const auto seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+      if (repeat == 0 || seconds < bestSeconds)
+      {
+        bestSeconds = seconds;
+      }
+    }
+    return bestSeconds;
+  }
+
+  std::vector<ExtSort::CharsChunk> SplitLines(std::string& data)
+  {
+    std::vector<ExtSort::CharsChunk> lines;
+    auto* cursor = &data[0];
+    auto* const end = cursor + data.size();
+    while (cursor != end)
+    {
+      auto* const lineEnd = ExtSort::FindChunkEnd(cursor, '\n');
+      lines.emplace_back(cursor, lineEnd);
+      cursor = lineEnd + 1;
+    }
+    return lines;
+  }
+
+  KernelResult RunMergeSort(const std::vector<ExtSort::CharsChunk>& lines, std::size_t bytes, std::size_t repeats)
+  {
+    std::vector<ExtSort::CharsChunk> arr(lines.size());
+    std::vector<ExtSort::CharsChunk> buf(lines.size());
+
+    g_comparisons = 0;
+    arr = lines;
+    Utils::MergeSort(buf.data(), arr.data(), 0, arr.size() - 1, CountingLess());
+    const auto comparisons = g_comparisons;
+
+    // The copy of the unsorted lines is a small part of the sort time.
+    const auto seconds = Measure(repeats, [&]()
+    {
+      arr = lines;
+      Utils::MergeSort(buf.data(), arr.data(), 0, arr.size() - 1, ExtSort::ChunkLess());
+      g_sink = g_sink + arr.front().ObjectsCount();
+    });
+    return KernelResult{ "merge_sort", seconds, lines.size(), bytes, comparisons };
+  }
+
+  KernelResult RunCompare(const std::vector<ExtSort::CharsChunk>& lines, std::size_t bytes, std::size_t repeats)
+  {
+    const auto seconds = Measure(repeats, [&]()
+    {
+      std::size_t less = 0;
+      for (std::size_t i = 1; i < lines.size(); ++i)
+      {
+        less += lines[i] < lines[i - 1] ? 1 : 0;
+      }
+      g_sink = g_sink + less;
+    });
+    return KernelResult{ "compare", seconds, lines.size(), bytes, lines.size() - 1 };
+  }
+
+  KernelResult RunScan(std::string& data, std::size_t linesCount, std::size_t repeats)
+  {
+    const auto seconds = Measure(repeats, [&]()
+    {
+      auto* cursor = &data[0];
+      auto* const end = cursor + data.size();
+      std::size_t lines = 0;
+      while (cursor != end)
+      {
+        cursor = ExtSort::FindChunkEnd(cursor, '\n') + 1;
+        ++lines;
+      }
+      g_sink = g_sink + lines;
+    });
+    return KernelResult{ "scan", seconds, linesCount, data.size(), 0 };
+  }
+
+  KernelResult RunMerge(const std::vector<ExtSort::CharsChunk>& lines, std::size_t bytes, std::size_t fanIn, bool stable, std::size_t repeats)
+  {
+    // Sorted lines dealt round robin give sorted runs of similar key ranges, as the runs of a sorter are.
+    auto sortedLines = lines;
+    std::sort(sortedLines.begin(), sortedLines.end(), ExtSort::ChunkLess());
+    std::vector<std::vector<std::string>> runs(fanIn);
+    for (std::size_t i = 0; i != sortedLines.size(); ++i)
+    {
+      runs[i % fanIn].emplace_back(sortedLines[i].begin, sortedLines[i].end);
+    }
+
+    const auto merge = [&](auto records)
+    {
+      using Records = decltype(records);
+      std::vector<std::unique_ptr<typename Records::RecordsEnumerator>> sources;
+      for (auto& run : runs)
+      {
+        sources.push_back(Records::CreateEnumerator(ExtSort::CreateStringsChunksEnumerator(run), ExtSort::KeySpec()));
+      }
+      const auto merged = ExtSort::CreateMergedRecordsEnumerator<Records>(std::move(sources), typename Records::Less(), stable);
+      std::size_t mergedLines = 0;
+      typename Records::Record record;
+      while (merged->Next(record))
+      {
+        ++mergedLines;
+      }
+      g_sink = g_sink + mergedLines;
+    };
+
+    g_comparisons = 0;
+    merge(CountingLineRecords());
+    const auto comparisons = g_comparisons;
+
+    const auto seconds = Measure(repeats, [&]()
+    {
+      merge(ExtSort::LineRecords());
+    });
+    return KernelResult{ (stable ? "stable_merge_fan_in_" : "merge_fan_in_") + std::to_string(fanIn), seconds, lines.size(), bytes, comparisons };
+  }
+
+  void Run(Utils::Arguments args)
+  {
+    const auto appName = args.GetArgument(ARG_APP_PATH);
+    if (args.HasArgument(ARG_USAGE_REQUEST))
+    {
+      LogUsage(appName);
+      return;
+    }
+
+    args.SetDefault(ARG_KERNELS           , DEFAULT_KERNELS);
+    args.SetDefault(ARG_DISTRIBUTION      , DEFAULT_DISTRIBUTION);
+    args.SetDefault(ARG_SIZE_MB           , DEFAULT_SIZE_MB);
+    args.SetDefault(ARG_MAX_LINE_LENGTH   , DEFAULT_MAX_LINE_LENGTH);
+    args.SetDefault(ARG_SEED              , DEFAULT_SEED);
+    args.SetDefault(ARG_FAN_IN            , DEFAULT_FAN_IN);
+    args.SetDefault(ARG_REPEATS           , DEFAULT_REPEATS);
+    args.SetDefault(ARG_RESULTS_FILE_PATH , DEFAULT_RESULTS_FILE_PATH);
+
+    const auto kernels         = args.GetArgument<std::string>(ARG_KERNELS);
+    Bench::DataParams params;
+    params.distribution        = Bench::ParseDistribution(args.GetArgument<std::string>(ARG_DISTRIBUTION));
+    params.size                = args.GetArgument<std::uint64_t>(ARG_SIZE_MB) << 20;
+    params.maxLineLength       = args.GetArgument<std::size_t>(ARG_MAX_LINE_LENGTH);
+    params.seed                = args.GetArgument<std::uint64_t>(ARG_SEED);
+    const auto fanIn           = args.GetArgument<std::size_t>(ARG_FAN_IN);
+    const auto repeats         = args.GetArgument<std::size_t>(ARG_REPEATS);
+    const auto resultsFilePath = args.GetArgument<std::string>(ARG_RESULTS_FILE_PATH);
+
+    ERR_THROW_IF(params.size == 0, std::string(ARG_SIZE_MB) + " should be >= 1.");
+    ERR_THROW_IF(fanIn < 2, std::string(ARG_FAN_IN) + " should be >= 2.");
+    ERR_THROW_IF(repeats == 0, std::string(ARG_REPEATS) + " should be >= 1.");
+
+    const auto hasKernel = [&](const std::string& kernel)
+    {
+      return ("," + kernels + ",").find("," + kernel + ",") != std::string::npos;
+    };
+
+    auto data = Bench::GenerateData(params, (std::max)(1u, std::thread::hardware_concurrency()));
+    const auto lines = SplitLines(data);
+    LOG_I("distribution = %s, size = %s, lines = %s",
+      Bench::GetDistributionName(params.distribution).c_str(),
+      std::to_string(data.size()).c_str(),
+      std::to_string(lines.size()).c_str());
+
+    std::vector<KernelResult> results;
+    if (hasKernel("merge_sort"))
+    {
+      results.push_back(RunMergeSort(lines, data.size(), repeats));
+    }
+    if (hasKernel("compare"))
+    {
+      results.push_back(RunCompare(lines, data.size(), repeats));
+    }
+    if (hasKernel("scan"))
+    {
+      results.push_back(RunScan(data, lines.size(), repeats));
+    }
+    if (hasKernel("merge"))
+    {
+      results.push_back(RunMerge(lines, data.size(), fanIn, false, repeats));
+    }
+    if (hasKernel("stable_merge"))
+    {
+      results.push_back(RunMerge(lines, data.size(), fanIn, true, repeats));
+    }
+    ERR_THROW_IF(results.empty(), "No kernels to run (" + std::string(ARG_KERNELS) + " = '" + kernels + "').");
+
+    std::ofstream resultsFile;
+    if (!resultsFilePath.empty())
+    {
+      const auto writeHeader = !Utils::Fs::IsExists(resultsFilePath);
+      resultsFile.open(resultsFilePath, std::ios::app);
+      ERR_THROW_IF_NOT(resultsFile, "Failed to open the results file (path = '" + resultsFilePath + "').");
+      if (writeHeader)
+      {
+        resultsFile << "kernel,distribution,size_bytes,lines,best_seconds,ns_per_line,GB_per_second,comparisons_per_line" << std::endl;
+      }
+    }
+
+    for (const auto& result : results)
+    {
+      const auto nsPerLine = result.bestSeconds * 1e9 / result.lines;
+      const auto gbPerSecond = result.bytes / result.bestSeconds / (1 << 30);
+      const auto comparisonsPerLine = static_cast<double>(result.comparisons) / result.lines;
+      LOG_I("%-16s : %8.2f ns/line, %7.3f GB/s, %6.2f comparisons/line", result.kernel.c_str(), nsPerLine, gbPerSecond, comparisonsPerLine);
+      if (resultsFile.is_open())
+      {
+        resultsFile << result.kernel << ',' << Bench::GetDistributionName(params.distribution) << ',' << result.bytes << ',' << result.lines << ','
+                    << std::fixed << std::setprecision(6) << result.bestSeconds << ',' << std::setprecision(3) << nsPerLine << ',' << gbPerSecond << ','
+                    << comparisonsPerLine << std::endl;
+      }
+    }
+    ERR_THROW_IF(resultsFile.is_open() && !resultsFile, "Failed to write the results file (path = '" + resultsFilePath + "').");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  int result = -1;
+  try
+  {
+    Run(Utils::Arguments(argc, argv));
+    result = 0;
+  }
+  catch (...)
+  {
+    Utils::Log::LogCurrentException("FAILED");
+  }
+  return result;
+}
@@ -0,0 +1,171 @@
+﻿#include <ext_sort/aggregation.h>
+
+#include <utils/err.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+namespace ExtSort
+{
+  namespace
+  {
+    // Formatted values are shorter, %.17g is needed for doubles to be parsed back exactly.
+    const std::size_t MAX_VALUE_SIZE = 32;
+
+    // Values which are whole 64-bit integers are parsed as integers, the other ones as doubles.
+    // Values without a number are integer 0 as missing ones, so they keep sums integer.
+    AggregatedValue ParseValue(const CharsChunk::ObjType* begin, const CharsChunk::ObjType* end)
+    {
+      // strtoll and strtod require a null terminated string.
+      char str[64];
+      const auto size = (std::min)(static_cast<std::size_t>(end - begin), sizeof(str) - 1);
+      std::copy(begin, begin + size, str);
+      str[size] = 0;
+
+      AggregatedValue value;
+      char* parsedEnd = nullptr;
+      errno = 0;
+      const auto integer = std::strtoll(str, &parsedEnd, 10);
+      if (parsedEnd != str && *parsedEnd == 0 && errno == 0)
+      {
+        value.integer = integer;
+        return value;
+      }
+      const auto real = std::strtod(str, &parsedEnd);
+      if (parsedEnd == str)
+      {
+        return value;
+      }
+      value.isInteger = false;
+      value.real = real;
+      return value;
+    }
+
+    double ToReal(const AggregatedValue& value)
+    {
+      return value.isInteger ? static_cast<double>(value.integer) : value.real;
+    }
+
+    class AggregatedChunksEnumerator : public CharsChunksEnumerator
+    {
+      std::unique_ptr<CharsChunksEnumerator> m_chunks;
+      const CharsChunk::ObjType m_fieldsDelim;
+
+    public:
+      AggregatedChunksEnumerator(std::unique_ptr<CharsChunksEnumerator> chunks, CharsChunk::ObjType fieldsDelim)
+        : m_chunks(std::move(chunks))
+        , m_fieldsDelim(fieldsDelim)
+      {
+        ERR_THROW_IF_NOT(m_chunks, "Invalid argument (chunks enumerator is null).");
+      }
+
+      virtual void SetObserver(EventsObserver observer) override
+      {
+        m_chunks->SetObserver(observer);
+      }
+
+      virtual bool Next(CharsChunk& chunk) override
+      {
+        if (!m_chunks->Next(chunk))
+        {
+          return false;
+        }
+
+        auto* valueDelim = chunk.end;
+        while (valueDelim != chunk.begin && *(valueDelim - 1) != m_fieldsDelim)
+        {
+          --valueDelim;
+        }
+        ERR_THROW_IF(valueDelim == chunk.begin, "Aggregated value is expected.");
+        chunk.end = valueDelim - 1;
+        return true;
+      }
+
+      AggregatedChunksEnumerator(const AggregatedChunksEnumerator&) = delete;
+      AggregatedChunksEnumerator& operator = (const AggregatedChunksEnumerator&) = delete;
+    };
+  }
+
+  AggregatedValue& AggregatedValue::operator += (const AggregatedValue& other)
+  {
+    if (isInteger && other.isInteger)
+    {
+      const auto max = (std::numeric_limits<std::int64_t>::max)();
+      const auto min = (std::numeric_limits<std::int64_t>::min)();
+      const auto overflow = other.integer > 0 ? integer > max - other.integer : integer < min - other.integer;
+      if (!overflow)
+      {
+        integer += other.integer;
+        return *this;
+      }
+    }
+    real = ToReal(*this) + ToReal(other);
+    isInteger = false;
+    return *this;
+  }
+
+  AggregatedValue GetSourceValue(const Aggregation& aggregation, const CharsChunk& chunk, CharsChunk::ObjType fieldsDelim)
+  {
+    if (aggregation.type == Aggregation::Type::COUNT)
+    {
+      AggregatedValue value;
+      value.integer = 1;
+      return value;
+    }
+
+    ERR_THROW_IF(aggregation.valueField == 0, "Invalid argument (value field numbers are 1-based).");
+    const CharsChunk::ObjType* const chunkEnd = chunk.end;
+    const CharsChunk::ObjType* fieldBegin = chunk.begin;
+    for (std::size_t fieldNumber = 1; fieldNumber != aggregation.valueField; ++fieldNumber)
+    {
+      fieldBegin = std::find(fieldBegin, chunkEnd, fieldsDelim);
+      if (fieldBegin == chunkEnd)
+      {
+        return AggregatedValue();
+      }
+      ++fieldBegin;
+    }
+    return ParseValue(fieldBegin, std::find(fieldBegin, chunkEnd, fieldsDelim));
+  }
+
+  AggregatedValue GetAggregatedValue(const CharsChunk& chunk, CharsChunk::ObjType chunksDelim)
+  {
+    const auto* valueBegin = chunk.end + 1;
+    const auto* valueEnd = valueBegin;
+    while (*valueEnd != chunksDelim)
+    {
+      ERR_THROW_IF(static_cast<std::size_t>(valueEnd - valueBegin) == MAX_VALUE_SIZE, "Aggregated value is too long.");
+      ++valueEnd;
+    }
+    return ParseValue(valueBegin, valueEnd);
+  }
+
+  void FormatAggregatedChunk(const CharsChunk& chunk,
+                             AggregatedValue value,
+                             CharsChunk::ObjType fieldsDelim,
+                             CharsChunk::ObjType chunksDelim,
+                             std::string& result)
+  {
+    char formattedValue[MAX_VALUE_SIZE];
+    const auto size = value.isInteger
+      ? std::snprintf(formattedValue, sizeof(formattedValue), "%" PRId64, value.integer)
+      : std::snprintf(formattedValue, sizeof(formattedValue), "%.17g", value.real);
+    ERR_THROW_IF(size <= 0 || static_cast<std::size_t>(size) >= sizeof(formattedValue), "Failed to format aggregated value.");
+
+    result.assign(chunk.begin, chunk.end);
+    result.push_back(fieldsDelim);
+    result.append(formattedValue, static_cast<std::size_t>(size));
+    result.push_back(chunksDelim);
+  }
+
+  std::unique_ptr<CharsChunksEnumerator> CreateAggregatedChunksEnumerator(
+    std::unique_ptr<CharsChunksEnumerator> chunks,
+    CharsChunk::ObjType fieldsDelim)
+  {
+    return std::make_unique<AggregatedChunksEnumerator>(std::move(chunks), fieldsDelim);
+  }
+}
@@ -0,0 +1,75 @@
+﻿#ifndef __EXT_SORT_AGGREGATION_H__
+#define __EXT_SORT_AGGREGATION_H__
+
+#include <ext_sort/types.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace ExtSort
+{
+  // Chunks with equal keys are aggregated into the first one of them followed by
+  // the fields delimiter and the aggregated value. Runs and merge phases produce
+  // aggregated chunks, so every phase aggregates partial values again.
+  struct Aggregation
+  {
+    enum class Type
+    {
+      NONE,
+      // Both aggregates are combined by addition.
+      COUNT,
+      SUM,
+    };
+
+    Type type;
+    // 1-based number of the summed field.
+    std::size_t valueField;
+
+    Aggregation()
+      : type(Type::NONE)
+      , valueField(0)
+    {
+    }
+  };
+
+  // Counts and sums of integer values are exact 64-bit integers. A sum becomes a double
+  // when a value is not an integer or the integer sum overflows.
+  struct AggregatedValue
+  {
+    bool isInteger;
+    std::int64_t integer;
+    double real;
+
+    AggregatedValue()
+      : isInteger(true)
+      , integer(0)
+      , real(0)
+    {
+    }
+
+    AggregatedValue& operator += (const AggregatedValue& other);
+  };
+
+  // The value of a source chunk: 1 to count it or its value field (unparsable values are 0).
+  AggregatedValue GetSourceValue(const Aggregation& aggregation, const CharsChunk& chunk, CharsChunk::ObjType fieldsDelim);
+
+  // The value of an aggregated chunk. It is read past the chunk end, so the chunk should be one returned
+  // by CreateAggregatedChunksEnumerator: its value field and the chunks delimiter follow it in the same
+  // buffer. The value is not longer than a formatted one.
+  AggregatedValue GetAggregatedValue(const CharsChunk& chunk, CharsChunk::ObjType chunksDelim);
+
+  // Formats 'chunk<fieldsDelim>value<chunksDelim>', the result without the chunks delimiter is a chunk for CreateFileChunksWriter.
+  void FormatAggregatedChunk(const CharsChunk& chunk,
+                             AggregatedValue value,
+                             CharsChunk::ObjType fieldsDelim,
+                             CharsChunk::ObjType chunksDelim,
+                             std::string& result);
+
+  // Strips the last field with the aggregated value, so keys are parsed as for source chunks.
+  std::unique_ptr<CharsChunksEnumerator> CreateAggregatedChunksEnumerator(
+    std::unique_ptr<CharsChunksEnumerator> chunks,
+    CharsChunk::ObjType fieldsDelim);
+}
+
+#endif
@@ -0,0 +1,305 @@
+﻿#include <ext_sort/checkpoint.h>
+
+#include <ext_sort/ext_sort_utils.h>
+#include <ext_sort/file_chunks_writer.h>
+
+#include <utils/err.h>
+#include <utils/hex.h>
+#include <utils/log/log.h>
+#include <utils/str_conv.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace ExtSort
+{
+  namespace
+  {
+    const char* const MANIFEST_FILE_NAME = "manifest.txt";
+
+    // Every manifest line is a tag with tab separated values.
+    const char* const OUTPUT_TAG = "output";
+    const char* const RUN_TAG = "run";
+    const char* const SPLITTER_TAG = "splitter";
+    const char* const SORTED_TAG = "sorted";
+    const char* const MERGED_TAG = "merged";
+    const char* const DONE_TAG = "done";
+    const char FIELDS_DELIM = '\t';
+
+    std::vector<std::string> SplitLine(const std::string& line)
+    {
+      std::vector<std::string> fields;
+      std::istringstream iss(line);
+      std::string field;
+      while (std::getline(iss, field, FIELDS_DELIM))
+      {
+        fields.push_back(field);
+      }
+      return fields;
+    }
+
+    std::string FormatChecksum(std::uint64_t checksum)
+    {
+      std::ostringstream oss;
+      oss << std::hex << checksum;
+      return oss.str();
+    }
+
+    std::uint64_t ParseChecksum(const std::string& value)
+    {
+      std::uint64_t checksum = 0;
+      std::istringstream iss(value);
+      iss.exceptions(std::istream::failbit | std::istream::badbit);
+      iss >> std::hex >> checksum;
+      return checksum;
+    }
+
+    std::string FormatFileInfo(const Checkpoint::FileInfo& fileInfo)
+    {
+      return fileInfo.path + FIELDS_DELIM + std::to_string(fileInfo.size) + FIELDS_DELIM + FormatChecksum(fileInfo.checksum);
+    }
+
+    Checkpoint::FileInfo ParseFileInfo(const std::vector<std::string>& fields, std::size_t index)
+    {
+      ERR_THROW_IF(fields.size() < index + 3, "Bad manifest line (fields count = " + std::to_string(fields.size()) + ").");
+      Checkpoint::FileInfo fileInfo;
+      fileInfo.path = fields[index];
+      fileInfo.size = Utils::FromString<Utils::Fs::Size>(fields[index + 1]);
+      fileInfo.checksum = ParseChecksum(fields[index + 2]);
+      return fileInfo;
+    }
+  }
+
+  Checkpoint::Checkpoint(const std::string& tempDirPath, const BytesChunk& buffer)
+    : m_manifestFilePath(Utils::Fs::AppendPath(tempDirPath, MANIFEST_FILE_NAME))
+    , m_buffer(buffer)
+    , m_done(false)
+  {
+    CheckChunk(m_buffer);
+    EnableWrittenChecksums();
+    if (Utils::Fs::IsExists(m_manifestFilePath))
+    {
+      Load();
+    }
+  }
+
+  bool Checkpoint::IsResumed() const
+  {
+    return !m_outputFilePath.empty();
+  }
+
+  bool Checkpoint::IsDone() const
+  {
+    return m_done;
+  }
+
+  std::string Checkpoint::GetOutputFilePath() const
+  {
+    return m_outputFilePath;
+  }
+
+  void Checkpoint::SetOutputFilePath(const std::string& outputFilePath)
+  {
+    ERR_THROW_IF(IsResumed(), "Invalid state (the output is already set).");
+    ERR_THROW_IF(outputFilePath.empty(), "Invalid argument (output file path is empty).");
+    Append(OUTPUT_TAG + std::string(1, FIELDS_DELIM) + outputFilePath);
+    m_outputFilePath = outputFilePath;
+  }
+
+  bool Checkpoint::GetSortedFiles(const std::string& prefix, std::vector<std::string>& sortedFilePaths, std::vector<std::string>& splitters)
+  {
+    const auto iter = m_sorted.find(prefix);
+    if (iter == m_sorted.end())
+    {
+      return false;
+    }
+
+    sortedFilePaths.clear();
+    for (const auto& fileInfo : iter->second.sortedFiles)
+    {
+      sortedFilePaths.push_back(fileInfo.path);
+    }
+    splitters = iter->second.splitters;
+    return true;
+  }
+
+  void Checkpoint::AddSortedFiles(const std::string& prefix, const std::vector<std::string>& sortedFilePaths, const std::vector<std::string>& splitters)
+  {
+    ERR_THROW_IF(m_sorted.count(prefix) != 0, "Invalid argument (sorted files are already added, prefix = '" + prefix + "').");
+
+    Utils::Log::ScopedInfoLog scope("Checkpoint::AddSortedFiles");
+    SortedData sortedData;
+    for (const auto& filePath : sortedFilePaths)
+    {
+      sortedData.sortedFiles.push_back(GetFileInfo(filePath));
+      Append(RUN_TAG + std::string(1, FIELDS_DELIM) + prefix + FIELDS_DELIM + FormatFileInfo(sortedData.sortedFiles.back()));
+    }
+    for (const auto& splitter : splitters)
+    {
+      Append(SPLITTER_TAG + std::string(1, FIELDS_DELIM) + prefix + FIELDS_DELIM + Utils::EncodeHex(splitter));
+    }
+    sortedData.splitters = splitters;
+    m_recordedFilePaths.insert(sortedFilePaths.begin(), sortedFilePaths.end());
+    // Runs of a phase without the sorted record are ignored on resume.
+    Append(SORTED_TAG + std::string(1, FIELDS_DELIM) + prefix);
+    m_sorted[prefix] = std::move(sortedData);
+  }
+
+  std::vector<std::string> Checkpoint::GetMergeSources(const std::vector<std::string>& sortedFilePaths)
+  {
+    Utils::Log::ScopedInfoLog scope("Checkpoint::GetMergeSources");
+
+    // The sources are replaced in place, the merge tasks merge consecutive files, so the order is kept.
+    std::vector<std::string> sources = sortedFilePaths;
+    for (const auto& merged : m_merged)
+    {
+      const auto first = std::find(sources.begin(), sources.end(), merged.sourceFilePaths.front());
+      ERR_THROW_IF(first == sources.end(), "Bad manifest (unknown merge source = '" + merged.sourceFilePaths.front() + "').");
+      ERR_THROW_IF(static_cast<std::size_t>(sources.end() - first) < merged.sourceFilePaths.size() || !std::equal(merged.sourceFilePaths.begin(), merged.sourceFilePaths.end(), first),
+        "Bad manifest (merge sources are not consecutive).");
+      const auto pos = sources.erase(first, first + merged.sourceFilePaths.size());
+      sources.insert(pos, merged.resultFile.path);
+    }
+
+    std::map<std::string, const FileInfo*> fileInfos;
+    for (const auto& sorted : m_sorted)
+    {
+      for (const auto& fileInfo : sorted.second.sortedFiles)
+      {
+        fileInfos[fileInfo.path] = &fileInfo;
+      }
+    }
+    for (const auto& merged : m_merged)
+    {
+      fileInfos[merged.resultFile.path] = &merged.resultFile;
+    }
+    for (const auto& source : sources)
+    {
+      const auto iter = fileInfos.find(source);
+      if (iter != fileInfos.end() && m_recordedFilePaths.count(source) == 0)
+      {
+        Validate(*iter->second);
+      }
+    }
+    return sources;
+  }
+
+  void Checkpoint::AddMergeTask(const std::vector<std::string>& sourceFilePaths, const std::string& resultFilePath)
+  {
+    ERR_THROW_IF(sourceFilePaths.empty(), "Invalid argument (source file paths are empty).");
+
+    MergedData merged;
+    merged.sourceFilePaths = sourceFilePaths;
+    merged.resultFile = GetFileInfo(resultFilePath);
+
+    std::string line = MERGED_TAG + std::string(1, FIELDS_DELIM) + FormatFileInfo(merged.resultFile);
+    for (const auto& source : sourceFilePaths)
+    {
+      line += FIELDS_DELIM + source;
+    }
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    Append(line);
+    m_recordedFilePaths.insert(resultFilePath);
+    m_merged.push_back(std::move(merged));
+  }
+
+  void Checkpoint::SetDone()
+  {
+    Append(DONE_TAG);
+    m_done = true;
+  }
+
+  void Checkpoint::Load()
+  {
+    Utils::Log::ScopedInfoLog scope("Checkpoint::Load");
+    LOG_I("manifest = '%s'", m_manifestFilePath.c_str());
+
+    std::map<std::string, SortedData> runs;
+    std::ifstream manifest(m_manifestFilePath, std::ios::binary);
+    ERR_THROW_IF_NOT(manifest, "Failed to open the manifest (path = '" + m_manifestFilePath + "').");
+    std::string line;
+    while (std::getline(manifest, line))
+    {
+      // The last line may be cut if the sort is killed while it is written.
+      if (manifest.eof())
+      {
+        LOG_W("%s", ("Incomplete manifest line is skipped: '" + line + "'.").c_str());
+        break;
+      }
+
+      const auto fields = SplitLine(line);
+      ERR_THROW_IF(fields.empty(), "Bad manifest (empty line).");
+      const auto& tag = fields[0];
+      if (tag == OUTPUT_TAG && fields.size() == 2)
+      {
+        m_outputFilePath = fields[1];
+      }
+      else if (tag == RUN_TAG && fields.size() == 5)
+      {
+        runs[fields[1]].sortedFiles.push_back(ParseFileInfo(fields, 2));
+      }
+      else if (tag == SPLITTER_TAG && fields.size() <= 3)
+      {
+        runs[fields[1]].splitters.push_back(fields.size() == 3 ? Utils::DecodeHex(fields[2]) : std::string());
+      }
+      else if (tag == SORTED_TAG && fields.size() == 2)
+      {
+        m_sorted[fields[1]] = std::move(runs[fields[1]]);
+        runs.erase(fields[1]);
+      }
+      else if (tag == MERGED_TAG && fields.size() > 4)
+      {
+        MergedData merged;
+        merged.resultFile = ParseFileInfo(fields, 1);
+        merged.sourceFilePaths.assign(fields.begin() + 4, fields.end());
+        m_merged.push_back(std::move(merged));
+      }
+      else if (tag == DONE_TAG)
+      {
+        m_done = true;
+      }
+      else
+      {
+        ERR_THROW("Bad manifest line: '" + line + "'.");
+      }
+    }
+
+    LOG_I("completed sort phases = %s", std::to_string(m_sorted.size()).c_str());
+    LOG_I("completed merge tasks = %s", std::to_string(m_merged.size()).c_str());
+  }
+
+  void Checkpoint::Append(const std::string& line)
+  {
+    const auto manifest = Utils::Fs::OpenFile(m_manifestFilePath, "ab");
+    // The line is written by one call, so the file needs no stream buffer.
+    const auto disableBufferResult = setvbuf(manifest.get(), nullptr, _IONBF, 0);
+    ERR_THROW_IF(disableBufferResult != 0, "Failed to disable buffering (error = " + std::to_string(disableBufferResult) + ").");
+    const auto data = line + '\n';
+    ERR_THROW_IF(fwrite(data.data(), data.size(), 1, manifest.get()) != 1, "Failed to write the manifest (path = '" + m_manifestFilePath + "').");
+    ERR_THROW_IF(fflush(manifest.get()) != 0, "Failed to flush the manifest (path = '" + m_manifestFilePath + "').");
+  }
+
+  Checkpoint::FileInfo Checkpoint::GetFileInfo(const std::string& filePath) const
+  {
+    FileInfo fileInfo;
+    fileInfo.path = filePath;
+    fileInfo.size = Utils::Fs::GetSize(filePath);
+    if (!GetWrittenChecksum(filePath, fileInfo.checksum))
+    {
+      fileInfo.checksum = GetFileChecksum(filePath, m_buffer);
+    }
+    return fileInfo;
+  }
+
+  void Checkpoint::Validate(const FileInfo& fileInfo) const
+  {
+    ERR_THROW_IF_NOT(Utils::Fs::IsExists(fileInfo.path), "Checkpoint file not exists (path = '" + fileInfo.path + "').");
+    const auto size = Utils::Fs::GetSize(fileInfo.path);
+    ERR_THROW_IF(size != fileInfo.size, "Checkpoint file size mismatch (path = '" + fileInfo.path + "', size = " + std::to_string(size) + ", expected = " + std::to_string(fileInfo.size) + ").");
+    const auto checksum = GetFileChecksum(fileInfo.path, m_buffer);
+    ERR_THROW_IF(checksum != fileInfo.checksum, "Checkpoint file checksum mismatch (path = '" + fileInfo.path + "').");
+  }
+}
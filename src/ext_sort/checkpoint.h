@@ -0,0 +1,86 @@
+﻿#ifndef __EXT_SORT_CHECKPOINT_H__
+#define __EXT_SORT_CHECKPOINT_H__
+
+#include <ext_sort/types.h>
+
+#include <utils/fs/fs.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace ExtSort
+{
+  // A manifest in the temp dir of a sort recording its completed steps, so a killed sort
+  // is resumed from the first incomplete one. Files of the completed steps are recorded
+  // with their sizes and checksums and are validated before they are used again.
+  class Checkpoint
+  {
+  public:
+    struct FileInfo
+    {
+      std::string path;
+      Utils::Fs::Size size;
+      std::uint64_t checksum;
+    };
+
+  private:
+    struct SortedData
+    {
+      std::vector<FileInfo> sortedFiles;
+      std::vector<std::string> splitters;
+    };
+
+    struct MergedData
+    {
+      std::vector<std::string> sourceFilePaths;
+      FileInfo resultFile;
+    };
+
+    const std::string m_manifestFilePath;
+    const BytesChunk m_buffer;
+    std::mutex m_mutex;
+    std::string m_outputFilePath;
+    bool m_done;
+    // Sort phases are identified by the prefixes of their file names.
+    std::map<std::string, SortedData> m_sorted;
+    std::vector<MergedData> m_merged;
+    // Files recorded by this process are not validated.
+    std::set<std::string> m_recordedFilePaths;
+
+  public:
+    // Loads the manifest if the temp dir has one. The files written after it get their checksums
+    // from the writers (see EnableWrittenChecksums), the buffer is used to compute the other ones.
+    Checkpoint(const std::string& tempDirPath, const BytesChunk& buffer);
+
+    bool IsResumed() const;
+    bool IsDone() const;
+    // The result of the sort. Results of a resumed sort are incomplete.
+    std::string GetOutputFilePath() const;
+    void SetOutputFilePath(const std::string& outputFilePath);
+
+    // Returns false if the sort phase is not completed.
+    bool GetSortedFiles(const std::string& prefix, std::vector<std::string>& sortedFilePaths, std::vector<std::string>& splitters);
+    void AddSortedFiles(const std::string& prefix, const std::vector<std::string>& sortedFilePaths, const std::vector<std::string>& splitters);
+
+    // Replaces the sources of the completed merge tasks by their results.
+    std::vector<std::string> GetMergeSources(const std::vector<std::string>& sortedFilePaths);
+    void AddMergeTask(const std::vector<std::string>& sourceFilePaths, const std::string& resultFilePath);
+
+    void SetDone();
+
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator = (const Checkpoint&) = delete;
+
+  private:
+    void Load();
+    void Append(const std::string& line);
+    FileInfo GetFileInfo(const std::string& filePath) const;
+    void Validate(const FileInfo& fileInfo) const;
+  };
+}
+
+#endif
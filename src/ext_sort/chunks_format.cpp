@@ -0,0 +1,301 @@
+﻿#include <ext_sort/chunks_format.h>
+#include <ext_sort/file_chunks_enumerator.h>
+#include <ext_sort/fixed_size_chunks_enumerator.h>
+#include <ext_sort/varint_chunks_enumerator.h>
+
+#include <utils/err.h>
+#include <utils/varint.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace ExtSort
+{
+  namespace
+  {
+    // Returns the offset right after the first delimiter at or after the offset.
+    Utils::Fs::Size FindDelimitedBoundary(FILE* file, Utils::Fs::Size offset, Utils::Fs::Size end, CharsChunk::ObjType delim)
+    {
+      Utils::Fs::SeekFile(file, offset);
+      CharsChunk::ObjType buffer[4096];
+      while (offset < end)
+      {
+        const auto toRead = static_cast<std::size_t>((std::min)(end - offset, static_cast<Utils::Fs::Size>(sizeof(buffer) / sizeof(buffer[0]))));
+        const auto read = fread(buffer, sizeof(buffer[0]), toRead, file);
+        ERR_THROW_IF(read != toRead, "Failed to read the file.");
+        const auto* const delimPos = std::find(buffer, buffer + read, delim);
+        if (delimPos != buffer + read)
+        {
+          return offset + (delimPos - buffer) + 1;
+        }
+        offset += read;
+      }
+      return end;
+    }
+
+    // Returns the offset of the first record at or after the target walking the records from the offset.
+    Utils::Fs::Size FindVarintBoundary(FILE* file, Utils::Fs::Size offset, Utils::Fs::Size target, Utils::Fs::Size end)
+    {
+      Utils::Fs::SeekFile(file, offset);
+      while (offset < target)
+      {
+        unsigned char prefix[Utils::MAX_VARINT_SIZE];
+        std::size_t prefixSize = 0;
+        do
+        {
+          ERR_THROW_IF(prefixSize == Utils::MAX_VARINT_SIZE || offset + static_cast<Utils::Fs::Size>(prefixSize) >= end, "Bad varint size prefix.");
+          ERR_THROW_IF(fread(prefix + prefixSize, 1, 1, file) != 1, "Failed to read the file.");
+        }
+        while (prefix[prefixSize++] & 0x80);
+
+        std::uint64_t recordSize = 0;
+        ERR_THROW_IF(Utils::DecodeVarint(prefix, prefix + prefixSize, recordSize) == 0, "Bad varint size prefix.");
+        offset += static_cast<Utils::Fs::Size>(prefixSize);
+        ERR_THROW_IF(recordSize > static_cast<std::uint64_t>(end - offset), "Unexpected end of file. A whole record is expected.");
+        offset += static_cast<Utils::Fs::Size>(recordSize);
+        Utils::Fs::SeekFile(file, offset);
+      }
+      return offset;
+    }
+  }
+
+  std::unique_ptr<CharsChunksEnumerator> CreateFileChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    const ChunksFormat& format)
+  {
+    return CreateFileChunksEnumerator(sourceFilePath, buffer, format, Utils::Fs::FileRange{ 0, Utils::Fs::GetSize(sourceFilePath) });
+  }
+
+  std::unique_ptr<CharsChunksEnumerator> CreateFileChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    const ChunksFormat& format,
+    const Utils::Fs::FileRange& range)
+  {
+    switch (format.type)
+    {
+      case ChunksFormat::Type::DELIMITED:
+        return CreateFileChunksEnumerator(sourceFilePath, buffer, format.delim, range);
+
+      case ChunksFormat::Type::FIXED_SIZE:
+        return CreateFixedSizeChunksEnumerator(sourceFilePath, buffer, format.chunkSize, range);
+
+      case ChunksFormat::Type::VARINT_PREFIXED:
+        return CreateVarintChunksEnumerator(sourceFilePath, buffer, range);
+    }
+
+    ERR_THROW("Unexpected chunks format.");
+    return nullptr;
+  }
+
+  std::vector<Utils::Fs::FileRange> SplitFileRange(
+    const std::string& filePath,
+    const Utils::Fs::FileRange& range,
+    std::size_t partsCount,
+    const ChunksFormat& format)
+  {
+    ERR_THROW_IF(partsCount == 0, "Invalid argument (parts count is 0).");
+    ERR_THROW_IF(format.type == ChunksFormat::Type::FIXED_SIZE && format.chunkSize == 0, "Invalid argument (chunk size is 0).");
+
+    const auto file = Utils::Fs::OpenFile(filePath, "rb");
+    const auto rangeSize = range.GetSize();
+    std::vector<Utils::Fs::FileRange> ranges;
+    auto partBegin = range.begin;
+    for (std::size_t part = 1; part <= partsCount && partBegin != range.end; ++part)
+    {
+      auto partEnd = range.begin + static_cast<Utils::Fs::Size>(rangeSize / partsCount * part + rangeSize % partsCount * part / partsCount);
+      if (part != partsCount && partEnd > partBegin)
+      {
+        switch (format.type)
+        {
+          case ChunksFormat::Type::DELIMITED:
+            partEnd = FindDelimitedBoundary(file.get(), partEnd - 1, range.end, format.delim);
+            break;
+
+          case ChunksFormat::Type::FIXED_SIZE:
+            partEnd -= (partEnd - range.begin) % static_cast<Utils::Fs::Size>(format.chunkSize);
+            break;
+
+          case ChunksFormat::Type::VARINT_PREFIXED:
+            partEnd = FindVarintBoundary(file.get(), partBegin, partEnd, range.end);
+            break;
+        }
+      }
+      if (partEnd > partBegin)
+      {
+        ranges.push_back(Utils::Fs::FileRange{ partBegin, partEnd });
+        partBegin = partEnd;
+      }
+    }
+    return ranges;
+  }
+
+  Utils::Fs::Size FindChunkBegin(FILE* file, const Utils::Fs::FileRange& range, Utils::Fs::Size offset, const ChunksFormat& format)
+  {
+    ERR_THROW_IF(format.type == ChunksFormat::Type::FIXED_SIZE && format.chunkSize == 0, "Invalid argument (chunk size is 0).");
+
+    if (offset <= range.begin)
+    {
+      return range.begin;
+    }
+    if (offset >= range.end)
+    {
+      return range.end;
+    }
+    switch (format.type)
+    {
+      case ChunksFormat::Type::DELIMITED:
+        return FindDelimitedBoundary(file, offset - 1, range.end, format.delim);
+
+      case ChunksFormat::Type::FIXED_SIZE:
+      {
+        const auto chunkSize = static_cast<Utils::Fs::Size>(format.chunkSize);
+        return (std::min)(range.begin + (offset - range.begin + chunkSize - 1) / chunkSize * chunkSize, range.end);
+      }
+
+      case ChunksFormat::Type::VARINT_PREFIXED:
+        return FindVarintBoundary(file, range.begin, offset, range.end);
+    }
+
+    ERR_THROW("Unexpected chunks format.");
+    return 0;
+  }
+
+  Utils::Fs::Size ReadChunk(FILE* file, Utils::Fs::Size offset, Utils::Fs::Size end, const ChunksFormat& format, std::string& chunk)
+  {
+    ERR_THROW_IF(offset >= end, "Invalid argument (offset is out of the range).");
+
+    Utils::Fs::SeekFile(file, offset);
+    chunk.clear();
+    switch (format.type)
+    {
+      case ChunksFormat::Type::DELIMITED:
+      {
+        CharsChunk::ObjType buffer[4096];
+        for (auto readOffset = offset; readOffset < end;)
+        {
+          const auto toRead = static_cast<std::size_t>((std::min)(end - readOffset, static_cast<Utils::Fs::Size>(sizeof(buffer) / sizeof(buffer[0]))));
+          const auto read = fread(buffer, sizeof(buffer[0]), toRead, file);
+          ERR_THROW_IF(read != toRead, "Failed to read the file.");
+          const auto* const delimPos = std::find(buffer, buffer + read, format.delim);
+          chunk.append(buffer, static_cast<std::size_t>(delimPos - buffer));
+          if (delimPos != buffer + read)
+          {
+            return offset + static_cast<Utils::Fs::Size>(chunk.size()) + 1;
+          }
+          readOffset += read;
+        }
+        ERR_THROW("Unexpected end of file. A delimiter is expected.");
+        return end;
+      }
+
+      case ChunksFormat::Type::FIXED_SIZE:
+      {
+        ERR_THROW_IF(offset + static_cast<Utils::Fs::Size>(format.chunkSize) > end, "Unexpected end of file. A whole record is expected.");
+        chunk.resize(format.chunkSize);
+        ERR_THROW_IF(fread(&chunk[0], 1, chunk.size(), file) != chunk.size(), "Failed to read the file.");
+        return offset + static_cast<Utils::Fs::Size>(chunk.size());
+      }
+
+      case ChunksFormat::Type::VARINT_PREFIXED:
+      {
+        unsigned char prefix[Utils::MAX_VARINT_SIZE];
+        std::size_t prefixSize = 0;
+        do
+        {
+          ERR_THROW_IF(prefixSize == Utils::MAX_VARINT_SIZE || offset + static_cast<Utils::Fs::Size>(prefixSize) >= end, "Bad varint size prefix.");
+          ERR_THROW_IF(fread(prefix + prefixSize, 1, 1, file) != 1, "Failed to read the file.");
+        }
+        while (prefix[prefixSize++] & 0x80);
+
+        std::uint64_t chunkSize = 0;
+        ERR_THROW_IF(Utils::DecodeVarint(prefix, prefix + prefixSize, chunkSize) == 0, "Bad varint size prefix.");
+        const auto chunkBegin = offset + static_cast<Utils::Fs::Size>(prefixSize);
+        ERR_THROW_IF(chunkSize > static_cast<std::uint64_t>(end - chunkBegin), "Unexpected end of file. A whole record is expected.");
+        const auto chunkEnd = chunkBegin + static_cast<Utils::Fs::Size>(chunkSize);
+        chunk.resize(static_cast<std::size_t>(chunkSize));
+        ERR_THROW_IF(!chunk.empty() && fread(&chunk[0], 1, chunk.size(), file) != chunk.size(), "Failed to read the file.");
+        return chunkEnd;
+      }
+    }
+
+    ERR_THROW("Unexpected chunks format.");
+    return 0;
+  }
+
+  std::size_t GetEncodedSize(const CharsChunk& chunk, const ChunksFormat& format)
+  {
+    const auto size = chunk.BytesCount();
+    switch (format.type)
+    {
+      case ChunksFormat::Type::DELIMITED:
+        return size + CharsChunk::SizeOfObject();
+
+      case ChunksFormat::Type::FIXED_SIZE:
+        return size;
+
+      case ChunksFormat::Type::VARINT_PREFIXED:
+      {
+        unsigned char prefix[Utils::MAX_VARINT_SIZE];
+        return size + Utils::EncodeVarint(size, prefix);
+      }
+    }
+
+    ERR_THROW("Unexpected chunks format.");
+    return 0;
+  }
+
+  CharsChunk::ObjType* ParseChunk(CharsChunk::ObjType* begin, CharsChunk::ObjType* end, const ChunksFormat& format, CharsChunk& chunk)
+  {
+    switch (format.type)
+    {
+      case ChunksFormat::Type::DELIMITED:
+      {
+        auto* const delimPos = static_cast<CharsChunk::ObjType*>(std::memchr(begin, format.delim, static_cast<std::size_t>(end - begin)));
+        if (delimPos == nullptr)
+        {
+          return nullptr;
+        }
+        chunk.begin = begin;
+        chunk.end = delimPos;
+        return delimPos + 1;
+      }
+
+      case ChunksFormat::Type::FIXED_SIZE:
+      {
+        ERR_THROW_IF(format.chunkSize == 0, "Invalid argument (chunk size is 0).");
+        if (static_cast<std::size_t>(end - begin) < format.chunkSize)
+        {
+          return nullptr;
+        }
+        chunk.begin = begin;
+        chunk.end = begin + format.chunkSize;
+        return chunk.end;
+      }
+
+      case ChunksFormat::Type::VARINT_PREFIXED:
+      {
+        std::uint64_t size = 0;
+        const auto prefixSize = Utils::DecodeVarint((const unsigned char*)begin, (const unsigned char*)end, size);
+        if (prefixSize == 0)
+        {
+          ERR_THROW_IF(static_cast<std::size_t>(end - begin) >= Utils::MAX_VARINT_SIZE, "Bad record size prefix.");
+          return nullptr;
+        }
+        auto* const payload = begin + prefixSize;
+        if (static_cast<std::uint64_t>(end - payload) < size)
+        {
+          return nullptr;
+        }
+        chunk.begin = payload;
+        chunk.end = payload + size;
+        return chunk.end;
+      }
+    }
+
+    ERR_THROW("Unexpected chunks format.");
+    return nullptr;
+  }
+}
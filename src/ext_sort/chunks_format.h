@@ -0,0 +1,74 @@
+﻿#ifndef __EXT_SORT_CHUNKS_FORMAT_H__
+#define __EXT_SORT_CHUNKS_FORMAT_H__
+
+#include <ext_sort/types.h>
+
+#include <utils/fs/fs.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ExtSort
+{
+  // How chunks are stored in the input, temp and result files.
+  struct ChunksFormat
+  {
+    enum class Type
+    {
+      // Every chunk is followed by the delimiter.
+      DELIMITED,
+      // Every chunk has the same size and there are no delimiters.
+      FIXED_SIZE,
+      // Every chunk is prefixed by its varint encoded size, so chunks may contain any bytes.
+      VARINT_PREFIXED,
+    };
+
+    Type type;
+    CharsChunk::ObjType delim;
+    std::size_t chunkSize;
+
+    ChunksFormat()
+      : type(Type::DELIMITED)
+      , delim('\n')
+      , chunkSize(0)
+    {
+    }
+  };
+
+  std::unique_ptr<CharsChunksEnumerator> CreateFileChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    const ChunksFormat& format);
+
+  // The range should contain whole chunks.
+  std::unique_ptr<CharsChunksEnumerator> CreateFileChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    const ChunksFormat& format,
+    const Utils::Fs::FileRange& range);
+
+  // Splits the range into up to partsCount ranges of similar sizes which begin and end at chunk boundaries.
+  std::vector<Utils::Fs::FileRange> SplitFileRange(
+    const std::string& filePath,
+    const Utils::Fs::FileRange& range,
+    std::size_t partsCount,
+    const ChunksFormat& format);
+
+  // Returns the begin of the first chunk at or after the offset in the range, or the range end if there is none.
+  // Varint prefixed chunks are walked from the range begin, so it is a scan for them.
+  Utils::Fs::Size FindChunkBegin(FILE* file, const Utils::Fs::FileRange& range, Utils::Fs::Size offset, const ChunksFormat& format);
+
+  // Reads the chunk which begins at the offset and returns the offset of the next one.
+  Utils::Fs::Size ReadChunk(FILE* file, Utils::Fs::Size offset, Utils::Fs::Size end, const ChunksFormat& format, std::string& chunk);
+
+  // Size of a chunk in a file.
+  std::size_t GetEncodedSize(const CharsChunk& chunk, const ChunksFormat& format);
+
+  // Parses the chunk encoded at the begin of the [begin, end) data and returns the position after it,
+  // or nullptr if the data ends in the middle of the chunk.
+  CharsChunk::ObjType* ParseChunk(CharsChunk::ObjType* begin, CharsChunk::ObjType* end, const ChunksFormat& format, CharsChunk& chunk);
+}
+
+#endif
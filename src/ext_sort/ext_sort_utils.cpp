@@ -1,45 +1,59 @@
 ﻿#include <ext_sort/ext_sort_utils.h>
 
 #include <utils/fs/fs.h>
+#include <utils/hash.h>
+
+#include <cstdio>
 
 namespace ExtSort
 {
-  void SaveToNewFile(const std::string& filePath,
-                     const CharsChunk* chunksArr,
-                     const std::size_t chunksArrSize,
-                     bool writeEndChar,
-                     void* writeBuffer,
-                     const std::size_t writeBufferSize)
+  std::uint64_t GetFileChecksum(const std::string& filePath, const BytesChunk& readBuffer)
   {
-    ERR_THROW_IF(chunksArr == nullptr, "Invalid argument. (chunksArr is null.");
-    ERR_THROW_IF(Utils::Fs::IsExists(filePath), "Fs entry is already exists (path = '" + filePath + "'.)");
+    CheckChunk(readBuffer);
+    ERR_THROW_IF(readBuffer.BytesCount() == 0, "Invalid argument (read buffer is empty).");
 
-    Utils::Fs::FileUniquePtr file = Utils::Fs::OpenFile(filePath, "wb");
-    FILE* rawFile = file.get();
+    const auto file = Utils::Fs::OpenFile(filePath, "rb");
+    Utils::Hash64 hash;
+    for (;;)
+    {
+      const auto read = fread(readBuffer.begin, 1, readBuffer.BytesCount(), file.get());
+      hash.Update(readBuffer.begin, read);
+      if (read != readBuffer.BytesCount())
+      {
+        ERR_THROW_IF(ferror(file.get()), "Failed to read file (path = '" + filePath + "').");
+        break;
+      }
+    }
+    return hash.GetValue();
+  }
 
-    if (writeBuffer && writeBufferSize)
+  std::vector<std::size_t> GetSplittersPositions(const std::vector<std::size_t>& sortedWeights, std::size_t shards)
+  {
+    std::vector<std::size_t> positions;
+    if (sortedWeights.empty())
     {
-      const auto disableBufferResult = setvbuf(rawFile, (char*) writeBuffer, _IOFBF, writeBufferSize);
-      ERR_THROW_IF(disableBufferResult != 0, "Failed to disable buffering (error = " + std::to_string(disableBufferResult) + ").");
+      return positions;
     }
 
-    const std::size_t tieSize = writeEndChar ? CharsChunk::SizeOfObject() : 0;
-    for (auto it = chunksArr, end = chunksArr + chunksArrSize; it != end; ++it)
+    std::size_t total = 0;
+    for (const auto weight : sortedWeights)
     {
-      const auto chunk = *it;
-      const auto writeRes = fwrite(chunk.begin, chunk.BytesCount() + tieSize, 1, rawFile);
-      if (writeRes != 1)
-      {
-        const auto err = ferror(rawFile);
-        ERR_THROW("Failed to write chunk to file (error = " + std::to_string(err) + ").");
-      }
+      total += weight;
     }
 
-    if (fflush(rawFile) != 0)
+    // The splitter of a shard is the sample whose weight covers the target part of the total one.
+    std::size_t position = 0;
+    std::size_t covered = sortedWeights[0];
+    for (std::size_t i = 1; i < shards; ++i)
     {
-      const int err = ferror(rawFile);
-      ERR_THROW("Failed to flush file (err = " + std::to_string(err) + ").");
+      const auto target = i * total / shards;
+      while (covered <= target && position + 1 < sortedWeights.size())
+      {
+        covered += sortedWeights[++position];
+      }
+      positions.push_back(position);
     }
+    return positions;
   }
 
   std::string FormatDataSize(std::size_t size)
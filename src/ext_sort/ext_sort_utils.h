@@ -1,21 +1,47 @@
 ﻿#ifndef __EXT_SORT_EXT_SORT_UTILS_H__
 #define __EXT_SORT_EXT_SORT_UTILS_H__
 
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/file_chunks_writer.h>
 #include <ext_sort/types.h>
 
 #include <utils/align.h>
 #include <utils/err.h>
 
 #include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 namespace ExtSort
 {
+  template <typename Record>
   void SaveToNewFile(const std::string& filePath,
-                     const CharsChunk* chunksArr,
-                     std::size_t chunksArrSize,
-                     bool writeEndChar,
-                     void* writeBuffer,
-                     std::size_t writeBufferSize);
+                     const Record* recordsArr,
+                     const std::size_t recordsArrSize,
+                     const ChunksFormat& format,
+                     const BytesChunk& writeBuffer)
+  {
+    ERR_THROW_IF(recordsArr == nullptr, "Invalid argument. (recordsArr is null.");
+
+    const auto writer = CreateFileChunksWriter(filePath, writeBuffer, format);
+    for (auto it = recordsArr, end = recordsArr + recordsArrSize; it != end; ++it)
+    {
+      writer->Write(GetChunk(*it));
+    }
+    writer->Flush();
+  }
+
+  // Returns the position of the delimiter ending the chunk at the cursor. The delimiter is
+  // a sentinel: the caller guarantees there is one before the buffer end.
+  template <typename T>
+  T* FindChunkEnd(T* cursor, T delim)
+  {
+    for (; *cursor != delim; ++cursor)
+    {
+    }
+    return cursor;
+  }
 
   template <typename T>
   void CheckAligned(const Chunk<T>& chunk)
@@ -56,6 +82,57 @@ namespace ExtSort
     CheckChunk(chunk, endLimit);
   }
 
+  // Keeps a copy of record data which outlives the buffer the source record points to.
+  template <typename Record>
+  class RecordCopy
+  {
+    std::string m_data;
+    Record m_record;
+
+  public:
+    bool IsEmpty() const
+    {
+      return GetChunk(m_record).begin == nullptr;
+    }
+
+    const Record& Get() const
+    {
+      return m_record;
+    }
+
+    void Assign(const Record& record)
+    {
+      const auto& chunk = GetChunk(record);
+      m_data.assign(chunk.begin, chunk.end);
+      m_record = record;
+      auto& chunkCopy = GetChunk(m_record);
+      chunkCopy.begin = &m_data[0];
+      chunkCopy.end = chunkCopy.begin + m_data.size();
+    }
+  };
+
+  // Every run gives up to the count of samples per shard.
+  const std::size_t SAMPLES_PER_SHARD = 64;
+
+  // Calls the callback with the index of every sample of the sorted run and the count of records it stands for,
+  // so a short run gets as many samples as a full one, but a smaller weight.
+  template <typename Callback>
+  void ForEachSample(std::size_t runSize, std::size_t shards, Callback callback)
+  {
+    const auto count = (std::min)(runSize, SAMPLES_PER_SHARD * shards);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      callback((2 * i + 1) * runSize / (2 * count), (i + 1) * runSize / count - i * runSize / count);
+    }
+  }
+
+  // Positions of the splitters among the samples sorted by the key, every shard gets an equal weight of samples.
+  // It is empty if there are no samples.
+  std::vector<std::size_t> GetSplittersPositions(const std::vector<std::size_t>& sortedWeights, std::size_t shards);
+
+  // Utils::Hash64 of the file data read through the buffer.
+  std::uint64_t GetFileChecksum(const std::string& filePath, const BytesChunk& readBuffer);
+
   std::string FormatDataSize(std::size_t size);
   std::string FormatDataCount(std::size_t size);
   std::string FormatDuration(std::chrono::system_clock::duration duration);
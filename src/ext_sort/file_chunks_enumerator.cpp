@@ -4,6 +4,8 @@
 #include <utils/empty_enumerator.h>
 #include <utils/err.h>
 #include <utils/fs/fs.h>
+#include <utils/metrics.h>
+#include <utils/trace.h>
 
 #include <cstring>
 
@@ -22,24 +24,27 @@ namespace ExtSort
       Char* m_cursor;
       Char* m_end;
       std::size_t m_lastChunkOffset;
+      Utils::Fs::Size m_bytesLeft;
       EventsObserver m_observer;
       Utils::Fs::FileUniquePtr m_file;
 
     public:
       ChunksEnumerator(const std::string& sourceFilePath,
                        const CharsChunk& buffer,
-                       CharsChunk::ObjType chunksDelim)
+                       CharsChunk::ObjType chunksDelim,
+                       const Utils::Fs::FileRange& range)
         : m_chunksDelim(chunksDelim)
         , m_bufferCapacity(buffer.ObjectsCount())
         , m_bufferDataPtr(buffer.begin)
         , m_cursor(nullptr)
         , m_end(nullptr)
         , m_lastChunkOffset(0)
+        , m_bytesLeft(range.GetSize())
       {
         CheckChunk(buffer);
 
-        const auto fileSize = Utils::Fs::GetSize(sourceFilePath);
-        ERR_THROW_IF(fileSize == 0, "File is empty (path = '" + sourceFilePath + "').");
+        const auto fileSize = m_bytesLeft;
+        ERR_THROW_IF(fileSize <= 0, "File is empty (path = '" + sourceFilePath + "').");
         ERR_THROW_IF(fileSize % CharsChunk::SizeOfObject() != 0, "fileSize % CharsChunk::SizeOfObject() != 0 (fileSize = " + std::to_string(fileSize) + ", CharsChunk::SizeOfObject() = " + std::to_string(CharsChunk::SizeOfObject()) + ", path = '" + sourceFilePath + "').");
         ERR_THROW_IF(m_bufferCapacity < CharsChunk::SizeOfObject(), "Invalid argument (buffer capacity is too small).");
         ERR_THROW_IF(m_bufferDataPtr == nullptr, "Invalid argument (buffer data is null).");
@@ -47,6 +52,10 @@ namespace ExtSort
         m_file = Utils::Fs::OpenFile(sourceFilePath, "rb");
         const auto disableBufferResult = setvbuf(m_file.get(), nullptr, _IONBF, 0);
         ERR_THROW_IF(disableBufferResult != 0, "Failed to disable buffering (error = " + std::to_string(disableBufferResult) + ").");
+        if (range.begin != 0)
+        {
+          Utils::Fs::SeekFile(m_file.get(), range.begin);
+        }
       }
 
       virtual void SetObserver(EventsObserver observer) override
@@ -65,11 +74,7 @@ namespace ExtSort
       {
         if (m_cursor != m_end)
         {
-          auto* cursor = m_cursor;
-          auto linesDelim = m_chunksDelim;
-          for (; *cursor != linesDelim; ++cursor)
-          {
-          }
+          auto* cursor = FindChunkEnd(m_cursor, m_chunksDelim);
           chunk.begin = m_cursor;
           chunk.end = cursor;
           m_cursor = cursor + 1;
@@ -78,7 +83,7 @@ namespace ExtSort
 
         FILE* file = m_file.get();
 
-        if (feof(file))
+        if (m_bytesLeft == 0)
         {
           return false;
         }
@@ -97,25 +102,30 @@ namespace ExtSort
           bufferSize -= m_lastChunkOffset;
         }
 
-        const auto read = fread(bufferData, sizeof(*bufferData), bufferSize, file);
+        if (static_cast<Utils::Fs::Size>(bufferSize) > m_bytesLeft)
+        {
+          bufferSize = static_cast<std::size_t>(m_bytesLeft);
+        }
 
+        std::size_t read = 0;
+        {
+          Utils::Metrics::ScopedDuration readDuration("read_us");
+          Utils::Trace::ScopedSpan readSpan("read");
+          read = fread(bufferData, sizeof(*bufferData), bufferSize, file);
+        }
+        Utils::Metrics::Add("bytes_read", read * sizeof(*bufferData));
         if (read != bufferSize)
         {
           if (const auto ferr = ferror(file))
           {
             ERR_THROW("Failed to read file data (error = " + std::to_string(ferr) + ").");
           }
+          ERR_THROW("Unexpected end of file (bytes left = " + std::to_string(m_bytesLeft) + ").");
+        }
+        m_bytesLeft -= read;
 
-          if (!feof(file))
-          {
-            ERR_THROW("Unexpected file state. EOF is expected.");
-          }
-
-          if (read == 0)
-          {
-            return false;
-          }
-
+        if (m_bytesLeft == 0)
+        {
           if (bufferData[read - 1] != m_chunksDelim)
           {
             ERR_THROW("Unexpected end of file. Char with the '" + std::to_string(int(m_chunksDelim)) + "' code is expected.");
@@ -155,11 +165,20 @@ namespace ExtSort
     const CharsChunk& buffer,
     CharsChunk::ObjType chunksDelim)
   {
-    if (Utils::Fs::GetSize(sourceFilePath) == 0)
+    return CreateFileChunksEnumerator(sourceFilePath, buffer, chunksDelim, Utils::Fs::FileRange{ 0, Utils::Fs::GetSize(sourceFilePath) });
+  }
+
+  std::unique_ptr<CharsChunksEnumerator> CreateFileChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    CharsChunk::ObjType chunksDelim,
+    const Utils::Fs::FileRange& range)
+  {
+    if (range.GetSize() == 0)
     {
       return std::make_unique<Utils::EmptyEnumerator<CharsChunk>>();
     }
 
-    return std::make_unique<ChunksEnumerator>(sourceFilePath, buffer, chunksDelim);
+    return std::make_unique<ChunksEnumerator>(sourceFilePath, buffer, chunksDelim, range);
   }
 }
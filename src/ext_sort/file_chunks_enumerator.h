@@ -3,6 +3,8 @@
 
 #include <ext_sort/types.h>
 
+#include <utils/fs/fs.h>
+
 #include <memory>
 #include <string>
 
@@ -17,6 +19,13 @@ namespace ExtSort
     const std::string& sourceFilePath,
     const CharsChunk& buffer,
     CharsChunk::ObjType chunksDelim);
+
+  // The range should start at a chunk begin and end after a delimiter.
+  std::unique_ptr<CharsChunksEnumerator> CreateFileChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    CharsChunk::ObjType chunksDelim,
+    const Utils::Fs::FileRange& range);
 }
 
 #endif
@@ -0,0 +1,230 @@
+﻿#include <ext_sort/file_chunks_writer.h>
+
+#include <utils/err.h>
+#include <utils/fs/fs.h>
+#include <utils/hash.h>
+#include <utils/metrics.h>
+#include <utils/trace.h>
+#include <utils/varint.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+namespace ExtSort
+{
+  namespace
+  {
+    struct WrittenChecksums
+    {
+      std::atomic<bool> enabled{ false };
+      std::mutex mutex;
+      std::map<std::string, std::uint64_t> checksums;
+    };
+
+    WrittenChecksums& GetWrittenChecksums()
+    {
+      static WrittenChecksums writtenChecksums;
+      return writtenChecksums;
+    }
+
+    // Hashes the data in the order it is written to the file.
+    class ChecksumRecorder
+    {
+      const std::string m_filePath;
+      const bool m_enabled;
+      Utils::Hash64 m_hash;
+
+    public:
+      explicit ChecksumRecorder(const std::string& filePath)
+        : m_filePath(filePath)
+        , m_enabled(GetWrittenChecksums().enabled)
+      {
+      }
+
+      void Update(const void* data, std::size_t size)
+      {
+        if (m_enabled)
+        {
+          m_hash.Update(data, size);
+        }
+      }
+
+      void Record() const
+      {
+        if (m_enabled)
+        {
+          auto& writtenChecksums = GetWrittenChecksums();
+          std::lock_guard<std::mutex> guard(writtenChecksums.mutex);
+          writtenChecksums.checksums[m_filePath] = m_hash.GetValue();
+        }
+      }
+    };
+
+    class FileChunksWriter : public CharsChunksWriter
+    {
+      Utils::Fs::FileUniquePtr m_file;
+      ChecksumRecorder m_checksum;
+      // The bytes in the stream buffer: only the writes overflowing the buffer reach the file, so only they are timed.
+      const std::size_t m_bufferSize;
+      std::size_t m_bufferedBytes;
+      std::uint64_t m_writtenBytes;
+
+    public:
+      // Without a write buffer the stream uses its default one.
+      FileChunksWriter(const std::string& filePath, const BytesChunk& writeBuffer)
+        : m_checksum(filePath)
+        , m_bufferSize(writeBuffer.begin ? writeBuffer.BytesCount() : BUFSIZ)
+        , m_bufferedBytes(0)
+        , m_writtenBytes(0)
+      {
+        ERR_THROW_IF(Utils::Fs::IsExists(filePath), "Fs entry is already exists (path = '" + filePath + "'.)");
+
+        m_file = Utils::Fs::OpenFile(filePath, "wb");
+
+        if (writeBuffer.begin && writeBuffer.BytesCount())
+        {
+          const auto disableBufferResult = setvbuf(m_file.get(), (char*) writeBuffer.begin, _IOFBF, writeBuffer.BytesCount());
+          ERR_THROW_IF(disableBufferResult != 0, "Failed to disable buffering (error = " + std::to_string(disableBufferResult) + ").");
+        }
+      }
+
+      virtual void Flush() override
+      {
+        FILE* file = m_file.get();
+        int flushRes = 0;
+        {
+          Utils::Metrics::ScopedDuration writeDuration("write_us");
+          Utils::Trace::ScopedSpan writeSpan("write");
+          flushRes = fflush(file);
+        }
+        if (flushRes != 0)
+        {
+          const int err = ferror(file);
+          ERR_THROW("Failed to flush file (err = " + std::to_string(err) + ").");
+        }
+        m_bufferedBytes = 0;
+        Utils::Metrics::Add("bytes_written", m_writtenBytes);
+        m_writtenBytes = 0;
+        m_checksum.Record();
+      }
+
+    protected:
+      void WriteBytes(const void* data, std::size_t size)
+      {
+        FILE* file = m_file.get();
+        m_checksum.Update(data, size);
+        m_writtenBytes += size;
+        m_bufferedBytes += size;
+        std::size_t writeRes = 0;
+        if (m_bufferedBytes < m_bufferSize)
+        {
+          writeRes = fwrite(data, size, 1, file);
+        }
+        else
+        {
+          Utils::Metrics::ScopedDuration writeDuration("write_us");
+          Utils::Trace::ScopedSpan writeSpan("write");
+          writeRes = fwrite(data, size, 1, file);
+          m_bufferedBytes = 0;
+        }
+        if (writeRes != 1)
+        {
+          const auto err = ferror(file);
+          ERR_THROW("Failed to write chunk to file (error = " + std::to_string(err) + ").");
+        }
+      }
+
+      FileChunksWriter(const FileChunksWriter&) = delete;
+      FileChunksWriter& operator = (const FileChunksWriter&) = delete;
+    };
+
+    class DelimitedChunksWriter : public FileChunksWriter
+    {
+    public:
+      using FileChunksWriter::FileChunksWriter;
+
+      virtual void Write(const CharsChunk& chunk) override
+      {
+        WriteBytes(chunk.begin, chunk.BytesCount() + CharsChunk::SizeOfObject());
+      }
+    };
+
+    class FixedSizeChunksWriter : public FileChunksWriter
+    {
+      const std::size_t m_chunkSize;
+
+    public:
+      FixedSizeChunksWriter(const std::string& filePath, const BytesChunk& writeBuffer, std::size_t chunkSize)
+        : FileChunksWriter(filePath, writeBuffer)
+        , m_chunkSize(chunkSize)
+      {
+        ERR_THROW_IF(m_chunkSize == 0, "Invalid argument (chunk size is 0).");
+      }
+
+      virtual void Write(const CharsChunk& chunk) override
+      {
+        ERR_THROW_IF(chunk.ObjectsCount() != m_chunkSize, "Unexpected chunk size (size = " + std::to_string(chunk.ObjectsCount()) + ", expected = " + std::to_string(m_chunkSize) + ").");
+        WriteBytes(chunk.begin, chunk.BytesCount());
+      }
+    };
+
+    class VarintChunksWriter : public FileChunksWriter
+    {
+    public:
+      using FileChunksWriter::FileChunksWriter;
+
+      virtual void Write(const CharsChunk& chunk) override
+      {
+        unsigned char prefix[Utils::MAX_VARINT_SIZE];
+        const auto size = chunk.BytesCount();
+        WriteBytes(prefix, Utils::EncodeVarint(size, prefix));
+        if (size != 0)
+        {
+          WriteBytes(chunk.begin, size);
+        }
+      }
+    };
+  }
+
+  std::unique_ptr<CharsChunksWriter> CreateFileChunksWriter(
+    const std::string& filePath,
+    const BytesChunk& writeBuffer,
+    const ChunksFormat& format)
+  {
+    switch (format.type)
+    {
+      case ChunksFormat::Type::DELIMITED:
+        return std::make_unique<DelimitedChunksWriter>(filePath, writeBuffer);
+
+      case ChunksFormat::Type::FIXED_SIZE:
+        return std::make_unique<FixedSizeChunksWriter>(filePath, writeBuffer, format.chunkSize);
+
+      case ChunksFormat::Type::VARINT_PREFIXED:
+        return std::make_unique<VarintChunksWriter>(filePath, writeBuffer);
+    }
+
+    ERR_THROW("Unexpected chunks format.");
+    return nullptr;
+  }
+
+  void EnableWrittenChecksums()
+  {
+    GetWrittenChecksums().enabled = true;
+  }
+
+  bool GetWrittenChecksum(const std::string& filePath, std::uint64_t& checksum)
+  {
+    auto& writtenChecksums = GetWrittenChecksums();
+    std::lock_guard<std::mutex> guard(writtenChecksums.mutex);
+    const auto iter = writtenChecksums.checksums.find(filePath);
+    if (iter == writtenChecksums.checksums.end())
+    {
+      return false;
+    }
+    checksum = iter->second;
+    return true;
+  }
+}
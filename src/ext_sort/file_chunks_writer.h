@@ -0,0 +1,28 @@
+﻿#ifndef __EXT_SORT_FILE_CHUNKS_WRITER_H__
+#define __EXT_SORT_FILE_CHUNKS_WRITER_H__
+
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/types.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace ExtSort
+{
+  // Creates a new file. The delimited format writer expects a chunk to be followed
+  // by the delimiter in memory (as in a read buffer) and writes it with the chunk.
+  std::unique_ptr<CharsChunksWriter> CreateFileChunksWriter(
+    const std::string& filePath,
+    const BytesChunk& writeBuffer,
+    const ChunksFormat& format);
+
+  // The writers created after it hash the written data, so the checksums of the files (see GetFileChecksum)
+  // are known without reading them back. A checksum is recorded when its writer is flushed.
+  void EnableWrittenChecksums();
+
+  // Returns false if the file is not written by a writer which hashes the data.
+  bool GetWrittenChecksum(const std::string& filePath, std::uint64_t& checksum);
+}
+
+#endif
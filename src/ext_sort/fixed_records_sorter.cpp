@@ -0,0 +1,340 @@
+﻿#include <ext_sort/fixed_records_sorter.h>
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/ext_sort_utils.h>
+#include <ext_sort/file_chunks_enumerator.h>
+#include <ext_sort/file_chunks_writer.h>
+
+#include <utils/align.h>
+#include <utils/log/log.h>
+#include <utils/err.h>
+#include <utils/metrics.h>
+#include <utils/trace.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ExtSort
+{
+  namespace
+  {
+    class FixedRecordsSorter : public Sorter
+    {
+      using Index = std::uint32_t;
+      using IndicesChunk = Chunk<Index>;
+      using UChar = unsigned char;
+
+      std::unique_ptr<Utils::Fs::FilePathsEnumerator> m_filePaths;
+      const SortOptions m_options;
+      const std::size_t m_recordSize;
+      const std::size_t m_keyOffset;
+      const std::size_t m_keySize;
+      BytesChunk m_writeBuffer;
+      CharsChunk m_recordsBuffer;
+      IndicesChunk m_indices;
+      IndicesChunk m_indicesBuffer;
+      std::vector<std::string> m_samples;
+      std::vector<std::size_t> m_samplesWeights;
+
+    public:
+      FixedRecordsSorter(std::unique_ptr<Utils::Fs::FilePathsEnumerator> filePaths,
+                         const BytesChunk& buffer,
+                         std::size_t maxWriteBufferSize,
+                         const SortOptions& options)
+        : m_filePaths(std::move(filePaths))
+        , m_options(options)
+        , m_recordSize(options.format.chunkSize)
+        , m_keyOffset(options.key.rangeOffset)
+        , m_keySize(options.key.rangeSize)
+      {
+        ERR_THROW_IF_NOT(m_filePaths, "Invalid argument (file paths is null).");
+        ERR_THROW_IF(m_options.format.type != ChunksFormat::Type::FIXED_SIZE, "Invalid argument (fixed size chunks format is expected).");
+        ERR_THROW_IF(m_recordSize == 0, "Invalid argument (record size is 0).");
+        ERR_THROW_IF(m_keySize == 0 || m_keyOffset + m_keySize > m_recordSize, "Invalid argument (key range is out of the record).");
+
+        CheckChunk(buffer);
+
+        LOG_I("FixedRecordsSorter::FixedRecordsSorter: buffer size = %s", FormatDataSize(buffer.ObjectsCount()).c_str());
+
+        const auto bufferSize = buffer.BytesCount();
+        const auto maxAcceptableWriteBufferSize = bufferSize / 10;
+        const auto writeBufferSize = (std::min)(maxAcceptableWriteBufferSize, maxWriteBufferSize);
+
+        m_writeBuffer.begin = (BytesChunk::ObjType*)(buffer.begin);
+        m_writeBuffer.end = (BytesChunk::ObjType*)(buffer.begin + writeBufferSize);
+        CheckChunk(m_writeBuffer, buffer.end);
+
+        // Every record takes its bytes plus two indices: the sorted ones and the radix sort buffer.
+        m_indices.begin = Utils::GetAligned((Index*)m_writeBuffer.end);
+        const auto availableBytes = (std::max)((const Byte*)buffer.end, (const Byte*)m_indices.begin) - (const Byte*)m_indices.begin;
+        const auto maxIndex = static_cast<std::size_t>((std::numeric_limits<Index>::max)());
+        const auto recordsCount = (std::min)(static_cast<std::size_t>(availableBytes) / (m_recordSize + 2 * sizeof(Index)), maxIndex);
+        ERR_THROW_IF(recordsCount == 0, "Buffer is too small for the record size (record size = " + std::to_string(m_recordSize) + ").");
+
+        m_indices.end = m_indices.begin + recordsCount;
+        m_indicesBuffer.begin = m_indices.end;
+        m_indicesBuffer.end = m_indicesBuffer.begin + recordsCount;
+        m_recordsBuffer.begin = (CharsChunk::ObjType*)m_indicesBuffer.end;
+        m_recordsBuffer.end = m_recordsBuffer.begin + recordsCount * m_recordSize;
+        CheckChunk(m_recordsBuffer, buffer.end);
+      }
+
+      virtual std::vector<std::string> Sort(const std::string& sourceFilePath) override
+      {
+        return Sort(sourceFilePath, Utils::Fs::FileRange{ 0, Utils::Fs::GetSize(sourceFilePath) });
+      }
+
+      virtual std::vector<std::string> Sort(const std::string& sourceFilePath, const Utils::Fs::FileRange& range) override
+      {
+        Utils::Log::ScopedInfoLog sortScope("FixedRecordsSorter::Sort");
+
+        const auto startTime = std::chrono::system_clock::now();
+
+        LOG_I("source file path     = '%s'", sourceFilePath.c_str());
+
+        const auto sourceFileSize = range.GetSize();
+        if (sourceFileSize == 0)
+        {
+          LOG_W("%s", ("The '" + sourceFilePath + "' file range is empty.").c_str());
+          std::string resultFilePath;
+          ERR_THROW_IF_NOT(m_filePaths->Next(resultFilePath), "Cannot get next file path.");
+          Utils::Fs::OpenFile(resultFilePath, "wb");
+          std::vector<std::string> files;
+          files.push_back(resultFilePath);
+          return files;
+        }
+
+        LOG_I("source file size     = %s", FormatDataSize(static_cast<std::size_t>(sourceFileSize)).c_str());
+        LOG_I("record size          = %s", FormatDataSize(m_recordSize).c_str());
+        LOG_I("max records per file = %s", FormatDataCount(m_indices.ObjectsCount()).c_str());
+
+        Utils::Fs::Size sortedDataSize = 0;
+        std::string sortedDataProgress;
+        std::vector<std::string> resultFilePaths;
+        std::size_t recordsCount = 0;
+
+        const auto flushData = [&, this] ()
+        {
+          if (recordsCount != 0)
+          {
+            std::string targetFilePath;
+            ERR_THROW_IF_NOT(m_filePaths->Next(targetFilePath), "Cannot get next file path.");
+
+            SortAndSave(recordsCount, targetFilePath);
+            resultFilePaths.push_back(targetFilePath);
+
+            sortedDataSize += recordsCount * m_recordSize;
+            Utils::Metrics::Add("lines", recordsCount);
+            recordsCount = 0;
+
+            if (Utils::Log::IsEnabled(Utils::Log::LOG_LEVEL_INFO))
+            {
+              std::string progress = FormatPart(sourceFileSize, sortedDataSize);
+              if (progress != sortedDataProgress)
+              {
+                sortedDataProgress.swap(progress);
+                LOG_I("Sort progress: %s", sortedDataProgress.c_str());
+              }
+            }
+          }
+        };
+
+        // The enumerator fills the whole records buffer, so a run is a buffer of records.
+        auto enumerator = CreateFileChunksEnumerator(sourceFilePath, m_recordsBuffer, m_options.format, range);
+        enumerator->SetObserver([&flushData] (const std::string& eventId)
+        {
+          if (eventId == FileChunksEnumeratorEvents::BEFORE_READ_BUFFER)
+          {
+            flushData();
+          }
+        });
+
+        CharsChunk chunk;
+        while (enumerator->Next(chunk))
+        {
+          ++recordsCount;
+        }
+
+        flushData();
+
+        LOG_I("DONE: 100%%");
+        LOG_I("Sort file time = %s", FormatDuration(std::chrono::system_clock::now() - startTime).c_str());
+
+        Utils::Metrics::AddDuration("total_us", std::chrono::system_clock::now() - startTime);
+
+        return resultFilePaths;
+      }
+
+      virtual std::vector<std::string> GetSplitters() const override
+      {
+        std::vector<std::size_t> order(m_samples.size());
+        for (std::size_t i = 0; i != order.size(); ++i)
+        {
+          order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [this](std::size_t lhs, std::size_t rhs)
+        {
+          const auto cmpRes = std::memcmp(m_samples[lhs].data() + m_keyOffset, m_samples[rhs].data() + m_keyOffset, m_keySize);
+          return m_options.key.reverse ? cmpRes > 0 : cmpRes < 0;
+        });
+
+        std::vector<std::size_t> sortedWeights;
+        for (const auto i : order)
+        {
+          sortedWeights.push_back(m_samplesWeights[i]);
+        }
+
+        const auto positions = GetSplittersPositions(sortedWeights, m_options.shards);
+        if (positions.empty())
+        {
+          return std::vector<std::string>(m_options.shards - 1, std::string(m_recordSize, 0));
+        }
+
+        std::vector<std::string> splitters;
+        for (const auto position : positions)
+        {
+          splitters.push_back(m_samples[order[position]]);
+        }
+        return splitters;
+      }
+
+    private:
+      const UChar* GetKey(Index index) const
+      {
+        return (const UChar*)m_recordsBuffer.begin + index * m_recordSize + m_keyOffset;
+      }
+
+      // Stable LSD radix sort of the records indices, one pass per key byte from the last one.
+      // A pass is skipped if all the records have the same byte at its position.
+      // Returns the sorted indices, which are either m_indices or m_indicesBuffer.
+      Index* RadixSort(std::size_t size)
+      {
+        Utils::Trace::ScopedSpan sortSpan("sort");
+        Index* indices = m_indices.begin;
+        Index* buffer = m_indicesBuffer.begin;
+        for (std::size_t i = 0; i != size; ++i)
+        {
+          indices[i] = static_cast<Index>(i);
+        }
+
+        std::array<std::size_t, 256> positions;
+        for (std::size_t bytePos = m_keySize; bytePos-- != 0; )
+        {
+          positions.fill(0);
+          for (std::size_t i = 0; i != size; ++i)
+          {
+            ++positions[GetKey(indices[i])[bytePos]];
+          }
+
+          if (std::find(positions.begin(), positions.end(), size) != positions.end())
+          {
+            continue;
+          }
+
+          std::size_t position = 0;
+          const auto setPosition = [&position] (std::size_t& count)
+          {
+            const auto bucketSize = count;
+            count = position;
+            position += bucketSize;
+          };
+          if (m_options.key.reverse)
+          {
+            std::for_each(positions.rbegin(), positions.rend(), setPosition);
+          }
+          else
+          {
+            std::for_each(positions.begin(), positions.end(), setPosition);
+          }
+
+          for (std::size_t i = 0; i != size; ++i)
+          {
+            const auto index = indices[i];
+            buffer[positions[GetKey(index)[bytePos]]++] = index;
+          }
+          std::swap(indices, buffer);
+        }
+
+        return indices;
+      }
+
+      void SortAndSave(std::size_t size, const std::string& outputFilePath)
+      {
+        Utils::Log::ScopedInfoLog sortScope("FixedRecordsSorter::SortAndSave");
+
+        LOG_I("output file path   = '%s'" , outputFilePath.c_str());
+        LOG_I("records count      = %s"   , FormatDataCount(size).c_str());
+
+        const auto startTime = std::chrono::system_clock::now();
+
+        const auto indices = RadixSort(size);
+        if (m_options.shards > 1)
+        {
+          ForEachSample(size, m_options.shards, [&](std::size_t index, std::size_t weight)
+          {
+            m_samples.emplace_back(m_recordsBuffer.begin + indices[index] * m_recordSize, m_recordSize);
+            m_samplesWeights.push_back(weight);
+          });
+        }
+        const auto sortDuration = (std::chrono::system_clock::now() - startTime).count();
+        Utils::Metrics::Add("runs", 1);
+        Utils::Metrics::AddDuration("sort_us", std::chrono::system_clock::duration(sortDuration));
+
+        const auto limit = m_options.limit != 0 ? m_options.limit : size;
+        const auto writer = CreateFileChunksWriter(outputFilePath, m_writeBuffer, m_options.format);
+        std::size_t saved = 0;
+        const UChar* lastKey = nullptr;
+        for (std::size_t i = 0; i != size && saved != limit; ++i)
+        {
+          const auto key = GetKey(indices[i]);
+          if (m_options.unique && lastKey != nullptr && std::memcmp(lastKey, key, m_keySize) == 0)
+          {
+            continue;
+          }
+          lastKey = key;
+
+          const auto recordBegin = m_recordsBuffer.begin + indices[i] * m_recordSize;
+          writer->Write(CharsChunk(recordBegin, recordBegin + m_recordSize));
+          ++saved;
+        }
+        writer->Flush();
+
+        if (saved != size)
+        {
+          LOG_I("saved records      = %s", FormatDataCount(saved).c_str());
+        }
+
+        const auto saveDuration = (std::chrono::system_clock::now() - startTime).count() - sortDuration;
+
+        const auto totalDuration = std::chrono::system_clock::now() - startTime;
+
+        if (totalDuration.count() > 0 && Utils::Log::IsEnabled(Utils::Log::LOG_LEVEL_INFO))
+        {
+          std::ostringstream oss;
+          oss << "total time         = " << FormatDuration(totalDuration);
+          oss << " : sort " << FormatPart(totalDuration.count(), sortDuration);
+          oss << " : save " << FormatPart(totalDuration.count(), saveDuration);
+          LOG_I("%s", oss.str().c_str());
+        }
+      }
+
+      FixedRecordsSorter(const FixedRecordsSorter&) = delete;
+      FixedRecordsSorter& operator = (const FixedRecordsSorter&) = delete;
+    };
+  }
+
+  std::unique_ptr<Sorter> CreateFixedRecordsSorter(
+    std::unique_ptr<Utils::Fs::FilePathsEnumerator> filePaths,
+    const BytesChunk& buffer,
+    const std::size_t maxWriteBufferSize,
+    const SortOptions& options)
+  {
+    return std::make_unique<FixedRecordsSorter>(std::move(filePaths), buffer, maxWriteBufferSize, options);
+  }
+}
@@ -0,0 +1,23 @@
+﻿#ifndef __EXT_SORT_FIXED_RECORDS_SORTER_H__
+#define __EXT_SORT_FIXED_RECORDS_SORTER_H__
+
+#include <ext_sort/sort_options.h>
+#include <ext_sort/sorter.h>
+#include <ext_sort/types.h>
+
+#include <utils/fs/fs.h>
+
+#include <memory>
+
+namespace ExtSort
+{
+  // Sorts runs of fixed size records by a bytes range key with the LSD radix sort.
+  // Expects the FIXED_SIZE chunks format and the key range within the record.
+  std::unique_ptr<Sorter> CreateFixedRecordsSorter(
+    std::unique_ptr<Utils::Fs::FilePathsEnumerator> filePaths,
+    const BytesChunk& buffer,
+    std::size_t maxWriteBufferSize,
+    const SortOptions& options);
+}
+
+#endif
@@ -0,0 +1,136 @@
+﻿#include <ext_sort/fixed_size_chunks_enumerator.h>
+#include <ext_sort/ext_sort_utils.h>
+#include <ext_sort/file_chunks_enumerator.h>
+
+#include <utils/empty_enumerator.h>
+#include <utils/err.h>
+#include <utils/fs/fs.h>
+#include <utils/metrics.h>
+#include <utils/trace.h>
+
+namespace ExtSort
+{
+  namespace
+  {
+    class FixedSizeChunksEnumerator : public CharsChunksEnumerator
+    {
+      using Char = CharsChunk::ObjType;
+      using EventsObserver = CharsChunksEnumerator::EventsObserver;
+
+      const std::size_t m_chunkSize;
+      const std::size_t m_bufferCapacity;
+      Char* const m_bufferDataPtr;
+      Char* m_cursor;
+      Char* m_end;
+      Utils::Fs::Size m_bytesLeft;
+      EventsObserver m_observer;
+      Utils::Fs::FileUniquePtr m_file;
+
+    public:
+      FixedSizeChunksEnumerator(const std::string& sourceFilePath,
+                                const CharsChunk& buffer,
+                                std::size_t chunkSize,
+                                const Utils::Fs::FileRange& range)
+        : m_chunkSize(chunkSize)
+        , m_bufferCapacity(chunkSize ? buffer.ObjectsCount() / chunkSize * chunkSize : 0)
+        , m_bufferDataPtr(buffer.begin)
+        , m_cursor(nullptr)
+        , m_end(nullptr)
+        , m_bytesLeft(range.GetSize())
+      {
+        CheckChunk(buffer);
+
+        ERR_THROW_IF(m_chunkSize == 0, "Invalid argument (chunk size is 0).");
+        ERR_THROW_IF(m_bufferCapacity == 0, "Invalid argument (buffer capacity is less than the chunk size).");
+
+        const auto fileSize = static_cast<std::size_t>(m_bytesLeft);
+        ERR_THROW_IF(fileSize % (m_chunkSize * CharsChunk::SizeOfObject()) != 0, "File size is not a multiple of the chunk size (fileSize = " + std::to_string(fileSize) + ", chunkSize = " + std::to_string(m_chunkSize) + ", path = '" + sourceFilePath + "').");
+        ERR_THROW_IF(range.begin % m_chunkSize != 0, "Range begin is not a multiple of the chunk size (path = '" + sourceFilePath + "').");
+
+        m_file = Utils::Fs::OpenFile(sourceFilePath, "rb");
+        const auto disableBufferResult = setvbuf(m_file.get(), nullptr, _IONBF, 0);
+        ERR_THROW_IF(disableBufferResult != 0, "Failed to disable buffering (error = " + std::to_string(disableBufferResult) + ").");
+        if (range.begin != 0)
+        {
+          Utils::Fs::SeekFile(m_file.get(), range.begin);
+        }
+      }
+
+      virtual void SetObserver(EventsObserver observer) override
+      {
+        m_observer = observer;
+      }
+
+      virtual bool Next(CharsChunk& chunk) override
+      {
+        if (m_cursor != m_end)
+        {
+          chunk.begin = m_cursor;
+          chunk.end = m_cursor + m_chunkSize;
+          m_cursor = chunk.end;
+          return true;
+        }
+
+        FILE* file = m_file.get();
+
+        if (m_bytesLeft == 0)
+        {
+          return false;
+        }
+
+        if (m_observer)
+        {
+          m_observer(FileChunksEnumeratorEvents::BEFORE_READ_BUFFER);
+        }
+
+        const auto bufferSize = static_cast<Utils::Fs::Size>(m_bufferCapacity) < m_bytesLeft ? m_bufferCapacity : static_cast<std::size_t>(m_bytesLeft);
+        std::size_t read = 0;
+        {
+          Utils::Metrics::ScopedDuration readDuration("read_us");
+          Utils::Trace::ScopedSpan readSpan("read");
+          read = fread(m_bufferDataPtr, sizeof(*m_bufferDataPtr), bufferSize, file);
+        }
+        Utils::Metrics::Add("bytes_read", read * sizeof(*m_bufferDataPtr));
+        if (read != bufferSize)
+        {
+          if (const auto ferr = ferror(file))
+          {
+            ERR_THROW("Failed to read file data (error = " + std::to_string(ferr) + ").");
+          }
+          ERR_THROW("Unexpected end of file (bytes left = " + std::to_string(m_bytesLeft) + ").");
+        }
+        m_bytesLeft -= read;
+
+        m_cursor = m_bufferDataPtr;
+        m_end = m_bufferDataPtr + read;
+
+        return FixedSizeChunksEnumerator::Next(chunk);
+      }
+
+      FixedSizeChunksEnumerator(const FixedSizeChunksEnumerator&) = delete;
+      FixedSizeChunksEnumerator& operator = (const FixedSizeChunksEnumerator&) = delete;
+    };
+  }
+
+  std::unique_ptr<CharsChunksEnumerator> CreateFixedSizeChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    std::size_t chunkSize)
+  {
+    return CreateFixedSizeChunksEnumerator(sourceFilePath, buffer, chunkSize, Utils::Fs::FileRange{ 0, Utils::Fs::GetSize(sourceFilePath) });
+  }
+
+  std::unique_ptr<CharsChunksEnumerator> CreateFixedSizeChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    std::size_t chunkSize,
+    const Utils::Fs::FileRange& range)
+  {
+    if (range.GetSize() == 0)
+    {
+      return std::make_unique<Utils::EmptyEnumerator<CharsChunk>>();
+    }
+
+    return std::make_unique<FixedSizeChunksEnumerator>(sourceFilePath, buffer, chunkSize, range);
+  }
+}
@@ -0,0 +1,28 @@
+﻿#ifndef __EXT_SORT_FIXED_SIZE_CHUNKS_ENUMERATOR_H__
+#define __EXT_SORT_FIXED_SIZE_CHUNKS_ENUMERATOR_H__
+
+#include <ext_sort/types.h>
+
+#include <utils/fs/fs.h>
+
+#include <memory>
+#include <string>
+
+namespace ExtSort
+{
+  // Enumerates chunks of the chunkSize size without any delimiters.
+  // Raises the FileChunksEnumeratorEvents::BEFORE_READ_BUFFER event.
+  std::unique_ptr<CharsChunksEnumerator> CreateFixedSizeChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    std::size_t chunkSize);
+
+  // The range should start at a chunk begin and contain whole chunks.
+  std::unique_ptr<CharsChunksEnumerator> CreateFixedSizeChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    std::size_t chunkSize,
+    const Utils::Fs::FileRange& range);
+}
+
+#endif
@@ -0,0 +1,28 @@
+﻿#ifndef __EXT_SORT_JOINER_H__
+#define __EXT_SORT_JOINER_H__
+
+#include <string>
+#include <vector>
+
+namespace ExtSort
+{
+  enum class JoinType
+  {
+    INNER,
+    // Left chunks without matches are written as they are.
+    LEFT,
+  };
+
+  class Joiner
+  {
+  public:
+    virtual ~Joiner() = default;
+
+    // The sorted files of each input are expected in the order of the source data.
+    virtual void Join(const std::vector<std::string>& leftSortedFilePaths,
+                      const std::vector<std::string>& rightSortedFilePaths,
+                      const std::string& resultFilePath) = 0;
+  };
+}
+
+#endif
@@ -0,0 +1,60 @@
+﻿#ifndef __EXT_SORT_KEYED_CHUNKS_ENUMERATOR_H__
+#define __EXT_SORT_KEYED_CHUNKS_ENUMERATOR_H__
+
+#include <ext_sort/types.h>
+
+#include <utils/err.h>
+
+#include <memory>
+
+namespace ExtSort
+{
+  // Parses a key of every chunk right after the chunk is tokenized by the source enumerator.
+  template <typename Parser>
+  class KeyedChunksEnumerator : public Utils::Enumerator<KeyedChunk<typename Parser::Key>>
+  {
+  public:
+    using Data = KeyedChunk<typename Parser::Key>;
+    using EventsObserver = typename Utils::Enumerator<Data>::EventsObserver;
+
+  private:
+    std::unique_ptr<CharsChunksEnumerator> m_chunks;
+    const Parser m_parser;
+
+  public:
+    KeyedChunksEnumerator(std::unique_ptr<CharsChunksEnumerator> chunks, const Parser& parser)
+      : m_chunks(std::move(chunks))
+      , m_parser(parser)
+    {
+      ERR_THROW_IF_NOT(m_chunks, "Invalid argument (chunks enumerator is null).");
+    }
+
+    virtual void SetObserver(EventsObserver observer) override
+    {
+      m_chunks->SetObserver(observer);
+    }
+
+    virtual bool Next(Data& keyedChunk) override
+    {
+      if (!m_chunks->Next(keyedChunk.chunk))
+      {
+        return false;
+      }
+      m_parser.Parse(keyedChunk.chunk, keyedChunk.key);
+      return true;
+    }
+
+    KeyedChunksEnumerator(const KeyedChunksEnumerator&) = delete;
+    KeyedChunksEnumerator& operator = (const KeyedChunksEnumerator&) = delete;
+  };
+
+  template <typename Parser>
+  std::unique_ptr<Utils::Enumerator<KeyedChunk<typename Parser::Key>>> CreateKeyedChunksEnumerator(
+    std::unique_ptr<CharsChunksEnumerator> chunks,
+    const Parser& parser)
+  {
+    return std::make_unique<KeyedChunksEnumerator<Parser>>(std::move(chunks), parser);
+  }
+}
+
+#endif
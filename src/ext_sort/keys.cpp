@@ -0,0 +1,162 @@
+﻿#include <ext_sort/keys.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace ExtSort
+{
+  namespace
+  {
+    using Char = CharsChunk::ObjType;
+
+    const std::uint64_t SIGN_BIT = std::uint64_t(1) << 63;
+
+    const Char* SkipBlanks(const Char* it, const Char* end)
+    {
+      while (it != end && (*it == ' ' || *it == '\t'))
+      {
+        ++it;
+      }
+      return it;
+    }
+
+    bool IsDigit(Char ch)
+    {
+      return ch >= '0' && ch <= '9';
+    }
+
+    int GetHexDigit(Char ch)
+    {
+      if (IsDigit(ch))
+      {
+        return ch - '0';
+      }
+      if (ch >= 'a' && ch <= 'f')
+      {
+        return ch - 'a' + 10;
+      }
+      if (ch >= 'A' && ch <= 'F')
+      {
+        return ch - 'A' + 10;
+      }
+      return -1;
+    }
+  }
+
+  std::uint64_t NormaliseInteger(const CharsChunk& field)
+  {
+    const Char* it = SkipBlanks(field.begin, field.end);
+    const Char* const end = field.end;
+
+    bool negative = false;
+    if (it != end && (*it == '-' || *it == '+'))
+    {
+      negative = *it == '-';
+      ++it;
+    }
+
+    // Out of range values are saturated.
+    const std::uint64_t maxMagnitude = negative ? SIGN_BIT : SIGN_BIT - 1;
+    std::uint64_t magnitude = 0;
+    for (; it != end && IsDigit(*it); ++it)
+    {
+      const unsigned digit = *it - '0';
+      if (magnitude > (maxMagnitude - digit) / 10)
+      {
+        magnitude = maxMagnitude;
+        break;
+      }
+      magnitude = magnitude * 10 + digit;
+    }
+
+    // The two's complement value with the flipped sign bit.
+    return negative ? SIGN_BIT - magnitude : SIGN_BIT + magnitude;
+  }
+
+  std::uint64_t NormaliseFloat(const CharsChunk& field)
+  {
+    const Char* it = SkipBlanks(field.begin, field.end);
+
+    // strtod requires a null terminated string. Longer fields are truncated.
+    char buffer[64];
+    const auto size = (std::min)(static_cast<std::size_t>(field.end - it), sizeof(buffer) - 1);
+    std::memcpy(buffer, it, size);
+    buffer[size] = 0;
+
+    char* parsedEnd = nullptr;
+    double value = std::strtod(buffer, &parsedEnd);
+    if (parsedEnd == buffer || std::isnan(value))
+    {
+      return 0;
+    }
+    if (value == 0)
+    {
+      // -0.0 == 0.0
+      value = 0;
+    }
+
+    static_assert(sizeof(value) == sizeof(std::uint64_t), "IEEE 754 double is expected.");
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    // Negative values are ordered backwards by their bits, positive ones go after them.
+    // -inf becomes 0x000FFFFFFFFFFFFF, so 0 is left for NaN.
+    return (bits & SIGN_BIT) ? ~bits : bits | SIGN_BIT;
+  }
+
+  std::uint64_t NormaliseHex(const CharsChunk& field)
+  {
+    const Char* it = SkipBlanks(field.begin, field.end);
+    const Char* const end = field.end;
+
+    if (end - it >= 2 && it[0] == '0' && (it[1] == 'x' || it[1] == 'X'))
+    {
+      it += 2;
+    }
+
+    std::uint64_t value = 0;
+    for (int digit = 0; it != end && (digit = GetHexDigit(*it)) >= 0; ++it)
+    {
+      if (value >> 60)
+      {
+        return (std::numeric_limits<std::uint64_t>::max)();
+      }
+      value = (value << 4) | static_cast<unsigned>(digit);
+    }
+    return value;
+  }
+
+  std::uint64_t NormaliseVersion(const CharsChunk& field)
+  {
+    const Char* it = SkipBlanks(field.begin, field.end);
+    const Char* const end = field.end;
+
+    if (it != end && (*it == 'v' || *it == 'V'))
+    {
+      ++it;
+    }
+
+    const unsigned componentBits = 16;
+    const unsigned componentsCount = 64 / componentBits;
+    const std::uint64_t maxComponent = (std::uint64_t(1) << componentBits) - 1;
+
+    std::uint64_t value = 0;
+    for (unsigned component = 0; component != componentsCount && it != end && IsDigit(*it); ++component)
+    {
+      std::uint64_t number = 0;
+      for (; it != end && IsDigit(*it); ++it)
+      {
+        number = (std::min)(number * 10 + (*it - '0'), maxComponent);
+      }
+      value |= number << (componentBits * (componentsCount - component - 1));
+
+      if (it == end || *it != '.')
+      {
+        break;
+      }
+      ++it;
+    }
+    return value;
+  }
+}
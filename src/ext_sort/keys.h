@@ -0,0 +1,254 @@
+﻿#ifndef __EXT_SORT_KEYS_H__
+#define __EXT_SORT_KEYS_H__
+
+#include <ext_sort/types.h>
+
+#include <utils/err.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace ExtSort
+{
+  const std::size_t MAX_KEY_FIELDS = 4;
+
+  enum class KeyType
+  {
+    STRING,
+    // Typed keys are parsed into normalised 64-bit keys and use a single key field.
+    INTEGER,
+    FLOAT,
+    HEX,
+    VERSION,
+  };
+
+  struct KeySpec
+  {
+    // 1-based field numbers in the comparison order. No fields means the whole chunk is the key.
+    std::vector<std::size_t> fields;
+    CharsChunk::ObjType fieldsDelim;
+    KeyType type;
+    bool reverse;
+    // A bytes range key of fixed size chunks, used instead of fields when the size is not 0.
+    std::size_t rangeOffset;
+    std::size_t rangeSize;
+
+    KeySpec()
+      : fieldsDelim('\t')
+      , type(KeyType::STRING)
+      , reverse(false)
+      , rangeOffset(0)
+      , rangeSize(0)
+    {
+    }
+  };
+
+  struct ChunkLess
+  {
+    bool operator () (const CharsChunk& lhs, const CharsChunk& rhs) const
+    {
+      return lhs < rhs;
+    }
+  };
+
+  template <typename Less>
+  struct ReversedLess
+  {
+    Less less;
+
+    template <typename Record>
+    bool operator () (const Record& lhs, const Record& rhs) const
+    {
+      return less(rhs, lhs);
+    }
+  };
+
+  // Offsets are relative to the chunk begin, so a key remains valid for a copy of its chunk.
+  struct KeyField
+  {
+    std::uint32_t begin;
+    std::uint32_t end;
+  };
+
+  template <std::size_t N>
+  struct FieldsKey
+  {
+    KeyField fields[N];
+  };
+
+  template <std::size_t N>
+  CharsChunk GetKeyField(const KeyedChunk<FieldsKey<N>>& keyedChunk, std::size_t index)
+  {
+    const auto& field = keyedChunk.key.fields[index];
+    return CharsChunk(keyedChunk.chunk.begin + field.begin, keyedChunk.chunk.begin + field.end);
+  }
+
+  template <std::size_t N>
+  struct FieldsKeyLess
+  {
+    bool operator () (const KeyedChunk<FieldsKey<N>>& lhs, const KeyedChunk<FieldsKey<N>>& rhs) const
+    {
+      for (std::size_t i = 0; i != N; ++i)
+      {
+        const auto cmpRes = Compare(GetKeyField(lhs, i), GetKeyField(rhs, i));
+        if (cmpRes != 0)
+        {
+          return cmpRes < 0;
+        }
+      }
+      return false;
+    }
+  };
+
+  template <std::size_t N>
+  class FieldsKeyParser
+  {
+  public:
+    using Key = FieldsKey<N>;
+
+  private:
+    std::size_t m_fields[N];
+    std::size_t m_lastField;
+    CharsChunk::ObjType m_fieldsDelim;
+
+  public:
+    explicit FieldsKeyParser(const KeySpec& keySpec)
+      : m_lastField(0)
+      , m_fieldsDelim(keySpec.fieldsDelim)
+    {
+      ERR_THROW_IF(keySpec.fields.size() != N, "Invalid argument (key fields count = " + std::to_string(keySpec.fields.size()) + ", expected = " + std::to_string(N) + ").");
+      for (std::size_t i = 0; i != N; ++i)
+      {
+        ERR_THROW_IF(keySpec.fields[i] == 0, "Invalid argument (key field numbers are 1-based).");
+        m_fields[i] = keySpec.fields[i];
+        m_lastField = (std::max)(m_lastField, m_fields[i]);
+      }
+    }
+
+    // Missing fields are parsed as empty ones at the chunk end.
+    void Parse(const CharsChunk& chunk, Key& key) const
+    {
+      const auto chunkSize = chunk.ObjectsCount();
+      ERR_THROW_IF(chunkSize > (std::numeric_limits<std::uint32_t>::max)(), "Chunk is too long to be keyed (length = " + std::to_string(chunkSize) + ").");
+
+      for (auto& field : key.fields)
+      {
+        field.begin = field.end = static_cast<std::uint32_t>(chunkSize);
+      }
+
+      const auto* const chunkBegin = chunk.begin;
+      const auto* const chunkEnd = chunk.end;
+      const auto* fieldBegin = chunkBegin;
+      for (std::size_t fieldNumber = 1; ; ++fieldNumber)
+      {
+        const auto* fieldEnd = std::find(fieldBegin, chunkEnd, m_fieldsDelim);
+        for (std::size_t i = 0; i != N; ++i)
+        {
+          if (m_fields[i] == fieldNumber)
+          {
+            key.fields[i].begin = static_cast<std::uint32_t>(fieldBegin - chunkBegin);
+            key.fields[i].end = static_cast<std::uint32_t>(fieldEnd - chunkBegin);
+          }
+        }
+
+        if (fieldNumber == m_lastField || fieldEnd == chunkEnd)
+        {
+          break;
+        }
+        fieldBegin = fieldEnd + 1;
+      }
+    }
+  };
+
+  // The key is a field at the same offset of every chunk, so it is compared as FieldsKey<1>.
+  class BytesRangeKeyParser
+  {
+  public:
+    using Key = FieldsKey<1>;
+
+  private:
+    const std::size_t m_offset;
+    const std::size_t m_size;
+
+  public:
+    explicit BytesRangeKeyParser(const KeySpec& keySpec)
+      : m_offset(keySpec.rangeOffset)
+      , m_size(keySpec.rangeSize)
+    {
+      ERR_THROW_IF(m_size == 0, "Invalid argument (key range size is 0).");
+      ERR_THROW_IF(m_offset + m_size > (std::numeric_limits<std::uint32_t>::max)(), "Invalid argument (key range is too long).");
+    }
+
+    // A range outside of a short chunk is clamped to the chunk end.
+    void Parse(const CharsChunk& chunk, Key& key) const
+    {
+      const auto chunkSize = chunk.ObjectsCount();
+      key.fields[0].begin = static_cast<std::uint32_t>((std::min)(m_offset, chunkSize));
+      key.fields[0].end = static_cast<std::uint32_t>((std::min)(m_offset + m_size, chunkSize));
+    }
+  };
+
+  // Order preserving mappings of a key field to an unsigned 64-bit value.
+  // Only the leading parsable part of a field is used. A field without one is mapped to the key of 0
+  // for integers, hex numbers and versions, and to the smallest key (below -inf) for floats.
+  std::uint64_t NormaliseInteger(const CharsChunk& field);
+  std::uint64_t NormaliseFloat(const CharsChunk& field);
+  std::uint64_t NormaliseHex(const CharsChunk& field);
+  // Up to 4 numeric components of up to 16 bits each: '1.2.10' < '1.10'.
+  std::uint64_t NormaliseVersion(const CharsChunk& field);
+
+  using NormalisedKey = std::uint64_t;
+
+  struct NormalisedKeyLess
+  {
+    bool operator () (const KeyedChunk<NormalisedKey>& lhs, const KeyedChunk<NormalisedKey>& rhs) const
+    {
+      return lhs.key < rhs.key;
+    }
+  };
+
+  template <NormalisedKey (*Normalise)(const CharsChunk&)>
+  class NormalisedKeyParser
+  {
+  public:
+    using Key = NormalisedKey;
+
+  private:
+    const bool m_wholeChunk;
+    const FieldsKeyParser<1> m_fieldParser;
+
+  public:
+    explicit NormalisedKeyParser(const KeySpec& keySpec)
+      : m_wholeChunk(keySpec.fields.empty())
+      , m_fieldParser(m_wholeChunk ? WholeChunkSpec() : keySpec)
+    {
+    }
+
+    void Parse(const CharsChunk& chunk, Key& key) const
+    {
+      if (m_wholeChunk)
+      {
+        key = Normalise(chunk);
+        return;
+      }
+
+      KeyedChunk<FieldsKey<1>> field;
+      field.chunk = chunk;
+      m_fieldParser.Parse(chunk, field.key);
+      key = Normalise(GetKeyField(field, 0));
+    }
+
+  private:
+    static KeySpec WholeChunkSpec()
+    {
+      KeySpec keySpec;
+      keySpec.fields.push_back(1);
+      return keySpec;
+    }
+  };
+}
+
+#endif
@@ -1,38 +1,56 @@
 ﻿#include <ext_sort/merge_sort_sorter.h>
 #include <ext_sort/ext_sort_utils.h>
+#include <ext_sort/chunks_format.h>
 #include <ext_sort/file_chunks_enumerator.h>
+#include <ext_sort/file_chunks_writer.h>
+#include <ext_sort/records.h>
+#include <ext_sort/run_chunks_enumerator.h>
 
 #include <utils/align.h>
 #include <utils/log/log.h>
 #include <utils/err.h>
 #include <utils/merge_sort.h>
+#include <utils/metrics.h>
 #include <utils/scope_time_logger.h>
+#include <utils/trace.h>
 
 #include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <deque>
 #include <sstream>
 
 namespace ExtSort
 {
   namespace
   {
+    // A run buffer is shared by the records data and their descriptors: the data is read straight to the buffer begin,
+    // the descriptors and the merge sort buffer take the end, so a run ends when they meet whatever the records lengths are.
+    template <typename Records>
     class MergeSortSorter : public Sorter
     {
-      using ChunksChunk = Chunk<CharsChunk>;
+      using Record = typename Records::Record;
+      using Less = typename Records::Less;
+      using RecordsChunk = Chunk<Record>;
 
       std::unique_ptr<Utils::Fs::FilePathsEnumerator> m_filePaths;
-      const CharsChunk::ObjType m_chunksDelim;
+      const SortOptions m_options;
+      const Less m_less;
       BytesChunk m_writeBuffer;
-      CharsChunk m_readBuffer;
-      ChunksChunk m_chunksBuffer;
+      RecordsChunk m_runBuffer;
+      RecordCopy<Record> m_threshold;
+      // Copies are not moved, so their records remain valid.
+      std::deque<RecordCopy<Record>> m_samples;
+      std::vector<std::size_t> m_samplesWeights;
 
     public:
       MergeSortSorter(std::unique_ptr<Utils::Fs::FilePathsEnumerator> filePaths,
                       const BytesChunk& buffer,
                       std::size_t maxWriteBufferSize,
-                      CharsChunk::ObjType chunksDelim)
+                      const SortOptions& options)
         : m_filePaths(std::move(filePaths))
-        , m_chunksDelim(chunksDelim)
+        , m_options(options)
+        , m_less()
       {
         ERR_THROW_IF_NOT(m_filePaths, "Invalid argument (file paths is null).");
 
@@ -40,28 +58,25 @@ namespace ExtSort
 
         LOG_I("MergeSortSorter::MergeSortSorter: buffer size = %s", FormatDataSize(buffer.ObjectsCount()).c_str());
 
-        const auto byfferSize = buffer.BytesCount();
-        const auto maxAcceptableWriteBufferSize = byfferSize / 10;
-        const auto writeBufferSize = (std::min)(maxAcceptableWriteBufferSize, maxWriteBufferSize);
-
-        m_writeBuffer.begin = (BytesChunk::ObjType*)(buffer.begin);
-        m_writeBuffer.end = (BytesChunk::ObjType*)(buffer.begin + writeBufferSize);
+        const auto writeBufferSize = (std::min)(buffer.BytesCount() / 10, maxWriteBufferSize);
+        m_writeBuffer.begin = buffer.begin;
+        m_writeBuffer.end = buffer.begin + writeBufferSize;
         CheckChunk(m_writeBuffer, buffer.end);
 
-        m_chunksBuffer.begin = Utils::GetAligned((ChunksChunk::ObjType*)(m_writeBuffer.end));
-        m_chunksBuffer.end = Utils::GetAligned((ChunksChunk::ObjType*)buffer.end);
-        AdjustEnd(m_chunksBuffer, buffer.end);
-
-        const auto availableBufferedChunks = m_chunksBuffer.ObjectsCount() / 2 - m_chunksBuffer.ObjectsCount() % 2;
-        m_chunksBuffer.end = m_chunksBuffer.begin + availableBufferedChunks;
-        CheckChunk(m_chunksBuffer, buffer.end);
+        // Records are read straight into the run buffer, so it takes the rest of the buffer.
+        // The rest is not necessarily a multiple of the record size, so the end is counted.
+        m_runBuffer.begin = Utils::GetAligned((typename RecordsChunk::ObjType*)(m_writeBuffer.end));
+        const auto availableRecords = static_cast<std::size_t>((const Byte*)buffer.end - (const Byte*)m_runBuffer.begin) / RecordsChunk::SizeOfObject();
+        m_runBuffer.end = m_runBuffer.begin + availableRecords;
+        CheckChunk(m_runBuffer, buffer.end);
+      }
 
-        m_readBuffer.begin = Utils::GetAligned((CharsChunk::ObjType*)m_chunksBuffer.end);
-        m_readBuffer.end = Utils::GetAligned((CharsChunk::ObjType*)buffer.end);
-        AdjustEnd(m_readBuffer, buffer.end);
+      virtual std::vector<std::string> Sort(const std::string& sourceFilePath)
+      {
+        return Sort(sourceFilePath, Utils::Fs::FileRange{ 0, Utils::Fs::GetSize(sourceFilePath) });
       }
 
-      virtual std::set<std::string> Sort(const std::string& sourceFilePath)
+      virtual std::vector<std::string> Sort(const std::string& sourceFilePath, const Utils::Fs::FileRange& range)
       {
         Utils::Log::ScopedInfoLog sortScope("MergeSortSorter::Sort");
 
@@ -69,15 +84,15 @@ namespace ExtSort
 
         LOG_I("source file path    = '%s'", sourceFilePath.c_str());
 
-        const auto sourceFileSize = Utils::Fs::GetSize(sourceFilePath);
+        const auto sourceFileSize = range.GetSize();
         if (sourceFileSize == 0)
         {
-          LOG_W("%s", ("The '" + sourceFilePath + "' file is empty.").c_str());
+          LOG_W("%s", ("The '" + sourceFilePath + "' file range is empty.").c_str());
           std::string resultFilePath;
           ERR_THROW_IF_NOT(m_filePaths->Next(resultFilePath), "Cannot get next file path.");
           Utils::Fs::OpenFile(resultFilePath, "wb");
-          std::set<std::string> files;
-          files.insert(resultFilePath);
+          std::vector<std::string> files;
+          files.push_back(resultFilePath);
           return files;
         }
 
@@ -86,74 +101,154 @@ namespace ExtSort
 
         LOG_I("source file size    = %s", FormatDataSize(static_cast<std::size_t>(sourceFileSize)).c_str());
 
-        const auto allChunks = m_chunksBuffer.ObjectsCount() / 2;
-        auto freeChunks = allChunks;
-        CharsChunk* chunksCursor = m_chunksBuffer.begin;
-        CharsChunk* sortBuffer = m_chunksBuffer.begin + freeChunks;
+        // Descriptors are taken from the end backwards and reversed before the sort, so the stable mode keeps the read order.
+        auto* const dataBegin = (CharsChunk::ObjType*)m_runBuffer.begin;
+        auto* dataCursor = dataBegin;
+        Record* const recordsEnd = m_runBuffer.end;
+        Record* recordsCursor = recordsEnd;
 
-        LOG_I("max chunks per file = %s", FormatDataCount(freeChunks).c_str());
-        LOG_I("max chunk length    = %s", FormatDataSize(m_readBuffer.ObjectsCount()).c_str());
+        LOG_I("run buffer size     = %s", FormatDataSize(m_runBuffer.BytesCount()).c_str());
+        if (m_options.limit != 0)
+        {
+          LOG_I("limit               = %s", FormatDataCount(m_options.limit).c_str());
+        }
 
-        std::set<std::string> resultFilePaths;
+        std::vector<std::string> resultFilePaths;
 
         const auto flushData = [&, this] ()
         {
-          if (m_chunksBuffer.begin != chunksCursor)
+          if (recordsCursor != recordsEnd)
           {
             std::string targetFilePath;
             ERR_THROW_IF_NOT(m_filePaths->Next(targetFilePath), "Cannot get next file path.");
 
-            const auto chunksArr = m_chunksBuffer.begin;
-            const auto chunksArrSize = std::distance(m_chunksBuffer.begin, chunksCursor);
-            const auto chunksDataSize = std::distance(chunksArr[0].begin, chunksArr[chunksArrSize - 1].end) + 1;
-            SortAndSave(sortBuffer, chunksArr, chunksArrSize, targetFilePath);
-            resultFilePaths.insert(targetFilePath);
-            chunksCursor = m_chunksBuffer.begin;
-            freeChunks = allChunks;
+            const auto chunksArr = recordsCursor;
+            const auto chunksArrSize = static_cast<std::size_t>(std::distance(recordsCursor, recordsEnd));
+            const auto chunksDataSize = std::distance(dataBegin, dataCursor);
+            std::reverse(chunksArr, recordsEnd);
+            SortAndSave(chunksArr - chunksArrSize, chunksArr, chunksArrSize, targetFilePath);
+            resultFilePaths.push_back(targetFilePath);
+            dataCursor = dataBegin;
+            recordsCursor = recordsEnd;
 
             sortedDataSize += chunksDataSize;
-            std::string progress = FormatPart(sourceFileSize, sortedDataSize);
-            if (progress != sortedDataProgress)
+            if (Utils::Log::IsEnabled(Utils::Log::LOG_LEVEL_INFO))
             {
-              sortedDataProgress.swap(progress);
-              LOG_I("Sort progress: %s", sortedDataProgress.c_str());
+              std::string progress = FormatPart(sourceFileSize, sortedDataSize);
+              if (progress != sortedDataProgress)
+              {
+                sortedDataProgress.swap(progress);
+                LOG_I("Sort progress: %s", sortedDataProgress.c_str());
+              }
             }
           }
         };
 
-        const auto enumeratorObserver = [&, this] (const std::string& eventId)
+        // Delimited chunks are kept with their delimiters for the writer.
+        const std::size_t chunkTailSize = m_options.format.type == ChunksFormat::Type::DELIMITED ? 1 : 0;
+
+        // The data may be read up to the descriptor of the next record and the sort buffer slots of all the run descriptors.
+        const auto getReadLimit = [&] ()
+        {
+          const auto reservedSize = (std::distance(recordsCursor, recordsEnd) + 2) * sizeof(Record);
+          const auto freeSize = static_cast<std::size_t>((Byte*)recordsCursor - (Byte*)dataBegin);
+          return reservedSize < freeSize ? (CharsChunk::ObjType*)((Byte*)recordsCursor - reservedSize) : dataBegin;
+        };
+
+        auto enumerator = Records::CreateEnumerator(
+          CreateRunChunksEnumerator(sourceFilePath, range, m_options.format, CharsChunk(dataBegin, (CharsChunk::ObjType*)recordsEnd), 2 * sizeof(Record), getReadLimit),
+          m_options.key);
+        enumerator->SetObserver([&] (const std::string& event)
         {
-          if (eventId == FileChunksEnumeratorEvents::BEFORE_READ_BUFFER)
+          if (event == FileChunksEnumeratorEvents::BEFORE_READ_BUFFER)
           {
             flushData();
           }
-        };
-
-        auto enumerator = CreateFileChunksEnumerator(sourceFilePath, m_readBuffer, m_chunksDelim);
-        enumerator->SetObserver(enumeratorObserver);
+        });
 
-        CharsChunk chunk;
+        std::size_t readChunks = 0;
+        std::size_t prunedChunks = 0;
+        Record chunk;
         while (enumerator->Next(chunk))
         {
-          *chunksCursor = chunk;
-          ++chunksCursor;
-          --freeChunks;
-          if (freeChunks == 0)
+          ++readChunks;
+          if (IsPruned(chunk))
           {
-            flushData();
+            ++prunedChunks;
+            continue;
           }
+
+          auto& chunkData = GetChunk(chunk);
+          const auto chunkSize = chunkData.ObjectsCount();
+          const auto headSize = GetEncodedSize(chunkData, m_options.format) - chunkSize - chunkTailSize;
+          if (chunkData.begin - headSize == dataCursor)
+          {
+            dataCursor += headSize + chunkSize + chunkTailSize;
+          }
+          else
+          {
+            // Pruned chunks leave a gap, so the chunk is moved down. Keys are relative to the chunk begin, so they remain valid.
+            std::memmove(dataCursor, chunkData.begin, chunkSize + chunkTailSize);
+            chunkData.begin = dataCursor;
+            chunkData.end = dataCursor + chunkSize;
+            dataCursor += chunkSize + chunkTailSize;
+          }
+          --recordsCursor;
+          *recordsCursor = chunk;
         }
 
         flushData();
 
+        if (m_options.limit != 0)
+        {
+          LOG_I("Pruned chunks = %s", FormatDataCount(prunedChunks).c_str());
+        }
+
         LOG_I("DONE: 100%%");
         LOG_I("Sort file time = %s", FormatDuration(std::chrono::system_clock::now() - startTime).c_str());
 
-        return std::move(resultFilePaths);
+        Utils::Metrics::Add("lines", readChunks);
+        Utils::Metrics::Add("pruned_lines", prunedChunks);
+        Utils::Metrics::AddDuration("total_us", std::chrono::system_clock::now() - startTime);
+
+        return resultFilePaths;
+      }
+
+      virtual std::vector<std::string> GetSplitters() const override
+      {
+        std::vector<std::size_t> order(m_samples.size());
+        for (std::size_t i = 0; i != order.size(); ++i)
+        {
+          order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [this](std::size_t lhs, std::size_t rhs)
+        {
+          return m_less(m_samples[lhs].Get(), m_samples[rhs].Get());
+        });
+
+        std::vector<std::size_t> sortedWeights;
+        for (const auto i : order)
+        {
+          sortedWeights.push_back(m_samplesWeights[i]);
+        }
+
+        const auto positions = GetSplittersPositions(sortedWeights, m_options.shards);
+        if (positions.empty())
+        {
+          return std::vector<std::string>(m_options.shards - 1);
+        }
+
+        std::vector<std::string> splitters;
+        for (const auto position : positions)
+        {
+          const auto& chunk = GetChunk(m_samples[order[position]].Get());
+          splitters.emplace_back(chunk.begin, chunk.end);
+        }
+        return splitters;
       }
 
     private:
-      void SortAndSave(CharsChunk* buf, CharsChunk* arr, std::size_t size, const std::string& outputFilePath)
+      void SortAndSave(Record* buf, Record* arr, std::size_t size, const std::string& outputFilePath)
       {
         Utils::Log::ScopedInfoLog sortScope("MergeSortSorter::SortAndSave");
 
@@ -162,19 +257,67 @@ namespace ExtSort
 
         LOG_I("output file path   = '%s'" , outputFilePath.c_str());
         LOG_I("chunks count       = %s"   , FormatDataCount(size).c_str());
-        LOG_I("total chunks size  = %s"   , FormatDataSize(std::distance(arr[0].begin, arr[size - 1].end) + 1).c_str());
+        LOG_I("total chunks size  = %s"   , FormatDataSize(std::distance(GetChunk(arr[0]).begin, GetChunk(arr[size - 1]).end) + 1).c_str());
         
         const auto startTime = std::chrono::system_clock::now();
 
-        Utils::MergeSort(buf, arr, 0, size - 1);
+        // Only the first limit chunks of a run can get into the result,
+        // so the rest is just partitioned away instead of being sorted.
+        // Duplicates are not known before sorting, so it is not the case for the unique mode.
+        // The partitioning does not keep the order of equal chunks, so the stable mode sorts the whole run and cuts it.
+        // All the chunks of a key are required to aggregate them.
+        const auto aggregate = m_options.aggregation.type != Aggregation::Type::NONE;
+        const auto limit = m_options.limit;
+        const auto cut = limit != 0 && !m_options.unique && !aggregate;
+        auto saveSize = cut && !m_options.stable ? (std::min)(size, limit) : size;
+        {
+          Utils::Trace::ScopedSpan sortSpan("sort");
+          if (saveSize != size)
+          {
+            std::nth_element(arr, arr + saveSize - 1, arr + size, m_less);
+          }
+          Utils::MergeSort(buf, arr, 0, saveSize - 1, m_less);
+        }
+        if (cut)
+        {
+          saveSize = (std::min)(saveSize, limit);
+        }
+        Sample(arr, saveSize);
+        if (aggregate)
+        {
+          const auto sortDuration = std::chrono::system_clock::now() - startTime;
+          Utils::Metrics::Add("runs", 1);
+          Utils::Metrics::AddDuration("sort_us", sortDuration);
+          SaveAggregated(arr, size, outputFilePath);
+          LOG_I("total time         = %s : sort %s", FormatDuration(std::chrono::system_clock::now() - startTime).c_str(), FormatDuration(sortDuration).c_str());
+          return;
+        }
+        if (m_options.unique)
+        {
+          saveSize = std::distance(arr, std::unique(arr, arr + saveSize, [this](const auto& lhs, const auto& rhs)
+          {
+            return !m_less(lhs, rhs);
+          }));
+          if (limit != 0)
+          {
+            saveSize = (std::min)(saveSize, limit);
+          }
+          LOG_I("unique chunks      = %s", FormatDataCount(saveSize).c_str());
+        }
+        if (saveSize == limit)
+        {
+          UpdateThreshold(arr[saveSize - 1]);
+        }
         const auto sortDuration = (std::chrono::system_clock::now() - startTime).count();
+        Utils::Metrics::Add("runs", 1);
+        Utils::Metrics::AddDuration("sort_us", std::chrono::system_clock::duration(sortDuration));
 
-        SaveToNewFile(outputFilePath, arr, size, true, m_writeBuffer.begin, m_writeBuffer.BytesCount());
+        SaveToNewFile(outputFilePath, arr, saveSize, m_options.format, m_writeBuffer);
         const auto saveDuration = (std::chrono::system_clock::now() - startTime).count() - sortDuration;
 
         const auto totalDuration = std::chrono::system_clock::now() - startTime;
 
-        if (totalDuration.count() > 0)
+        if (totalDuration.count() > 0 && Utils::Log::IsEnabled(Utils::Log::LOG_LEVEL_INFO))
         {
           std::ostringstream oss;
           oss << "total time         = " << FormatDuration(totalDuration);
@@ -184,6 +327,61 @@ namespace ExtSort
         }
       }
 
+      void Sample(const Record* arr, std::size_t size)
+      {
+        if (m_options.shards < 2)
+        {
+          return;
+        }
+        ForEachSample(size, m_options.shards, [&](std::size_t index, std::size_t weight)
+        {
+          m_samples.emplace_back();
+          m_samples.back().Assign(arr[index]);
+          m_samplesWeights.push_back(weight);
+        });
+      }
+
+      // Every group of chunks with equal keys is saved as its first chunk with the aggregated value.
+      void SaveAggregated(const Record* arr, std::size_t size, const std::string& outputFilePath) const
+      {
+        const auto fieldsDelim = m_options.key.fieldsDelim;
+        const auto chunksDelim = m_options.format.delim;
+        const auto limit = m_options.limit != 0 ? m_options.limit : size;
+        // Aggregated chunks are formatted into one string, which is copied to the write buffer.
+        const auto writer = CreateFileChunksWriter(outputFilePath, m_writeBuffer, m_options.format);
+        std::string aggregated;
+        std::size_t groups = 0;
+        for (std::size_t i = 0; i != size && groups != limit; ++groups)
+        {
+          const auto& group = arr[i];
+          AggregatedValue value;
+          for (; i != size && !m_less(group, arr[i]); ++i)
+          {
+            value += GetSourceValue(m_options.aggregation, GetChunk(arr[i]), fieldsDelim);
+          }
+          FormatAggregatedChunk(GetChunk(group), value, fieldsDelim, chunksDelim, aggregated);
+          writer->Write(CharsChunk(&aggregated[0], &aggregated[0] + aggregated.size() - 1));
+        }
+        writer->Flush();
+
+        LOG_I("aggregated chunks  = %s", FormatDataCount(groups).c_str());
+      }
+
+      // A chunk which is greater than the limit-th chunk of some saved run
+      // cannot get into the first limit chunks of the result.
+      bool IsPruned(const Record& chunk) const
+      {
+        return !m_threshold.IsEmpty() && m_less(m_threshold.Get(), chunk);
+      }
+
+      void UpdateThreshold(const Record& candidate)
+      {
+        if (m_threshold.IsEmpty() || m_less(candidate, m_threshold.Get()))
+        {
+          m_threshold.Assign(candidate);
+        }
+      }
+
       MergeSortSorter(const MergeSortSorter&) = delete;
       MergeSortSorter& operator = (const MergeSortSorter&) = delete;
     };
@@ -192,10 +390,14 @@ namespace ExtSort
   std::unique_ptr<Sorter> CreateMergeSortSorter(
     std::unique_ptr<Utils::Fs::FilePathsEnumerator> filePaths,
     const BytesChunk& buffer,
-    const std::size_t maxWriteBufferSize,
-    CharsChunk::ObjType chunksDelim)
+    std::size_t maxWriteBufferSize,
+    const SortOptions& options)
   {
-    return std::make_unique<MergeSortSorter>(
-      std::move(filePaths), buffer, maxWriteBufferSize, chunksDelim);
+    return DispatchRecords(options.key, [&](auto records) -> std::unique_ptr<Sorter>
+    {
+      using Records = decltype(records);
+      return std::make_unique<MergeSortSorter<Records>>(
+        std::move(filePaths), buffer, maxWriteBufferSize, options);
+    });
   }
 }
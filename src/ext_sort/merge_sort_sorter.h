@@ -1,6 +1,7 @@
 ﻿#ifndef __EXT_SORT_MERGE_SORT_SORTER_H__
 #define __EXT_SORT_MERGE_SORT_SORTER_H__
 
+#include <ext_sort/sort_options.h>
 #include <ext_sort/sorter.h>
 #include <ext_sort/types.h>
 
@@ -14,7 +15,7 @@ namespace ExtSort
     std::unique_ptr<Utils::Fs::FilePathsEnumerator> filePaths,
     const BytesChunk& buffer,
     std::size_t maxWriteBufferSize,
-    CharsChunk::ObjType chunksDelim);
+    const SortOptions& options);
 }
 
 #endif
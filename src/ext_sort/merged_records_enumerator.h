@@ -0,0 +1,119 @@
+﻿#ifndef __EXT_SORT_MERGED_RECORDS_ENUMERATOR_H__
+#define __EXT_SORT_MERGED_RECORDS_ENUMERATOR_H__
+
+#include <ext_sort/types.h>
+
+#include <utils/err.h>
+#include <utils/pool_allocator.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace ExtSort
+{
+  // Merges sorted sources into one sorted sequence.
+  // A record remains valid until the next call of Next: its source is advanced lazily.
+  // In the stable mode equal records are ordered by their sources indices, so no sequence numbers are stored.
+  template <typename Records, bool Stable>
+  class MergedRecordsEnumerator : public Records::RecordsEnumerator
+  {
+  public:
+    using Record = typename Records::Record;
+    using Less = typename Records::Less;
+    using RecordsEnumerator = typename Records::RecordsEnumerator;
+    using EventsObserver = typename RecordsEnumerator::EventsObserver;
+
+  private:
+    struct MergeKey
+    {
+      Record record;
+      std::size_t source;
+    };
+
+    struct MergeKeyLess
+    {
+      Less less;
+
+      bool operator () (const MergeKey& lhs, const MergeKey& rhs) const
+      {
+        if (less(lhs.record, rhs.record))
+        {
+          return true;
+        }
+        return Stable && lhs.source < rhs.source && !less(rhs.record, lhs.record);
+      }
+    };
+
+    // Every merged record erases a node and inserts one, the pool reuses it instead of the heap.
+    using MergeItem = std::pair<const MergeKey, RecordsEnumerator*>;
+    using MergeItems = std::multimap<MergeKey, RecordsEnumerator*, MergeKeyLess, Utils::PoolAllocator<MergeItem>>;
+
+    std::vector<std::unique_ptr<RecordsEnumerator>> m_sources;
+    MergeItems m_mergeItems;
+    std::pair<MergeKey, RecordsEnumerator*> m_lastItem;
+
+  public:
+    MergedRecordsEnumerator(std::vector<std::unique_ptr<RecordsEnumerator>> sources, const Less& less)
+      : m_sources(std::move(sources))
+      , m_mergeItems(MergeKeyLess{ less })
+      , m_lastItem(MergeKey{ Record(), 0 }, nullptr)
+    {
+      for (std::size_t source = 0; source != m_sources.size(); ++source)
+      {
+        const auto enumerator = m_sources[source].get();
+        ERR_THROW_IF_NOT(enumerator, "Invalid argument (source enumerator is null).");
+
+        Record record;
+        if (enumerator->Next(record))
+        {
+          m_mergeItems.emplace(MergeKey{ record, source }, enumerator);
+        }
+      }
+    }
+
+    virtual void SetObserver(EventsObserver) override
+    {
+    }
+
+    virtual bool Next(Record& record) override
+    {
+      if (m_lastItem.second)
+      {
+        if (m_lastItem.second->Next(m_lastItem.first.record))
+        {
+          m_mergeItems.insert(m_lastItem);
+        }
+        m_lastItem.second = nullptr;
+      }
+
+      if (m_mergeItems.empty())
+      {
+        return false;
+      }
+
+      m_lastItem = *m_mergeItems.begin();
+      m_mergeItems.erase(m_mergeItems.begin());
+      record = m_lastItem.first.record;
+      return true;
+    }
+
+    MergedRecordsEnumerator(const MergedRecordsEnumerator&) = delete;
+    MergedRecordsEnumerator& operator = (const MergedRecordsEnumerator&) = delete;
+  };
+
+  template <typename Records>
+  std::unique_ptr<typename Records::RecordsEnumerator> CreateMergedRecordsEnumerator(
+    std::vector<std::unique_ptr<typename Records::RecordsEnumerator>> sources,
+    const typename Records::Less& less,
+    bool stable)
+  {
+    if (stable)
+    {
+      return std::make_unique<MergedRecordsEnumerator<Records, true>>(std::move(sources), less);
+    }
+    return std::make_unique<MergedRecordsEnumerator<Records, false>>(std::move(sources), less);
+  }
+}
+
+#endif
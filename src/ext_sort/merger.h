@@ -1,17 +1,32 @@
 ﻿#ifndef __EXT_SORT_MERGER_H__
 #define __EXT_SORT_MERGER_H__
 
-#include <set>
+#include <functional>
 #include <string>
+#include <vector>
 
 namespace ExtSort
 {
   class Merger
   {
+  public:
+    // Called when an intermediate merge task has written its result, before its sources are removed.
+    using TasksObserver = std::function<void(const std::vector<std::string>& sourceFilePaths, const std::string& resultFilePath)>;
+
   public:
     virtual ~Merger() = default;
 
-    virtual void Merge(const std::set<std::string>& sortedFilePaths, const std::string& resultFilePath) = 0;
+    virtual void SetObserver(TasksObserver observer) = 0;
+
+    // The sorted files are expected in the order of the source data.
+    virtual void Merge(const std::vector<std::string>& sortedFilePaths, const std::string& resultFilePath) = 0;
+
+    // Every result gets chunks which are not less than its splitter (but the first one) and
+    // are less than the next splitter. The results are merged in parallel.
+    // The splitters may be replaced by the chunks of the sorted files, which split them into parts of closer sizes.
+    virtual void Merge(const std::vector<std::string>& sortedFilePaths,
+                       const std::vector<std::string>& splitters,
+                       const std::vector<std::string>& resultFilePaths) = 0;
   };
 }
 
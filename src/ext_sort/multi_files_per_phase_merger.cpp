@@ -1,39 +1,66 @@
 ﻿#include <ext_sort/multi_files_per_phase_merger.h>
 
 #include <ext_sort/ext_sort_utils.h>
-#include <ext_sort/file_chunks_enumerator.h>
+#include <ext_sort/aggregation.h>
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/file_chunks_writer.h>
+#include <ext_sort/merged_records_enumerator.h>
+#include <ext_sort/offsets_chunks_enumerator.h>
+#include <ext_sort/records.h>
+#include <ext_sort/sparse_index.h>
+#include <ext_sort/strings_chunks_enumerator.h>
 
 #include <utils/align.h>
 #include <utils/err.h>
+#include <utils/fs/fs.h>
 #include <utils/log/log.h>
 #include <utils/merge_sort.h>
+#include <utils/metrics.h>
 
 #include <algorithm>
 #include <chrono>
-#include <map>
+#include <exception>
+#include <limits>
+#include <memory>
 #include <numeric>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 namespace ExtSort
 {
   namespace
   {
+    template <typename Records>
     class MultiFilesPerPhaseMerger : public Merger
     {
-      using ChunksChunk = Chunk<CharsChunk>;
+      using Record = typename Records::Record;
+      using Less = typename Records::Less;
+      using RecordsEnumerator = typename Records::RecordsEnumerator;
 
       struct ReadParams
       {
         std::string filePath;
         CharsChunk readBuffer;
+        // Files of the next phases do not exist when the tasks are created, so they are read whole.
+        bool wholeFile = true;
+        Utils::Fs::FileRange range;
+
+        Utils::Fs::FileRange GetRange() const
+        {
+          return wholeFile ? Utils::Fs::FileRange{ 0, Utils::Fs::GetSize(filePath) } : range;
+        }
       };
 
       struct MergeTask
       {
         std::string name;
+        unsigned phase = 0;
         std::string resultFilePath;
+        // Empty when the result is not indexed.
+        std::string indexFilePath;
         BytesChunk writeBuffer;
+        BytesChunk indexWriteBuffer;
         std::vector<ReadParams> readParams;
       };
 
@@ -42,28 +69,36 @@ namespace ExtSort
       const BytesChunk m_buffer;
       const std::size_t m_maxFilesPerPhase;
       const std::size_t m_maxWriteBufferSize;
-      const CharsChunk::ObjType m_chunksDelim;
       const bool m_removeTempFiles;
+      const SortOptions m_options;
+      const Less m_less;
+      TasksObserver m_observer;
 
     public:
       MultiFilesPerPhaseMerger(std::unique_ptr<Utils::Fs::FilePathsEnumerator> tempFilePaths,
                                const BytesChunk& buffer,
                                std::size_t maxFilesPerPhase,
                                std::size_t maxWriteBufferSize,
-                               CharsChunk::ObjType chunksDelim,
-                               bool removeTempFiles)
+                               bool removeTempFiles,
+                               const SortOptions& options)
         : m_tempFilePaths(std::move(tempFilePaths))
         , m_buffer(buffer)
         , m_maxFilesPerPhase(maxFilesPerPhase)
         , m_maxWriteBufferSize(maxWriteBufferSize)
-        , m_chunksDelim(chunksDelim)
         , m_removeTempFiles(removeTempFiles)
+        , m_options(options)
+        , m_less()
       {
         ERR_THROW_IF_NOT(m_tempFilePaths, "Invalid argument (file paths is null).");
         CheckChunk(m_buffer);
       }
 
-      virtual void Merge(const std::set<std::string>& sortedFilePaths, const std::string& resultFilePath) override
+      virtual void SetObserver(TasksObserver observer) override
+      {
+        m_observer = std::move(observer);
+      }
+
+      virtual void Merge(const std::vector<std::string>& sortedFilePaths, const std::string& resultFilePath) override
       {
         Utils::Log::ScopedInfoLog sortScope("MultiFilesPerPhaseMerger::Merge");
 
@@ -80,7 +115,8 @@ namespace ExtSort
         });
         ERR_THROW_IF(emptySortedFilePathsCount != 0, "Invalid argument (emptySortedFilePathsCount = " + std::to_string(emptySortedFilePathsCount) + ").");
 
-        if (sortedFilePaths.size() == 1)
+        // A single sorted file is copied when indexed, the index is built while writing.
+        if (sortedFilePaths.size() == 1 && m_options.indexStep == 0)
         {
           Utils::Fs::MoveFile(*sortedFilePaths.begin(), resultFilePath);
           return;
@@ -88,6 +124,7 @@ namespace ExtSort
 
         std::size_t completedMergeTasks = 0;
         const auto mergeTasks = GetMergeTasks(0, sortedFilePaths, resultFilePath);
+        Utils::Metrics::Add("merge_phases", mergeTasks.back().phase + 1);
         for (const auto& mergeTask : mergeTasks)
         {
           std::ostringstream scope;
@@ -98,6 +135,15 @@ namespace ExtSort
           Utils::Log::ScopedInfoLog mergeTaskScope(scope.str());
           const auto startMergeTime = std::chrono::system_clock::now();
           Merge(mergeTask);
+          if (m_observer && mergeTask.resultFilePath != resultFilePath)
+          {
+            std::vector<std::string> sourceFilePaths;
+            for (const auto& readParams : mergeTask.readParams)
+            {
+              sourceFilePaths.push_back(readParams.filePath);
+            }
+            m_observer(sourceFilePaths, mergeTask.resultFilePath);
+          }
           if (m_removeTempFiles)
           {
             for (const auto& readParams : mergeTask.readParams)
@@ -113,111 +159,483 @@ namespace ExtSort
         LOG_I("Merge time = %s", FormatDuration(std::chrono::system_clock::now() - startTime).c_str());
       }
 
+      virtual void Merge(const std::vector<std::string>& sortedFilePaths,
+                         const std::vector<std::string>& splitters,
+                         const std::vector<std::string>& resultFilePaths) override
+      {
+        Utils::Log::ScopedInfoLog sortScope("MultiFilesPerPhaseMerger::MergeShards");
+
+        const auto startTime = std::chrono::system_clock::now();
+
+        const auto shardsCount = resultFilePaths.size();
+        LOG_I("result source files count = %s", std::to_string(sortedFilePaths.size()).c_str());
+        LOG_I("result shards count = %s", std::to_string(shardsCount).c_str());
+
+        ERR_THROW_IF(shardsCount != splitters.size() + 1, "Invalid argument (shards count = " + std::to_string(shardsCount) + ", splitters count = " + std::to_string(splitters.size()) + ").");
+        ERR_THROW_IF(sortedFilePaths.size() > m_maxFilesPerPhase, "Shards are merged in a single phase (files count = " + std::to_string(sortedFilePaths.size()) + ", max files per phase = " + std::to_string(m_maxFilesPerPhase) + ").");
+
+        // Splitters are parsed as source chunks, the records refer to the splitters copy.
+        std::vector<std::string> splittersData = BalanceSplitters(sortedFilePaths, splitters);
+        std::vector<Record> splitterRecords;
+        {
+          auto enumerator = Records::CreateEnumerator(CreateStringsChunksEnumerator(splittersData), m_options.key);
+          Record record;
+          while (enumerator->Next(record))
+          {
+            splitterRecords.push_back(record);
+          }
+        }
+        for (std::size_t i = 1; i < splitterRecords.size(); ++i)
+        {
+          ERR_THROW_IF(m_less(splitterRecords[i], splitterRecords[i - 1]), "Invalid argument (splitters are not sorted).");
+        }
+
+        std::vector<MergeTask> mergeTasks(shardsCount);
+        Utils::Metrics::Add("merge_phases", 1);
+        for (std::size_t shard = 0; shard != shardsCount; ++shard)
+        {
+          mergeTasks[shard].name = "shard." + std::to_string(shard);
+          mergeTasks[shard].resultFilePath = resultFilePaths[shard];
+          mergeTasks[shard].indexFilePath = GetResultIndexFilePath(resultFilePaths[shard]);
+        }
+        for (const auto& filePath : sortedFilePaths)
+        {
+          const auto ranges = GetShardRanges(filePath, splitterRecords);
+          for (std::size_t shard = 0; shard != shardsCount; ++shard)
+          {
+            ReadParams readParams;
+            readParams.filePath = filePath;
+            readParams.wholeFile = false;
+            readParams.range = ranges[shard];
+            mergeTasks[shard].readParams.push_back(std::move(readParams));
+          }
+        }
+
+        const auto shardBufferSize = m_buffer.BytesCount() / shardsCount;
+        for (std::size_t shard = 0; shard != shardsCount; ++shard)
+        {
+          const auto shardBufferBegin = m_buffer.begin + shard * shardBufferSize;
+          SetupBuffers(mergeTasks[shard], BytesChunk(shardBufferBegin, shardBufferBegin + shardBufferSize));
+        }
+
+        std::vector<std::exception_ptr> errors(shardsCount);
+        std::vector<std::thread> threads;
+        const auto metricsPhase = Utils::Metrics::GetPhase();
+        for (std::size_t shard = 0; shard != shardsCount; ++shard)
+        {
+          threads.emplace_back([this, &mergeTasks, &errors, &metricsPhase, shard]()
+          {
+            try
+            {
+              Utils::Metrics::ScopedPhase phase(metricsPhase);
+              Utils::Log::ScopedInfoLog mergeTaskScope("Merge task : ('" + mergeTasks[shard].name + "')");
+              Merge(mergeTasks[shard]);
+            }
+            catch (...)
+            {
+              errors[shard] = std::current_exception();
+            }
+          });
+        }
+        for (auto& thread : threads)
+        {
+          thread.join();
+        }
+        for (const auto& error : errors)
+        {
+          if (error)
+          {
+            std::rethrow_exception(error);
+          }
+        }
+
+        if (m_removeTempFiles)
+        {
+          for (const auto& filePath : sortedFilePaths)
+          {
+            Utils::Fs::RemoveFile(filePath);
+          }
+        }
+
+        LOG_I("DONE: 100 %%");
+        LOG_I("Merge time = %s", FormatDuration(std::chrono::system_clock::now() - startTime).c_str());
+      }
+
     private:
-      static decltype(auto) CreateProgress(const MergeTask& mergeTask)
+      // Chunks of the sorted files are found by their offsets, which is not the case for varint prefixed ones.
+      bool IsSearchable() const
       {
-        const auto totalFilesSize = std::accumulate(mergeTask.readParams.begin(), mergeTask.readParams.end(), std::size_t(0), [](auto summ, const auto& rp)
+        return m_options.format.type != ChunksFormat::Type::VARINT_PREFIXED;
+      }
+
+      // Records of the sorted files chunks, the aggregated values are stripped as by the merge.
+      std::vector<Record> ParseFileRecords(std::vector<std::string>& chunks) const
+      {
+        auto chunksEnumerator = CreateStringsChunksEnumerator(chunks);
+        if (m_options.aggregation.type != Aggregation::Type::NONE)
         {
-          return summ + static_cast<std::size_t>(Utils::Fs::GetSize(rp.filePath));
-        });
+          chunksEnumerator = CreateAggregatedChunksEnumerator(std::move(chunksEnumerator), m_options.key.fieldsDelim);
+        }
+        const auto enumerator = Records::CreateEnumerator(std::move(chunksEnumerator), m_options.key);
+        std::vector<Record> records;
+        Record record;
+        while (enumerator->Next(record))
+        {
+          records.push_back(record);
+        }
+        return records;
+      }
+
+      // Offset of the first chunk of the sorted file which is not less than the key, or the file size if there is none.
+      // It is a binary search by the offsets, a probe reads a single chunk.
+      Utils::Fs::Size FindLowerBound(FILE* file, Utils::Fs::Size fileSize, const Record& key) const
+      {
+        const Utils::Fs::FileRange range{ 0, fileSize };
+        std::vector<std::string> chunk(1);
+        // The chunks before the low offset are less than the key, the ones from the high offset are not.
+        Utils::Fs::Size low = 0;
+        Utils::Fs::Size high = fileSize;
+        while (low < high)
+        {
+          auto offset = FindChunkBegin(file, range, low + (high - low) / 2, m_options.format);
+          if (offset >= high)
+          {
+            // The chunk at the middle begins before the low offset, so the low chunk is the next one to check.
+            offset = low;
+          }
+          const auto nextOffset = ReadChunk(file, offset, fileSize, m_options.format, chunk.front());
+          if (m_less(ParseFileRecords(chunk).front(), key))
+          {
+            low = nextOffset;
+          }
+          else
+          {
+            high = offset;
+          }
+        }
+        return high;
+      }
+
+      // The shards get equal parts of the sorted files in bytes. The given splitters are the candidates
+      // along with chunks sampled from the files at even offsets, so the chunks of a sorted file which
+      // were not sampled by the sorter (like the one to append to) get into the splitters too.
+      std::vector<std::string> BalanceSplitters(const std::vector<std::string>& sortedFilePaths, const std::vector<std::string>& splitters) const
+      {
+        if (!IsSearchable() || splitters.empty())
+        {
+          return splitters;
+        }
+
+        Utils::Log::ScopedInfoLog balanceScope("MultiFilesPerPhaseMerger::BalanceSplitters");
+        Utils::Metrics::ScopedDuration balanceDuration("balance_us");
+
+        std::vector<Utils::Fs::FileUniquePtr> files;
+        std::vector<Utils::Fs::Size> filesSizes;
+        Utils::Fs::Size totalSize = 0;
+        for (const auto& filePath : sortedFilePaths)
+        {
+          files.push_back(Utils::Fs::OpenFile(filePath, "rb"));
+          filesSizes.push_back(Utils::Fs::GetSize(filePath));
+          totalSize += filesSizes.back();
+        }
 
-        return [totalFilesSize, processedBytes = std::size_t(0), percents = -1](std::size_t bytes, bool done) mutable
+        std::vector<std::string> samples;
+        const auto samplesCount = static_cast<Utils::Fs::Size>(SAMPLES_PER_SHARD * m_options.shards);
+        for (std::size_t i = 0; i != files.size() && totalSize != 0; ++i)
         {
-          if (totalFilesSize)
+          const auto fileSamples = samplesCount * filesSizes[i] / totalSize;
+          for (Utils::Fs::Size sample = 0; sample < fileSamples; ++sample)
           {
-            processedBytes += bytes;
-            const auto newPercents = done ? 100 : static_cast<int>(100.0 * processedBytes / totalFilesSize);
-            if (newPercents != percents || percents < 0)
+            const Utils::Fs::FileRange range{ 0, filesSizes[i] };
+            const auto offset = FindChunkBegin(files[i].get(), range, (2 * sample + 1) * filesSizes[i] / (2 * fileSamples), m_options.format);
+            if (offset != filesSizes[i])
             {
-              if (percents < 0 || newPercents / 10 != percents / 10)
-              {
-                percents = newPercents;
-                LOG_I("merge progress: %d %%", percents);
-              }
+              samples.emplace_back();
+              ReadChunk(files[i].get(), offset, filesSizes[i], m_options.format, samples.back());
             }
           }
+        }
+
+        std::vector<std::string> splittersData(splitters);
+        auto candidates = ParseFileRecords(samples);
+        {
+          auto enumerator = Records::CreateEnumerator(CreateStringsChunksEnumerator(splittersData), m_options.key);
+          Record record;
+          while (enumerator->Next(record))
+          {
+            candidates.push_back(record);
+          }
+        }
+        std::sort(candidates.begin(), candidates.end(), m_less);
+
+        // The part of the files before a candidate is the sum of its lower bounds in them, it is not less for the next candidates.
+        std::vector<Utils::Fs::Size> candidatesParts(candidates.size(), (std::numeric_limits<Utils::Fs::Size>::max)());
+        const auto getPart = [&](std::size_t candidate)
+        {
+          if (candidatesParts[candidate] == (std::numeric_limits<Utils::Fs::Size>::max)())
+          {
+            candidatesParts[candidate] = 0;
+            for (std::size_t i = 0; i != files.size(); ++i)
+            {
+              candidatesParts[candidate] += FindLowerBound(files[i].get(), filesSizes[i], candidates[candidate]);
+            }
+          }
+          return candidatesParts[candidate];
         };
+
+        std::vector<std::string> result;
+        for (std::size_t shard = 1; shard < m_options.shards; ++shard)
+        {
+          const auto shards = static_cast<Utils::Fs::Size>(m_options.shards);
+          const auto target = totalSize / shards * static_cast<Utils::Fs::Size>(shard) + totalSize % shards * static_cast<Utils::Fs::Size>(shard) / shards;
+          // The first candidate which part is not less than the target, or the previous one if it is closer.
+          std::size_t low = 0;
+          std::size_t high = candidates.size();
+          while (low < high)
+          {
+            const auto middle = low + (high - low) / 2;
+            if (getPart(middle) < target)
+            {
+              low = middle + 1;
+            }
+            else
+            {
+              high = middle;
+            }
+          }
+          if (low == candidates.size() || (low != 0 && target - getPart(low - 1) < getPart(low) - target))
+          {
+            --low;
+          }
+          const auto& chunk = GetChunk(candidates[low]);
+          result.emplace_back(chunk.begin, chunk.end);
+        }
+        return result;
       }
 
-      void Merge(const MergeTask& mergeTask) const
+      // Finds the ranges of the shards in a sorted file by the keys of its chunks.
+      std::vector<Utils::Fs::FileRange> GetShardRanges(const std::string& filePath, const std::vector<Record>& splitters) const
       {
-        ERR_THROW_IF(Utils::Fs::IsExists(mergeTask.resultFilePath), "Fs entry is already exists (path = '" + mergeTask.resultFilePath + "'.)");
+        const auto fileSize = Utils::Fs::GetSize(filePath);
+        if (IsSearchable())
+        {
+          const auto file = Utils::Fs::OpenFile(filePath, "rb");
+          std::vector<Utils::Fs::FileRange> ranges;
+          Utils::Fs::Size rangeBegin = 0;
+          for (const auto& splitter : splitters)
+          {
+            const auto rangeEnd = FindLowerBound(file.get(), fileSize, splitter);
+            ranges.push_back(Utils::Fs::FileRange{ rangeBegin, rangeEnd });
+            rangeBegin = rangeEnd;
+          }
+          ranges.push_back(Utils::Fs::FileRange{ rangeBegin, fileSize });
+          return ranges;
+        }
+
+        CharsChunk readBuffer;
+        readBuffer.begin = Utils::GetAligned((CharsChunk::ObjType*)m_buffer.begin);
+        readBuffer.end = Utils::GetAligned((CharsChunk::ObjType*)m_buffer.end);
+        AdjustEnd(readBuffer, m_buffer.end);
+
+        Utils::Fs::Size chunkOffset = 0;
+        auto chunks = CreateOffsetsChunksEnumerator(
+          CreateFileChunksEnumerator(filePath, readBuffer, m_options.format),
+          m_options.format,
+          chunkOffset);
+        if (m_options.aggregation.type != Aggregation::Type::NONE)
+        {
+          chunks = CreateAggregatedChunksEnumerator(std::move(chunks), m_options.key.fieldsDelim);
+        }
+        const auto records = Records::CreateEnumerator(std::move(chunks), m_options.key);
+
+        std::vector<Utils::Fs::FileRange> ranges;
+        Utils::Fs::Size rangeBegin = 0;
+        Utils::Fs::Size recordBegin = chunkOffset;
+        Record record;
+        while (ranges.size() != splitters.size() && records->Next(record))
+        {
+          while (ranges.size() != splitters.size() && !m_less(record, splitters[ranges.size()]))
+          {
+            ranges.push_back(Utils::Fs::FileRange{ rangeBegin, recordBegin });
+            rangeBegin = recordBegin;
+          }
+          recordBegin = chunkOffset;
+        }
 
-        const auto resultFile = Utils::Fs::OpenFile(mergeTask.resultFilePath, "wb");
-        FILE* rawResultFile = resultFile.get();
-        if (const auto writeBufferSize = mergeTask.writeBuffer.BytesCount())
+        while (ranges.size() != splitters.size() + 1)
         {
-          const auto disableBufferResult = setvbuf(rawResultFile, (char*) mergeTask.writeBuffer.begin, _IOFBF, writeBufferSize);
-          ERR_THROW_IF(disableBufferResult != 0, "Failed to disable buffering (error = " + std::to_string(disableBufferResult) + ").");
+          ranges.push_back(Utils::Fs::FileRange{ rangeBegin, fileSize });
+          rangeBegin = fileSize;
         }
+        return ranges;
+      }
 
-        constexpr auto writeTie = CharsChunk::SizeOfObject();
-        const auto writeChunk = [rawResultFile, writeTie] (CharsChunk chunk)
+      // The percents are computed when the processed bytes reach the next 10 percents only,
+      // so the progress of a merged chunk is an addition and a comparison.
+      static decltype(auto) CreateProgress(const MergeTask& mergeTask)
+      {
+        const auto totalFilesSize = std::accumulate(mergeTask.readParams.begin(), mergeTask.readParams.end(), std::size_t(0), [](auto summ, const auto& rp)
         {
-          const auto writeRes = fwrite(chunk.begin, chunk.BytesCount() + writeTie, 1, rawResultFile);
-          if (writeRes != 1)
+          return summ + static_cast<std::size_t>(rp.GetRange().GetSize());
+        });
+        const auto enabled = totalFilesSize != 0 && Utils::Log::IsEnabled(Utils::Log::LOG_LEVEL_INFO);
+
+        return [enabled, totalFilesSize, processedBytes = std::size_t(0), nextBytes = std::size_t(0), percents = -1](std::size_t bytes, bool done) mutable
+        {
+          if (!enabled)
+          {
+            return;
+          }
+          processedBytes += bytes;
+          if (processedBytes < nextBytes && !done)
+          {
+            return;
+          }
+          const auto newPercents = done ? 100 : static_cast<int>(100.0 * processedBytes / totalFilesSize);
+          if (percents < 0 || newPercents / 10 != percents / 10)
           {
-            const auto err = ferror(rawResultFile);
-            ERR_THROW("Failed to write chunk to file (error = " + std::to_string(err) + ").");
+            percents = newPercents;
+            LOG_I("merge progress: %d %%", percents);
           }
+          const auto nextTens = static_cast<std::size_t>(newPercents / 10 + 1);
+          nextBytes = (totalFilesSize * nextTens + 9) / 10;
         };
+      }
+
+      void Merge(const MergeTask& mergeTask) const
+      {
+        Utils::Metrics::ScopedDuration taskDuration("task_us");
+        Utils::Metrics::Add("tasks", 1);
+        Utils::Metrics::SetMax("fan_in", mergeTask.readParams.size());
+
+        auto resultWriter = CreateFileChunksWriter(mergeTask.resultFilePath, mergeTask.writeBuffer, m_options.format);
+        if (!mergeTask.indexFilePath.empty())
+        {
+          resultWriter = CreateSparseIndexWriter(std::move(resultWriter), mergeTask.indexFilePath, mergeTask.indexWriteBuffer, m_options.format, m_options.indexStep);
+        }
 
+        const auto aggregate = m_options.aggregation.type != Aggregation::Type::NONE;
 
-        using EnumeratorPtr = std::unique_ptr<CharsChunksEnumerator>;
-        std::vector<EnumeratorPtr> enumerators;
-        std::multimap<CharsChunk, CharsChunksEnumerator*> mergeItems;
+        // The sources are in the order of the read params, which keep the order of the source data.
+        std::vector<std::unique_ptr<RecordsEnumerator>> sources;
         for (const auto& rp : mergeTask.readParams)
         {
-          auto enumerator = CreateFileChunksEnumerator(rp.filePath, rp.readBuffer, m_chunksDelim);
-          CharsChunk chunk;
-          if (enumerator->Next(chunk))
+          auto chunks = CreateFileChunksEnumerator(rp.filePath, rp.readBuffer, m_options.format, rp.GetRange());
+          if (aggregate)
           {
-            auto enumeratorPtr = enumerator.get();
-            enumerators.push_back(std::move(enumerator));
-            mergeItems.emplace(chunk, enumeratorPtr);
+            chunks = CreateAggregatedChunksEnumerator(std::move(chunks), m_options.key.fieldsDelim);
           }
+          sources.push_back(Records::CreateEnumerator(std::move(chunks), m_options.key));
         }
+        const auto mergedRecords = CreateMergedRecordsEnumerator<Records>(std::move(sources), m_less, m_options.stable);
 
         auto progress = CreateProgress(mergeTask);
         progress(0, false);
 
-        while(!mergeItems.empty())
+        if (aggregate)
+        {
+          MergeAggregated(*mergedRecords, *resultWriter, progress);
+        }
+        else
         {
-          std::pair<CharsChunk, CharsChunksEnumerator*> tmp = *mergeItems.begin();
+          MergeRecords(*mergedRecords, *resultWriter, progress);
+        }
+
+        progress(0, true);
 
-          writeChunk(tmp.first);
-          progress(tmp.first.BytesCount(), false);
+        resultWriter->Flush();
+      }
 
-          mergeItems.erase(mergeItems.begin());
-          if (tmp.second->Next(tmp.first))
+      template <typename Progress>
+      void MergeRecords(RecordsEnumerator& mergedRecords, CharsChunksWriter& resultWriter, Progress& progress) const
+      {
+        // Every merge task may stop after m_limit chunks: the first m_limit chunks
+        // of the result are among the first m_limit chunks of any files subset.
+        const auto unique = m_options.unique;
+        auto chunksLeft = m_options.limit != 0 ? m_options.limit : std::numeric_limits<std::size_t>::max();
+        // The last written chunk may be overwritten by the next read of its file, so it is copied.
+        RecordCopy<Record> lastChunk;
+        std::size_t writtenChunks = 0;
+        Record record;
+        while (chunksLeft != 0 && mergedRecords.Next(record))
+        {
+          if (!unique || lastChunk.IsEmpty() || m_less(lastChunk.Get(), record))
           {
-            mergeItems.insert(std::move(tmp));
+            resultWriter.Write(GetChunk(record));
+            --chunksLeft;
+            ++writtenChunks;
+            if (unique)
+            {
+              lastChunk.Assign(record);
+            }
           }
+          progress(GetChunk(record).BytesCount(), false);
         }
+        Utils::Metrics::Add("lines", writtenChunks);
+      }
 
-        progress(0, true);
+      // The limit is applied to groups: a group is written only when all its chunks are merged.
+      template <typename Progress>
+      void MergeAggregated(RecordsEnumerator& mergedRecords, CharsChunksWriter& resultWriter, Progress& progress) const
+      {
+        const auto fieldsDelim = m_options.key.fieldsDelim;
+        const auto chunksDelim = m_options.format.delim;
+        auto groupsLeft = m_options.limit != 0 ? m_options.limit : std::numeric_limits<std::size_t>::max();
+        // The first chunk of a group may be overwritten by the next read of its file, so it is copied.
+        RecordCopy<Record> group;
+        bool hasGroup = false;
+        AggregatedValue groupValue;
+        std::string aggregated;
+        std::size_t writtenGroups = 0;
+
+        const auto writeGroup = [&]()
+        {
+          FormatAggregatedChunk(GetChunk(group.Get()), groupValue, fieldsDelim, chunksDelim, aggregated);
+          resultWriter.Write(CharsChunk(&aggregated[0], &aggregated[0] + aggregated.size() - 1));
+          ++writtenGroups;
+          --groupsLeft;
+          hasGroup = false;
+        };
 
-        if (fflush(rawResultFile) != 0)
+        Record record;
+        while (groupsLeft != 0 && mergedRecords.Next(record))
         {
-          const int err = ferror(rawResultFile);
-          ERR_THROW("Failed to flush file (err = " + std::to_string(err) + ").");
+          if (hasGroup && m_less(group.Get(), record))
+          {
+            writeGroup();
+          }
+          if (!hasGroup)
+          {
+            group.Assign(record);
+            groupValue = AggregatedValue();
+            hasGroup = true;
+          }
+          groupValue += GetAggregatedValue(GetChunk(record), chunksDelim);
+          progress(GetChunk(record).BytesCount(), false);
         }
+
+        if (hasGroup && groupsLeft != 0)
+        {
+          writeGroup();
+        }
+        Utils::Metrics::Add("lines", writtenGroups);
       }
 
       std::vector<MergeTask> GetMergeTasks(
         unsigned phase,
-        const std::set<std::string>& sortedFilePaths,
+        const std::vector<std::string>& sortedFilePaths,
         const std::string& resultFilePath) const
       {
         const auto sortedFilesCount = sortedFilePaths.size();
-        ERR_THROW_IF(sortedFilesCount < 2, "Invalid argument (sortedFilesCount < 2).");
-        ERR_THROW_IF(m_maxFilesPerPhase < 2, "Invalid state (maxFilesPerPhase < 2).");
+        ERR_THROW_IF(sortedFilesCount == 0, "Invalid argument (sortedFilesCount = 0).");
 
         if (sortedFilesCount <= m_maxFilesPerPhase)
         {
           MergeTask mergeTask;
           mergeTask.name = std::to_string(phase) + "." + std::to_string(0);
+          mergeTask.phase = phase;
           mergeTask.resultFilePath = resultFilePath;
+          mergeTask.indexFilePath = GetResultIndexFilePath(resultFilePath);
           mergeTask.readParams.reserve(sortedFilesCount);
           for (const auto& filePath : sortedFilePaths)
           {
@@ -229,16 +647,19 @@ namespace ExtSort
           return{ mergeTask };
         }
 
+        ERR_THROW_IF(m_maxFilesPerPhase < 2, "Invalid state (maxFilesPerPhase < 2).");
+
         std::vector<MergeTask> mergeTasks;
-        std::set<std::string> thisPhaseFilePaths;
+        std::vector<std::string> thisPhaseFilePaths;
         auto sortedFilePathIter = sortedFilePaths.begin();
         const std::size_t tasksCount = sortedFilesCount / m_maxFilesPerPhase + ((sortedFilesCount % m_maxFilesPerPhase) ? 1 : 0);
         for (std::size_t i = 0; i != tasksCount; ++i)
         {
           MergeTask mergeTask;
           mergeTask.name = std::to_string(phase) + "." + std::to_string(i);
+          mergeTask.phase = phase;
           ERR_THROW_IF_NOT(m_tempFilePaths->Next(mergeTask.resultFilePath), "Cannot get temp file path.");
-          thisPhaseFilePaths.insert(mergeTask.resultFilePath);
+          thisPhaseFilePaths.push_back(mergeTask.resultFilePath);
           mergeTask.readParams.reserve(sortedFilesCount);
           for (std::size_t j = 0, end = sortedFilesCount / tasksCount; j != end; ++j)
           {
@@ -263,12 +684,21 @@ namespace ExtSort
 
         const std::vector<MergeTask> nextPhaseTasks = GetMergeTasks(phase + 1, thisPhaseFilePaths, resultFilePath);
         mergeTasks.insert(mergeTasks.end(), nextPhaseTasks.begin(), nextPhaseTasks.end());
-        return std::move(mergeTasks);
+        return mergeTasks;
+      }
+
+      std::string GetResultIndexFilePath(const std::string& resultFilePath) const
+      {
+        return m_options.indexStep != 0 ? GetSparseIndexFilePath(resultFilePath) : std::string();
       }
 
       void SetupBuffers(MergeTask& mergeTask) const
       {
-        const BytesChunk buffer = m_buffer;
+        SetupBuffers(mergeTask, m_buffer);
+      }
+
+      void SetupBuffers(MergeTask& mergeTask, const BytesChunk& buffer) const
+      {
         const auto byfferSize = buffer.BytesCount();
 
         const auto maxAcceptableWriteBufferSize = byfferSize / (mergeTask.readParams.size() + 1);
@@ -277,6 +707,14 @@ namespace ExtSort
         mergeTask.writeBuffer.end = (BytesChunk::ObjType*)(buffer.begin + writeBufferSize);
         CheckChunk(mergeTask.writeBuffer, buffer.end);
 
+        // The index takes a few chunks per step, so an eighth of the write buffer is enough for it.
+        if (!mergeTask.indexFilePath.empty())
+        {
+          mergeTask.indexWriteBuffer.begin = mergeTask.writeBuffer.begin;
+          mergeTask.indexWriteBuffer.end = mergeTask.writeBuffer.begin + writeBufferSize / 8;
+          mergeTask.writeBuffer.begin = mergeTask.indexWriteBuffer.end;
+        }
+
         CharsChunk readBuffer;
         readBuffer.begin = Utils::GetAligned((CharsChunk::ObjType*)(mergeTask.writeBuffer.end));
         readBuffer.end = Utils::GetAligned((CharsChunk::ObjType*)buffer.end);
@@ -315,15 +753,19 @@ namespace ExtSort
     const BytesChunk& buffer,
     std::size_t maxFilesPerPhase,
     std::size_t maxWriteBufferSize,
-    CharsChunk::ObjType chunksDelim,
-    bool removeTempFiles)
+    bool removeTempFiles,
+    const SortOptions& options)
   {
-    return std::make_unique<MultiFilesPerPhaseMerger>(
-      std::move(tempFilePaths),
-      buffer,
-      maxFilesPerPhase,
-      maxWriteBufferSize,
-      chunksDelim,
-      removeTempFiles);
+    return DispatchRecords(options.key, [&](auto records) -> std::unique_ptr<Merger>
+    {
+      using Records = decltype(records);
+      return std::make_unique<MultiFilesPerPhaseMerger<Records>>(
+        std::move(tempFilePaths),
+        buffer,
+        maxFilesPerPhase,
+        maxWriteBufferSize,
+        removeTempFiles,
+        options);
+    });
   }
 }
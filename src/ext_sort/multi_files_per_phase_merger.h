@@ -2,6 +2,7 @@
 #define __EXT_SORT_MULTI_FILES_MERGER_H__
 
 #include <ext_sort/merger.h>
+#include <ext_sort/sort_options.h>
 #include <ext_sort/types.h>
 
 #include <utils/fs/fs.h>
@@ -15,8 +16,8 @@ namespace ExtSort
     const BytesChunk& buffer,
     std::size_t maxFilesPerPhase,
     std::size_t maxWriteBufferSize,
-    CharsChunk::ObjType chunksDelim,
-    bool removeTempFiles);
+    bool removeTempFiles,
+    const SortOptions& options);
 }
 
 #endif
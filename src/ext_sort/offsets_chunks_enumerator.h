@@ -0,0 +1,58 @@
+﻿#ifndef __EXT_SORT_OFFSETS_CHUNKS_ENUMERATOR_H__
+#define __EXT_SORT_OFFSETS_CHUNKS_ENUMERATOR_H__
+
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/types.h>
+
+#include <utils/err.h>
+#include <utils/fs/fs.h>
+
+#include <memory>
+
+namespace ExtSort
+{
+  // Keeps the offset of the end of the last enumerated chunk in the file.
+  class OffsetsChunksEnumerator : public CharsChunksEnumerator
+  {
+    std::unique_ptr<CharsChunksEnumerator> m_chunks;
+    const ChunksFormat m_format;
+    Utils::Fs::Size& m_offset;
+
+  public:
+    OffsetsChunksEnumerator(std::unique_ptr<CharsChunksEnumerator> chunks, const ChunksFormat& format, Utils::Fs::Size& offset)
+      : m_chunks(std::move(chunks))
+      , m_format(format)
+      , m_offset(offset)
+    {
+      ERR_THROW_IF_NOT(m_chunks, "Invalid argument (chunks enumerator is null).");
+    }
+
+    virtual void SetObserver(EventsObserver observer) override
+    {
+      m_chunks->SetObserver(observer);
+    }
+
+    virtual bool Next(CharsChunk& chunk) override
+    {
+      if (!m_chunks->Next(chunk))
+      {
+        return false;
+      }
+      m_offset += GetEncodedSize(chunk, m_format);
+      return true;
+    }
+
+    OffsetsChunksEnumerator(const OffsetsChunksEnumerator&) = delete;
+    OffsetsChunksEnumerator& operator = (const OffsetsChunksEnumerator&) = delete;
+  };
+
+  inline std::unique_ptr<CharsChunksEnumerator> CreateOffsetsChunksEnumerator(
+    std::unique_ptr<CharsChunksEnumerator> chunks,
+    const ChunksFormat& format,
+    Utils::Fs::Size& offset)
+  {
+    return std::make_unique<OffsetsChunksEnumerator>(std::move(chunks), format, offset);
+  }
+}
+
+#endif
@@ -0,0 +1,135 @@
+﻿#ifndef __EXT_SORT_RECORDS_H__
+#define __EXT_SORT_RECORDS_H__
+
+#include <ext_sort/keyed_chunks_enumerator.h>
+#include <ext_sort/keys.h>
+#include <ext_sort/types.h>
+
+#include <utils/err.h>
+
+#include <memory>
+#include <string>
+
+namespace ExtSort
+{
+  // Records are what the sorter and the merger compare: whole chunks or chunks with parsed keys.
+  // The records type is chosen once by DispatchRecords, so the sort and merge loops are
+  // instantiated per comparator instead of switching on the key type for every comparison.
+  struct LineRecords
+  {
+    using Record = CharsChunk;
+    using Less = ChunkLess;
+    using RecordsEnumerator = Utils::Enumerator<Record>;
+
+    static std::unique_ptr<RecordsEnumerator> CreateEnumerator(
+      std::unique_ptr<CharsChunksEnumerator> chunks,
+      const KeySpec&)
+    {
+      return chunks;
+    }
+  };
+
+  template <std::size_t N>
+  struct FieldsKeyRecords
+  {
+    using Record = KeyedChunk<FieldsKey<N>>;
+    using Less = FieldsKeyLess<N>;
+    using RecordsEnumerator = Utils::Enumerator<Record>;
+
+    static std::unique_ptr<RecordsEnumerator> CreateEnumerator(
+      std::unique_ptr<CharsChunksEnumerator> chunks,
+      const KeySpec& keySpec)
+    {
+      return CreateKeyedChunksEnumerator(std::move(chunks), FieldsKeyParser<N>(keySpec));
+    }
+  };
+
+  struct BytesRangeKeyRecords
+  {
+    using Record = KeyedChunk<BytesRangeKeyParser::Key>;
+    using Less = FieldsKeyLess<1>;
+    using RecordsEnumerator = Utils::Enumerator<Record>;
+
+    static std::unique_ptr<RecordsEnumerator> CreateEnumerator(
+      std::unique_ptr<CharsChunksEnumerator> chunks,
+      const KeySpec& keySpec)
+    {
+      return CreateKeyedChunksEnumerator(std::move(chunks), BytesRangeKeyParser(keySpec));
+    }
+  };
+
+  template <NormalisedKey (*Normalise)(const CharsChunk&)>
+  struct NormalisedKeyRecords
+  {
+    using Record = KeyedChunk<NormalisedKey>;
+    using Less = NormalisedKeyLess;
+    using RecordsEnumerator = Utils::Enumerator<Record>;
+
+    static std::unique_ptr<RecordsEnumerator> CreateEnumerator(
+      std::unique_ptr<CharsChunksEnumerator> chunks,
+      const KeySpec& keySpec)
+    {
+      return CreateKeyedChunksEnumerator(std::move(chunks), NormalisedKeyParser<Normalise>(keySpec));
+    }
+  };
+
+  template <typename Records>
+  struct ReversedRecords : public Records
+  {
+    using Less = ReversedLess<typename Records::Less>;
+  };
+
+  namespace Private
+  {
+    template <typename Func>
+    auto DispatchStringRecords(const KeySpec& keySpec, Func&& func)
+    {
+      const auto fieldsCount = keySpec.fields.size();
+      ERR_THROW_IF(fieldsCount > MAX_KEY_FIELDS, "Too many key fields (count = " + std::to_string(fieldsCount) + ", max = " + std::to_string(MAX_KEY_FIELDS) + ").");
+      static_assert(MAX_KEY_FIELDS == 4, "DispatchStringRecords should be updated.");
+      switch (fieldsCount)
+      {
+        case 0  : return func(LineRecords());
+        case 1  : return func(FieldsKeyRecords<1>());
+        case 2  : return func(FieldsKeyRecords<2>());
+        case 3  : return func(FieldsKeyRecords<3>());
+        default : return func(FieldsKeyRecords<4>());
+      }
+    }
+
+    template <typename Func>
+    auto DispatchKeyType(const KeySpec& keySpec, Func&& func)
+    {
+      ERR_THROW_IF(keySpec.type != KeyType::STRING && keySpec.fields.size() > 1, "Typed keys support a single key field.");
+      if (keySpec.rangeSize != 0)
+      {
+        ERR_THROW_IF(!keySpec.fields.empty(), "A bytes range key cannot be combined with key fields.");
+        ERR_THROW_IF(keySpec.type != KeyType::STRING, "A bytes range key is compared as a string.");
+        return func(BytesRangeKeyRecords());
+      }
+      switch (keySpec.type)
+      {
+        case KeyType::INTEGER : return func(NormalisedKeyRecords<&NormaliseInteger>());
+        case KeyType::FLOAT   : return func(NormalisedKeyRecords<&NormaliseFloat>());
+        case KeyType::HEX     : return func(NormalisedKeyRecords<&NormaliseHex>());
+        case KeyType::VERSION : return func(NormalisedKeyRecords<&NormaliseVersion>());
+        default               : return DispatchStringRecords(keySpec, func);
+      }
+    }
+  }
+
+  template <typename Func>
+  auto DispatchRecords(const KeySpec& keySpec, Func&& func)
+  {
+    if (keySpec.reverse)
+    {
+      return Private::DispatchKeyType(keySpec, [&func](auto records)
+      {
+        return func(ReversedRecords<decltype(records)>());
+      });
+    }
+    return Private::DispatchKeyType(keySpec, func);
+  }
+}
+
+#endif
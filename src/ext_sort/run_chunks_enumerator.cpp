@@ -0,0 +1,188 @@
+﻿#include <ext_sort/run_chunks_enumerator.h>
+#include <ext_sort/ext_sort_utils.h>
+#include <ext_sort/file_chunks_enumerator.h>
+
+#include <utils/empty_enumerator.h>
+#include <utils/err.h>
+#include <utils/metrics.h>
+#include <utils/trace.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace ExtSort
+{
+  namespace
+  {
+    class RunChunksEnumerator : public CharsChunksEnumerator
+    {
+      using Char = CharsChunk::ObjType;
+      using EventsObserver = CharsChunksEnumerator::EventsObserver;
+
+      const ChunksFormat m_format;
+      const std::size_t m_chunkOverhead;
+      const std::function<Char* ()> m_getLimit;
+      const std::size_t m_minReadSize;
+      const std::size_t m_maxReadSize;
+      Char* const m_begin;
+      Char* m_cursor;
+      Char* m_end;
+      Utils::Fs::Size m_bytesLeft;
+      std::size_t m_parsedSize;
+      std::size_t m_parsedChunks;
+      EventsObserver m_observer;
+      Utils::Fs::FileUniquePtr m_file;
+
+    public:
+      RunChunksEnumerator(const std::string& sourceFilePath,
+                          const Utils::Fs::FileRange& range,
+                          const ChunksFormat& format,
+                          const CharsChunk& buffer,
+                          std::size_t chunkOverhead,
+                          std::function<Char* ()> getLimit)
+        : m_format(format)
+        , m_chunkOverhead(chunkOverhead)
+        , m_getLimit(std::move(getLimit))
+        // Short reads are not worth a syscall while a run can be flushed instead,
+        // long ones move much data back if their chunks are shorter than estimated.
+        , m_minReadSize(buffer.ObjectsCount() / 64)
+        , m_maxReadSize(buffer.ObjectsCount() / 8)
+        , m_begin(buffer.begin)
+        , m_cursor(buffer.begin)
+        , m_end(buffer.begin)
+        , m_bytesLeft(range.GetSize())
+        , m_parsedSize(0)
+        , m_parsedChunks(0)
+      {
+        CheckChunk(buffer);
+
+        ERR_THROW_IF(!m_getLimit, "Invalid argument (limit getter is null).");
+        ERR_THROW_IF(m_maxReadSize == 0, "Invalid argument (buffer capacity is too small).");
+
+        m_file = Utils::Fs::OpenFile(sourceFilePath, "rb");
+        const auto disableBufferResult = setvbuf(m_file.get(), nullptr, _IONBF, 0);
+        ERR_THROW_IF(disableBufferResult != 0, "Failed to disable buffering (error = " + std::to_string(disableBufferResult) + ").");
+        if (range.begin != 0)
+        {
+          Utils::Fs::SeekFile(m_file.get(), range.begin);
+        }
+      }
+
+      virtual void SetObserver(EventsObserver observer) override
+      {
+        m_observer = observer;
+      }
+
+      virtual bool Next(CharsChunk& chunk) override
+      {
+        // The chunks of the last read are shorter than estimated, so the next one has no space for its overhead.
+        if (m_getLimit() < m_end)
+        {
+          ReleaseBuffer();
+        }
+
+        while (true)
+        {
+          if (auto* const next = ParseChunk(m_cursor, m_end, m_format, chunk))
+          {
+            m_parsedSize += static_cast<std::size_t>(next - m_cursor);
+            ++m_parsedChunks;
+            m_cursor = next;
+            return true;
+          }
+          if (m_bytesLeft == 0)
+          {
+            ERR_THROW_IF(m_cursor != m_end, "Unexpected end of file. A whole chunk is expected.");
+            return false;
+          }
+          ReadBuffer();
+        }
+      }
+
+    private:
+      // The space below the limit is shared by the data and the overheads of its chunks in proportion to the average chunk size.
+      std::size_t GetReadSize() const
+      {
+        const auto* const limit = m_getLimit();
+        if (limit <= m_end)
+        {
+          return 0;
+        }
+        const auto freeSize = static_cast<std::size_t>(limit - m_end);
+        const auto averageSize = m_parsedChunks != 0 ? static_cast<double>(m_parsedSize) / m_parsedChunks : static_cast<double>(m_chunkOverhead);
+        const auto readSize = static_cast<std::size_t>(freeSize * averageSize / (averageSize + m_chunkOverhead));
+        return (std::min)(readSize, m_maxReadSize);
+      }
+
+      // The observer is done with the chunks, so the unparsed data is moved to the buffer begin.
+      void ReleaseBuffer()
+      {
+        if (m_observer)
+        {
+          m_observer(FileChunksEnumeratorEvents::BEFORE_READ_BUFFER);
+        }
+
+        const auto tailSize = static_cast<std::size_t>(m_end - m_cursor);
+        if (m_cursor != m_begin)
+        {
+          std::memmove(m_begin, m_cursor, tailSize);
+        }
+        m_cursor = m_begin;
+        m_end = m_begin + tailSize;
+      }
+
+      void ReadBuffer()
+      {
+        auto bufferSize = GetReadSize();
+        if (bufferSize < m_minReadSize)
+        {
+          ReleaseBuffer();
+          bufferSize = GetReadSize();
+          ERR_THROW_IF(bufferSize == 0, "Chunk length exceeds the run buffer (length > " + std::to_string(m_end - m_cursor) + ").");
+        }
+        if (static_cast<Utils::Fs::Size>(bufferSize) > m_bytesLeft)
+        {
+          bufferSize = static_cast<std::size_t>(m_bytesLeft);
+        }
+
+        FILE* file = m_file.get();
+        std::size_t read = 0;
+        {
+          Utils::Metrics::ScopedDuration readDuration("read_us");
+          Utils::Trace::ScopedSpan readSpan("read");
+          read = fread(m_end, sizeof(Char), bufferSize, file);
+        }
+        Utils::Metrics::Add("bytes_read", read * sizeof(Char));
+        if (read != bufferSize)
+        {
+          if (const auto ferr = ferror(file))
+          {
+            ERR_THROW("Failed to read file data (error = " + std::to_string(ferr) + ").");
+          }
+          ERR_THROW("Unexpected end of file (bytes left = " + std::to_string(m_bytesLeft) + ").");
+        }
+        m_bytesLeft -= read;
+        m_end += read;
+      }
+
+      RunChunksEnumerator(const RunChunksEnumerator&) = delete;
+      RunChunksEnumerator& operator = (const RunChunksEnumerator&) = delete;
+    };
+  }
+
+  std::unique_ptr<CharsChunksEnumerator> CreateRunChunksEnumerator(
+    const std::string& sourceFilePath,
+    const Utils::Fs::FileRange& range,
+    const ChunksFormat& format,
+    const CharsChunk& buffer,
+    std::size_t chunkOverhead,
+    std::function<CharsChunk::ObjType* ()> getLimit)
+  {
+    if (range.GetSize() == 0)
+    {
+      return std::make_unique<Utils::EmptyEnumerator<CharsChunk>>();
+    }
+
+    return std::make_unique<RunChunksEnumerator>(sourceFilePath, range, format, buffer, chunkOverhead, std::move(getLimit));
+  }
+}
@@ -0,0 +1,28 @@
+﻿#ifndef __EXT_SORT_RUN_CHUNKS_ENUMERATOR_H__
+#define __EXT_SORT_RUN_CHUNKS_ENUMERATOR_H__
+
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/types.h>
+
+#include <utils/fs/fs.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace ExtSort
+{
+  // Enumerates chunks of the range read straight into the run buffer, so a sorter keeps them in place.
+  // Data is appended to the unparsed data below the limit which getLimit returns for the next chunk,
+  // every chunk taking chunkOverhead bytes below the limit too. The buffer begin is only reused after
+  // the FileChunksEnumeratorEvents::BEFORE_READ_BUFFER event, when the unparsed data is moved to it.
+  std::unique_ptr<CharsChunksEnumerator> CreateRunChunksEnumerator(
+    const std::string& sourceFilePath,
+    const Utils::Fs::FileRange& range,
+    const ChunksFormat& format,
+    const CharsChunk& buffer,
+    std::size_t chunkOverhead,
+    std::function<CharsChunk::ObjType* ()> getLimit);
+}
+
+#endif
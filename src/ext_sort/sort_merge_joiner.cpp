@@ -0,0 +1,297 @@
+﻿#include <ext_sort/sort_merge_joiner.h>
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/ext_sort_utils.h>
+#include <ext_sort/file_chunks_writer.h>
+#include <ext_sort/merged_records_enumerator.h>
+#include <ext_sort/records.h>
+
+#include <utils/align.h>
+#include <utils/err.h>
+#include <utils/fs/fs.h>
+#include <utils/log/log.h>
+#include <utils/varint.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace ExtSort
+{
+  namespace
+  {
+    template <typename Records>
+    class SortMergeJoiner : public Joiner
+    {
+      using Record = typename Records::Record;
+      using Less = typename Records::Less;
+      using RecordsEnumerator = typename Records::RecordsEnumerator;
+
+      const std::unique_ptr<Utils::Fs::FilePathsEnumerator> m_tempFilePaths;
+      const BytesChunk m_buffer;
+      const std::size_t m_maxWriteBufferSize;
+      const bool m_removeTempFiles;
+      const SortOptions m_options;
+      const JoinType m_joinType;
+      const Less m_less;
+
+    public:
+      SortMergeJoiner(std::unique_ptr<Utils::Fs::FilePathsEnumerator> tempFilePaths,
+                      const BytesChunk& buffer,
+                      std::size_t maxWriteBufferSize,
+                      bool removeTempFiles,
+                      const SortOptions& options,
+                      JoinType joinType)
+        : m_tempFilePaths(std::move(tempFilePaths))
+        , m_buffer(buffer)
+        , m_maxWriteBufferSize(maxWriteBufferSize)
+        , m_removeTempFiles(removeTempFiles)
+        , m_options(options)
+        , m_joinType(joinType)
+        , m_less()
+      {
+        ERR_THROW_IF_NOT(m_tempFilePaths, "Invalid argument (file paths is null).");
+        CheckChunk(m_buffer);
+        ERR_THROW_IF(m_options.format.type == ChunksFormat::Type::FIXED_SIZE, "Joined chunks of the fixed size format would not have the fixed size.");
+      }
+
+      virtual void Join(const std::vector<std::string>& leftSortedFilePaths,
+                        const std::vector<std::string>& rightSortedFilePaths,
+                        const std::string& resultFilePath) override
+      {
+        Utils::Log::ScopedInfoLog joinScope("SortMergeJoiner::Join");
+
+        const auto startTime = std::chrono::system_clock::now();
+
+        LOG_I("left files count  = %s", std::to_string(leftSortedFilePaths.size()).c_str());
+        LOG_I("right files count = %s", std::to_string(rightSortedFilePaths.size()).c_str());
+        LOG_I("result file path  = '%s'", resultFilePath.c_str());
+
+        ERR_THROW_IF(resultFilePath.empty(), "Invalid argument (resultFilePath is empty).");
+
+        JoinFiles(leftSortedFilePaths, rightSortedFilePaths, resultFilePath);
+
+        if (m_removeTempFiles)
+        {
+          for (const auto& filePath : leftSortedFilePaths)
+          {
+            Utils::Fs::RemoveFile(filePath);
+          }
+          for (const auto& filePath : rightSortedFilePaths)
+          {
+            Utils::Fs::RemoveFile(filePath);
+          }
+        }
+
+        LOG_I("Join time = %s", FormatDuration(std::chrono::system_clock::now() - startTime).c_str());
+      }
+
+    private:
+      void JoinFiles(const std::vector<std::string>& leftSortedFilePaths,
+                     const std::vector<std::string>& rightSortedFilePaths,
+                     const std::string& resultFilePath) const
+      {
+        // All the files are read in a single pass: the buffer is split between them, the writer and the right group.
+        const auto filesCount = leftSortedFilePaths.size() + rightSortedFilePaths.size();
+        const auto writeBufferSize = (std::min)(m_buffer.BytesCount() / (filesCount + 1), m_maxWriteBufferSize);
+        BytesChunk writeBuffer(m_buffer.begin, m_buffer.begin + writeBufferSize);
+
+        CharsChunk readBuffer;
+        readBuffer.begin = Utils::GetAligned((CharsChunk::ObjType*)writeBuffer.end);
+        readBuffer.end = Utils::GetAligned((CharsChunk::ObjType*)m_buffer.end);
+        AdjustEnd(readBuffer, m_buffer.end);
+        const auto readBufferSize = readBuffer.ObjectsCount() / (filesCount + 1);
+        ERR_THROW_IF(readBufferSize == 0, "Buffer is too small.");
+
+        auto nextReadBuffer = readBuffer.begin;
+        const auto createRecords = [&, this](const std::vector<std::string>& filePaths)
+        {
+          std::vector<std::unique_ptr<RecordsEnumerator>> sources;
+          for (const auto& filePath : filePaths)
+          {
+            const CharsChunk fileReadBuffer(nextReadBuffer, nextReadBuffer + readBufferSize);
+            nextReadBuffer = fileReadBuffer.end;
+            sources.push_back(Records::CreateEnumerator(
+              CreateFileChunksEnumerator(filePath, fileReadBuffer, m_options.format),
+              m_options.key));
+          }
+          return CreateMergedRecordsEnumerator<Records>(std::move(sources), m_less, m_options.stable);
+        };
+        const auto leftRecords = createRecords(leftSortedFilePaths);
+        const auto rightRecords = createRecords(rightSortedFilePaths);
+
+        // Right chunks may be overwritten by the next reads of their files, so a group of equal ones is copied
+        // to the group buffer as it is stored in a file. A group which does not fit is written to a temp file
+        // and the buffer reads it back for every matching left chunk.
+        const CharsChunk groupBuffer(nextReadBuffer, nextReadBuffer + readBufferSize);
+        auto groupEnd = groupBuffer.begin;
+        std::string spillFilePath;
+        Utils::Fs::FileUniquePtr spillFile;
+        std::size_t spilledGroups = 0;
+        const auto spill = [&]()
+        {
+          if (!spillFile)
+          {
+            if (spillFilePath.empty())
+            {
+              ERR_THROW_IF_NOT(m_tempFilePaths->Next(spillFilePath), "Cannot get temp file path.");
+            }
+            spillFile = Utils::Fs::OpenFile(spillFilePath, "wb");
+            // The group buffer is written by one call, so the file needs no stream buffer.
+            const auto disableBufferResult = setvbuf(spillFile.get(), nullptr, _IONBF, 0);
+            ERR_THROW_IF(disableBufferResult != 0, "Failed to disable buffering (error = " + std::to_string(disableBufferResult) + ").");
+            ++spilledGroups;
+          }
+          const auto size = static_cast<std::size_t>(groupEnd - groupBuffer.begin);
+          ERR_THROW_IF(size != 0 && fwrite(groupBuffer.begin, size, 1, spillFile.get()) != 1, "Failed to write the group (path = '" + spillFilePath + "').");
+          groupEnd = groupBuffer.begin;
+        };
+
+        const auto resultWriter = CreateFileChunksWriter(resultFilePath, writeBuffer, m_options.format);
+        std::size_t joinedChunks = 0;
+        std::size_t unmatchedChunks = 0;
+
+        RecordCopy<Record> groupKey;
+        std::string joined;
+
+        Record left;
+        Record right;
+        bool hasLeft = leftRecords->Next(left);
+        bool hasRight = rightRecords->Next(right);
+        while (hasLeft)
+        {
+          while (hasRight && m_less(right, left))
+          {
+            hasRight = rightRecords->Next(right);
+          }
+
+          if (!hasRight || m_less(left, right))
+          {
+            if (m_joinType == JoinType::LEFT)
+            {
+              resultWriter->Write(GetChunk(left));
+              ++unmatchedChunks;
+            }
+            hasLeft = leftRecords->Next(left);
+            continue;
+          }
+
+          groupKey.Assign(right);
+          groupEnd = groupBuffer.begin;
+          while (hasRight && !m_less(groupKey.Get(), right))
+          {
+            const auto& chunk = GetChunk(right);
+            const auto encodedSize = GetEncodedSize(chunk, m_options.format);
+            ERR_THROW_IF(encodedSize > groupBuffer.ObjectsCount(), "Buffer is too small.");
+            if (encodedSize > static_cast<std::size_t>(groupBuffer.end - groupEnd))
+            {
+              spill();
+            }
+            groupEnd = EncodeChunk(chunk, groupEnd);
+            hasRight = rightRecords->Next(right);
+          }
+          const bool spilled = !!spillFile;
+          if (spilled)
+          {
+            spill();
+            ERR_THROW_IF(fflush(spillFile.get()) != 0, "Failed to write the group (path = '" + spillFilePath + "').");
+            spillFile.reset();
+          }
+
+          const auto writeJoined = [&](const CharsChunk& leftChunk, const CharsChunk& rightChunk)
+          {
+            joined.assign(leftChunk.begin, leftChunk.end);
+            joined.push_back(m_options.key.fieldsDelim);
+            joined.append(rightChunk.begin, rightChunk.end);
+            joined.push_back(m_options.format.delim);
+            resultWriter->Write(CharsChunk(&joined[0], &joined[0] + joined.size() - 1));
+            ++joinedChunks;
+          };
+
+          // Left chunks are not less than the group key, so equal ones are not greater than it.
+          while (hasLeft && !m_less(groupKey.Get(), left))
+          {
+            const auto& leftChunk = GetChunk(left);
+            CharsChunk rightChunk;
+            if (spilled)
+            {
+              const auto rightChunks = CreateFileChunksEnumerator(spillFilePath, groupBuffer, m_options.format);
+              while (rightChunks->Next(rightChunk))
+              {
+                writeJoined(leftChunk, rightChunk);
+              }
+            }
+            else
+            {
+              for (auto pos = groupBuffer.begin; pos != groupEnd; )
+              {
+                pos = DecodeChunk(pos, groupEnd, rightChunk);
+                writeJoined(leftChunk, rightChunk);
+              }
+            }
+            hasLeft = leftRecords->Next(left);
+          }
+        }
+
+        resultWriter->Flush();
+        if (!spillFilePath.empty())
+        {
+          Utils::Fs::RemoveFile(spillFilePath);
+        }
+
+        LOG_I("joined chunks    = %s", FormatDataCount(joinedChunks).c_str());
+        if (m_joinType == JoinType::LEFT)
+        {
+          LOG_I("unmatched chunks = %s", FormatDataCount(unmatchedChunks).c_str());
+        }
+        LOG_I("spilled groups   = %s", FormatDataCount(spilledGroups).c_str());
+      }
+
+      // Copies the chunk as it is stored in a file and returns the end of the copy.
+      CharsChunk::ObjType* EncodeChunk(const CharsChunk& chunk, CharsChunk::ObjType* out) const
+      {
+        if (m_options.format.type == ChunksFormat::Type::VARINT_PREFIXED)
+        {
+          out += Utils::EncodeVarint(chunk.ObjectsCount(), reinterpret_cast<unsigned char*>(out));
+        }
+        out = std::copy(chunk.begin, chunk.end, out);
+        if (m_options.format.type == ChunksFormat::Type::DELIMITED)
+        {
+          *out++ = m_options.format.delim;
+        }
+        return out;
+      }
+
+      // Reads the chunk copied by EncodeChunk and returns the begin of the next one.
+      CharsChunk::ObjType* DecodeChunk(CharsChunk::ObjType* pos, CharsChunk::ObjType* end, CharsChunk& chunk) const
+      {
+        if (m_options.format.type == ChunksFormat::Type::VARINT_PREFIXED)
+        {
+          std::uint64_t size = 0;
+          pos += Utils::DecodeVarint(reinterpret_cast<unsigned char*>(pos), reinterpret_cast<unsigned char*>(end), size);
+          chunk = CharsChunk(pos, pos + size);
+          return chunk.end;
+        }
+        chunk = CharsChunk(pos, std::find(pos, end, m_options.format.delim));
+        return chunk.end + 1;
+      }
+
+      SortMergeJoiner(const SortMergeJoiner&) = delete;
+      SortMergeJoiner& operator = (const SortMergeJoiner&) = delete;
+    };
+  }
+
+  std::unique_ptr<Joiner> CreateSortMergeJoiner(
+    std::unique_ptr<Utils::Fs::FilePathsEnumerator> tempFilePaths,
+    const BytesChunk& buffer,
+    std::size_t maxWriteBufferSize,
+    bool removeTempFiles,
+    const SortOptions& options,
+    JoinType joinType)
+  {
+    return DispatchRecords(options.key, [&](auto records) -> std::unique_ptr<Joiner>
+    {
+      using Records = decltype(records);
+      return std::make_unique<SortMergeJoiner<Records>>(
+        std::move(tempFilePaths), buffer, maxWriteBufferSize, removeTempFiles, options, joinType);
+    });
+  }
+}
@@ -0,0 +1,27 @@
+﻿#ifndef __EXT_SORT_SORT_MERGE_JOINER_H__
+#define __EXT_SORT_SORT_MERGE_JOINER_H__
+
+#include <ext_sort/joiner.h>
+#include <ext_sort/sort_options.h>
+#include <ext_sort/types.h>
+
+#include <utils/fs/fs.h>
+
+#include <memory>
+
+namespace ExtSort
+{
+  // Merges the sorted files of both inputs in a single pass and joins chunks with equal keys.
+  // A joined chunk is the left chunk, the fields delimiter and the right chunk.
+  // Right chunks with the same key are kept in a part of the buffer while the matching left chunks are joined,
+  // a larger group goes to a temp file which is read once per matching left chunk.
+  std::unique_ptr<Joiner> CreateSortMergeJoiner(
+    std::unique_ptr<Utils::Fs::FilePathsEnumerator> tempFilePaths,
+    const BytesChunk& buffer,
+    std::size_t maxWriteBufferSize,
+    bool removeTempFiles,
+    const SortOptions& options,
+    JoinType joinType);
+}
+
+#endif
@@ -0,0 +1,38 @@
+﻿#ifndef __EXT_SORT_SORT_OPTIONS_H__
+#define __EXT_SORT_SORT_OPTIONS_H__
+
+#include <ext_sort/aggregation.h>
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/keys.h>
+#include <ext_sort/types.h>
+
+namespace ExtSort
+{
+  // Options describing the result. Both the sorter and the merger should get the same ones.
+  struct SortOptions
+  {
+    ChunksFormat format;
+    KeySpec key;
+    // Max chunks count in the result (0 means no limit).
+    std::size_t limit;
+    bool unique;
+    // Chunks with equal keys keep the source order.
+    bool stable;
+    Aggregation aggregation;
+    // Count of results with consecutive key ranges. The sorter samples runs to split them.
+    std::size_t shards;
+    // Every indexStep-th chunk of the result is indexed in a sidecar sparse index (0 means no index).
+    std::size_t indexStep;
+
+    SortOptions()
+      : limit(0)
+      , unique(false)
+      , stable(false)
+      , shards(1)
+      , indexStep(0)
+    {
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,205 @@
+﻿#include <ext_sort/sorted_file_verifier.h>
+
+#include <ext_sort/ext_sort_utils.h>
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/offsets_chunks_enumerator.h>
+#include <ext_sort/records.h>
+
+#include <utils/align.h>
+#include <utils/err.h>
+#include <utils/fs/fs.h>
+#include <utils/hash.h>
+#include <utils/log/log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace ExtSort
+{
+  namespace
+  {
+    // Smaller parts of the buffer would fail on long chunks.
+    const std::size_t MIN_THREAD_BUFFER_SIZE = 1 << 20;
+
+    std::uint64_t GetChunkHash(const CharsChunk& chunk)
+    {
+      Utils::Hash64 hash;
+      hash.Update(chunk.begin, chunk.BytesCount());
+      return hash.GetValue();
+    }
+
+    // Runs the task for every chunk aligned range of the file in its own thread with its own part of the buffer.
+    template <typename Result, typename Task>
+    std::vector<Result> ForEachRange(
+      const std::string& filePath,
+      const BytesChunk& buffer,
+      std::size_t threadsCount,
+      const ChunksFormat& format,
+      Task task)
+    {
+      CheckChunk(buffer);
+      ERR_THROW_IF_NOT(Utils::Fs::IsExists(filePath), "File not exists (path = '" + filePath + "').");
+
+      const auto fileSize = Utils::Fs::GetSize(filePath);
+      threadsCount = (std::max)(std::size_t(1), (std::min)(threadsCount, buffer.BytesCount() / MIN_THREAD_BUFFER_SIZE));
+      const auto ranges = SplitFileRange(filePath, Utils::Fs::FileRange{ 0, fileSize }, threadsCount, format);
+      LOG_I("file size = %s, ranges = %s", FormatDataSize(fileSize).c_str(), std::to_string(ranges.size()).c_str());
+
+      std::vector<Result> results(ranges.size());
+      if (ranges.empty())
+      {
+        return results;
+      }
+
+      const auto threadBufferSize = buffer.BytesCount() / ranges.size();
+      std::vector<std::exception_ptr> errors(ranges.size());
+      std::vector<std::thread> threads;
+      for (std::size_t i = 0; i != ranges.size(); ++i)
+      {
+        CharsChunk readBuffer;
+        readBuffer.begin = Utils::GetAligned((CharsChunk::ObjType*)(buffer.begin + i * threadBufferSize));
+        readBuffer.end = Utils::GetAligned((CharsChunk::ObjType*)(buffer.begin + (i + 1) * threadBufferSize));
+        AdjustEnd(readBuffer, buffer.begin + (i + 1) * threadBufferSize);
+
+        threads.emplace_back([&, i, readBuffer]()
+        {
+          try
+          {
+            results[i] = task(ranges[i], fileSize, readBuffer);
+          }
+          catch (...)
+          {
+            errors[i] = std::current_exception();
+          }
+        });
+      }
+      for (auto& thread : threads)
+      {
+        thread.join();
+      }
+      for (const auto& error : errors)
+      {
+        if (error)
+        {
+          std::rethrow_exception(error);
+        }
+      }
+      return results;
+    }
+
+    // The chunk next to the range is compared with the last one of the range but is not counted.
+    template <typename Records>
+    VerifyResult VerifyRange(
+      const std::string& filePath,
+      const Utils::Fs::FileRange& range,
+      Utils::Fs::Size fileSize,
+      const CharsChunk& readBuffer,
+      const SortOptions& options)
+    {
+      using Record = typename Records::Record;
+      const typename Records::Less less;
+      const auto unique = options.unique;
+
+      Utils::Fs::Size offset = range.begin;
+      const auto records = Records::CreateEnumerator(
+        CreateOffsetsChunksEnumerator(
+          CreateFileChunksEnumerator(filePath, readBuffer, options.format, Utils::Fs::FileRange{ range.begin, fileSize }),
+          options.format,
+          offset),
+        options.key);
+
+      VerifyResult result{ 0, true, 0, 0 };
+      // The previous chunk may be overwritten by the next read, so it is copied.
+      RecordCopy<Record> prevRecord;
+      Utils::Fs::Size recordBegin = offset;
+      Record record;
+      while (records->Next(record))
+      {
+        if (result.sorted && !prevRecord.IsEmpty() && (unique ? !less(prevRecord.Get(), record) : less(record, prevRecord.Get())))
+        {
+          result.sorted = false;
+          result.unsortedChunkIndex = result.chunksCount;
+        }
+        if (recordBegin >= range.end)
+        {
+          break;
+        }
+        result.checksum += GetChunkHash(GetChunk(record));
+        ++result.chunksCount;
+        prevRecord.Assign(record);
+        recordBegin = offset;
+      }
+      return result;
+    }
+  }
+
+  VerifyResult VerifySortedFile(
+    const std::string& filePath,
+    const BytesChunk& buffer,
+    std::size_t threadsCount,
+    const SortOptions& options)
+  {
+    Utils::Log::ScopedInfoLog verifyScope("VerifySortedFile");
+    const auto startTime = std::chrono::system_clock::now();
+
+    const auto rangeResults = DispatchRecords(options.key, [&](auto records)
+    {
+      using Records = decltype(records);
+      return ForEachRange<VerifyResult>(filePath, buffer, threadsCount, options.format,
+        [&](const Utils::Fs::FileRange& range, Utils::Fs::Size fileSize, const CharsChunk& readBuffer)
+        {
+          return VerifyRange<Records>(filePath, range, fileSize, readBuffer, options);
+        });
+    });
+
+    VerifyResult result{ 0, true, 0, 0 };
+    for (const auto& rangeResult : rangeResults)
+    {
+      if (result.sorted && !rangeResult.sorted)
+      {
+        result.sorted = false;
+        result.unsortedChunkIndex = result.chunksCount + rangeResult.unsortedChunkIndex;
+      }
+      result.chunksCount += rangeResult.chunksCount;
+      result.checksum += rangeResult.checksum;
+    }
+
+    LOG_I("Verify time = %s", FormatDuration(std::chrono::system_clock::now() - startTime).c_str());
+    return result;
+  }
+
+  std::uint64_t GetChunksChecksum(
+    const std::string& filePath,
+    const BytesChunk& buffer,
+    std::size_t threadsCount,
+    const ChunksFormat& format)
+  {
+    Utils::Log::ScopedInfoLog checksumScope("GetChunksChecksum");
+    const auto startTime = std::chrono::system_clock::now();
+
+    const auto rangeChecksums = ForEachRange<std::uint64_t>(filePath, buffer, threadsCount, format,
+      [&](const Utils::Fs::FileRange& range, Utils::Fs::Size, const CharsChunk& readBuffer)
+      {
+        std::uint64_t checksum = 0;
+        const auto chunks = CreateFileChunksEnumerator(filePath, readBuffer, format, range);
+        CharsChunk chunk;
+        while (chunks->Next(chunk))
+        {
+          checksum += GetChunkHash(chunk);
+        }
+        return checksum;
+      });
+
+    std::uint64_t checksum = 0;
+    for (const auto rangeChecksum : rangeChecksums)
+    {
+      checksum += rangeChecksum;
+    }
+
+    LOG_I("Checksum time = %s", FormatDuration(std::chrono::system_clock::now() - startTime).c_str());
+    return checksum;
+  }
+}
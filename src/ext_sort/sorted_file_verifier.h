@@ -0,0 +1,42 @@
+﻿#ifndef __EXT_SORT_SORTED_FILE_VERIFIER_H__
+#define __EXT_SORT_SORTED_FILE_VERIFIER_H__
+
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/sort_options.h>
+#include <ext_sort/types.h>
+
+#include <cstdint>
+#include <string>
+
+namespace ExtSort
+{
+  struct VerifyResult
+  {
+    std::size_t chunksCount;
+    bool sorted;
+    // 0-based index of the first chunk out of the order, valid if the file is not sorted.
+    std::size_t unsortedChunkIndex;
+    // Order independent checksum: the sum of Utils::Hash64 of the chunks.
+    std::uint64_t checksum;
+  };
+
+  // Checks the order of the file by threads reading chunk aligned ranges, every thread also
+  // reads the first chunk of the next range to check the boundary. The buffer is split between
+  // the threads. The options should be the ones the file is sorted with, unique files should
+  // have no equal keys.
+  VerifyResult VerifySortedFile(
+    const std::string& filePath,
+    const BytesChunk& buffer,
+    std::size_t threadsCount,
+    const SortOptions& options);
+
+  // The order independent checksum of the chunks, which is the same for a file and its sorted
+  // copy unless chunks are removed or aggregated.
+  std::uint64_t GetChunksChecksum(
+    const std::string& filePath,
+    const BytesChunk& buffer,
+    std::size_t threadsCount,
+    const ChunksFormat& format);
+}
+
+#endif
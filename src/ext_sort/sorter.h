@@ -1,8 +1,10 @@
 ﻿#ifndef __EXT_SORT_SORTER_H__
 #define __EXT_SORT_SORTER_H__
 
-#include <set>
+#include <utils/fs/fs.h>
+
 #include <string>
+#include <vector>
 
 namespace ExtSort
 {
@@ -11,7 +13,14 @@ namespace ExtSort
   public:
     virtual ~Sorter() = default;
 
-    virtual std::set<std::string> Sort(const std::string& sourceFilePath) = 0;
+    // Returns the sorted runs in the order of the source data.
+    virtual std::vector<std::string> Sort(const std::string& sourceFilePath) = 0;
+    // Sorts a part of the source file, the range should begin and end at chunk boundaries.
+    virtual std::vector<std::string> Sort(const std::string& sourceFilePath, const Utils::Fs::FileRange& range) = 0;
+
+    // Returns SortOptions::shards - 1 chunks splitting the sorted data into ranges of similar sizes.
+    // Chunks of a range are not less than its splitter. Available after Sort.
+    virtual std::vector<std::string> GetSplitters() const = 0;
   };
 }
 
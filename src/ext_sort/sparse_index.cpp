@@ -0,0 +1,270 @@
+﻿#include <ext_sort/sparse_index.h>
+
+#include <ext_sort/ext_sort_utils.h>
+#include <ext_sort/file_chunks_writer.h>
+#include <ext_sort/records.h>
+#include <ext_sort/strings_chunks_enumerator.h>
+#include <ext_sort/varint_chunks_enumerator.h>
+
+#include <utils/align.h>
+#include <utils/err.h>
+#include <utils/log/log.h>
+#include <utils/str_conv.h>
+
+#include <algorithm>
+
+namespace ExtSort
+{
+  namespace
+  {
+    const char* const SPARSE_INDEX_EXT = ".idx";
+
+    // A block is stored as three varint prefixed chunks: the decimal offset, the first and the last chunks.
+    class SparseIndexWriter : public CharsChunksWriter
+    {
+      std::unique_ptr<CharsChunksWriter> m_writer;
+      std::unique_ptr<CharsChunksWriter> m_indexWriter;
+      const ChunksFormat m_format;
+      const std::size_t m_step;
+      Utils::Fs::Size m_offset;
+      std::size_t m_blockChunks;
+      Utils::Fs::Size m_blockOffset;
+      std::string m_blockFirst;
+      // The last chunk of a block is known only when the next block begins, so every chunk is kept
+      // until the next one. The copy reuses the capacity, so it is a memcpy of the written data.
+      std::string m_blockLast;
+
+    public:
+      SparseIndexWriter(std::unique_ptr<CharsChunksWriter> writer, const std::string& indexFilePath, const BytesChunk& indexWriteBuffer, const ChunksFormat& format, std::size_t step)
+        : m_writer(std::move(writer))
+        , m_format(format)
+        , m_step(step)
+        , m_offset(0)
+        , m_blockChunks(0)
+        , m_blockOffset(0)
+      {
+        ERR_THROW_IF_NOT(m_writer, "Invalid argument (writer is null).");
+        ERR_THROW_IF(m_step == 0, "Invalid argument (step is 0).");
+
+        ChunksFormat indexFormat;
+        indexFormat.type = ChunksFormat::Type::VARINT_PREFIXED;
+        m_indexWriter = CreateFileChunksWriter(indexFilePath, indexWriteBuffer, indexFormat);
+      }
+
+      virtual void Write(const CharsChunk& chunk) override
+      {
+        m_writer->Write(chunk);
+
+        if (m_blockChunks == m_step)
+        {
+          WriteBlock();
+        }
+        if (m_blockChunks == 0)
+        {
+          m_blockOffset = m_offset;
+          m_blockFirst.assign(chunk.begin, chunk.end);
+        }
+        m_blockLast.assign(chunk.begin, chunk.end);
+        ++m_blockChunks;
+        m_offset += GetEncodedSize(chunk, m_format);
+      }
+
+      virtual void Flush() override
+      {
+        m_writer->Flush();
+        if (m_blockChunks != 0)
+        {
+          WriteBlock();
+        }
+        m_indexWriter->Flush();
+      }
+
+      SparseIndexWriter(const SparseIndexWriter&) = delete;
+      SparseIndexWriter& operator = (const SparseIndexWriter&) = delete;
+
+    private:
+      void WriteBlock()
+      {
+        auto offset = std::to_string(m_blockOffset);
+        m_indexWriter->Write(CharsChunk(&offset[0], &offset[0] + offset.size()));
+        m_indexWriter->Write(CharsChunk(&m_blockFirst[0], &m_blockFirst[0] + m_blockFirst.size()));
+        m_indexWriter->Write(CharsChunk(&m_blockLast[0], &m_blockLast[0] + m_blockLast.size()));
+        m_blockChunks = 0;
+      }
+    };
+
+    std::string MakeKeyChunk(const std::string& key, const KeySpec& keySpec)
+    {
+      if (keySpec.rangeSize != 0)
+      {
+        return std::string(keySpec.rangeOffset, '\0') + key;
+      }
+      if (keySpec.fields.empty())
+      {
+        return key;
+      }
+
+      std::vector<std::string> values(1);
+      for (const auto ch : key)
+      {
+        if (ch == keySpec.fieldsDelim)
+        {
+          values.emplace_back();
+        }
+        else
+        {
+          values.back() += ch;
+        }
+      }
+      ERR_THROW_IF(values.size() != keySpec.fields.size(), "The key should have " + std::to_string(keySpec.fields.size()) + " fields (key = '" + key + "').");
+
+      std::vector<std::string> fields(*std::max_element(keySpec.fields.begin(), keySpec.fields.end()));
+      for (std::size_t i = 0; i != values.size(); ++i)
+      {
+        fields[keySpec.fields[i] - 1] = values[i];
+      }
+      std::string chunk = fields.front();
+      for (std::size_t i = 1; i != fields.size(); ++i)
+      {
+        chunk += keySpec.fieldsDelim;
+        chunk += fields[i];
+      }
+      return chunk;
+    }
+
+    template <typename Records>
+    std::vector<typename Records::Record> ParseRecords(std::vector<std::string>& chunks, const KeySpec& keySpec)
+    {
+      std::vector<typename Records::Record> records;
+      auto enumerator = Records::CreateEnumerator(CreateStringsChunksEnumerator(chunks), keySpec);
+      typename Records::Record record;
+      while (enumerator->Next(record))
+      {
+        records.push_back(record);
+      }
+      return records;
+    }
+
+    template <typename Records>
+    std::size_t Lookup(
+      const std::string& sortedFilePath,
+      const std::string& key,
+      const BytesChunk& buffer,
+      std::size_t maxWriteBufferSize,
+      const std::string& resultFilePath,
+      const SortOptions& options)
+    {
+      using Record = typename Records::Record;
+      const typename Records::Less less;
+
+      BytesChunk writeBuffer;
+      writeBuffer.begin = buffer.begin;
+      writeBuffer.end = buffer.begin + (std::min)(maxWriteBufferSize, buffer.BytesCount() / 2);
+      CharsChunk readBuffer;
+      readBuffer.begin = Utils::GetAligned((CharsChunk::ObjType*)writeBuffer.end);
+      readBuffer.end = Utils::GetAligned((CharsChunk::ObjType*)buffer.end);
+      AdjustEnd(readBuffer, buffer.end);
+
+      const auto blocks = ReadSparseIndex(GetSparseIndexFilePath(sortedFilePath), readBuffer);
+      LOG_I("index blocks = %s", FormatDataCount(blocks.size()).c_str());
+
+      std::vector<std::string> keyChunks{ MakeKeyChunk(key, options.key) };
+      const auto keyRecord = ParseRecords<Records>(keyChunks, options.key).front();
+
+      std::vector<std::string> lastChunks;
+      std::vector<std::string> firstChunks;
+      for (const auto& block : blocks)
+      {
+        firstChunks.push_back(block.first);
+        lastChunks.push_back(block.last);
+      }
+      const auto firstRecords = ParseRecords<Records>(firstChunks, options.key);
+      const auto lastRecords = ParseRecords<Records>(lastChunks, options.key);
+
+      const auto resultWriter = CreateFileChunksWriter(resultFilePath, writeBuffer, options.format);
+
+      // Chunks with the key begin in the first block which max is not less than the key.
+      const auto blockIter = std::partition_point(lastRecords.begin(), lastRecords.end(), [&](const Record& last)
+      {
+        return less(last, keyRecord);
+      });
+      const auto blockIndex = static_cast<std::size_t>(blockIter - lastRecords.begin());
+      std::size_t found = 0;
+      if (blockIndex != blocks.size() && !less(keyRecord, firstRecords[blockIndex]))
+      {
+        LOG_I("index block  = %s, offset = %s", std::to_string(blockIndex).c_str(), std::to_string(blocks[blockIndex].offset).c_str());
+
+        const auto range = Utils::Fs::FileRange{ blocks[blockIndex].offset, Utils::Fs::GetSize(sortedFilePath) };
+        const auto records = Records::CreateEnumerator(CreateFileChunksEnumerator(sortedFilePath, readBuffer, options.format, range), options.key);
+        Record record;
+        while (records->Next(record))
+        {
+          if (less(record, keyRecord))
+          {
+            continue;
+          }
+          if (less(keyRecord, record))
+          {
+            break;
+          }
+          resultWriter->Write(GetChunk(record));
+          ++found;
+        }
+      }
+      resultWriter->Flush();
+      return found;
+    }
+  }
+
+  std::string GetSparseIndexFilePath(const std::string& sortedFilePath)
+  {
+    return sortedFilePath + SPARSE_INDEX_EXT;
+  }
+
+  std::unique_ptr<CharsChunksWriter> CreateSparseIndexWriter(
+    std::unique_ptr<CharsChunksWriter> writer,
+    const std::string& indexFilePath,
+    const BytesChunk& indexWriteBuffer,
+    const ChunksFormat& format,
+    std::size_t step)
+  {
+    return std::make_unique<SparseIndexWriter>(std::move(writer), indexFilePath, indexWriteBuffer, format, step);
+  }
+
+  std::vector<SparseIndexBlock> ReadSparseIndex(const std::string& indexFilePath, const CharsChunk& readBuffer)
+  {
+    ERR_THROW_IF_NOT(Utils::Fs::IsExists(indexFilePath), "Index file not exists (path = '" + indexFilePath + "').");
+
+    std::vector<SparseIndexBlock> blocks;
+    const auto chunks = CreateVarintChunksEnumerator(indexFilePath, readBuffer);
+    CharsChunk offset;
+    while (chunks->Next(offset))
+    {
+      SparseIndexBlock block;
+      block.offset = Utils::FromString<Utils::Fs::Size>(std::string(offset.begin, offset.end));
+      CharsChunk chunk;
+      ERR_THROW_IF_NOT(chunks->Next(chunk), "Bad index file (path = '" + indexFilePath + "').");
+      block.first.assign(chunk.begin, chunk.end);
+      ERR_THROW_IF_NOT(chunks->Next(chunk), "Bad index file (path = '" + indexFilePath + "').");
+      block.last.assign(chunk.begin, chunk.end);
+      ERR_THROW_IF(!blocks.empty() && blocks.back().offset >= block.offset, "Bad index file (path = '" + indexFilePath + "').");
+      blocks.push_back(std::move(block));
+    }
+    return blocks;
+  }
+
+  std::size_t LookupSortedFile(
+    const std::string& sortedFilePath,
+    const std::string& key,
+    const BytesChunk& buffer,
+    std::size_t maxWriteBufferSize,
+    const std::string& resultFilePath,
+    const SortOptions& options)
+  {
+    Utils::Log::ScopedInfoLog lookupScope("LookupSortedFile");
+    return DispatchRecords(options.key, [&](auto records)
+    {
+      return Lookup<decltype(records)>(sortedFilePath, key, buffer, maxWriteBufferSize, resultFilePath, options);
+    });
+  }
+}
@@ -0,0 +1,50 @@
+﻿#ifndef __EXT_SORT_SPARSE_INDEX_H__
+#define __EXT_SORT_SPARSE_INDEX_H__
+
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/sort_options.h>
+#include <ext_sort/types.h>
+
+#include <utils/fs/fs.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ExtSort
+{
+  // A sparse index of a sorted file is a sidecar file of blocks of consecutive chunks.
+  // Every block keeps the offset of its first chunk and its first and last chunks,
+  // which are the min and the max of the block in the sort order.
+  struct SparseIndexBlock
+  {
+    Utils::Fs::Size offset;
+    std::string first;
+    std::string last;
+  };
+
+  std::string GetSparseIndexFilePath(const std::string& sortedFilePath);
+
+  // Writes the chunks by the writer and indexes every step-th one. The index is written through the index write buffer.
+  std::unique_ptr<CharsChunksWriter> CreateSparseIndexWriter(
+    std::unique_ptr<CharsChunksWriter> writer,
+    const std::string& indexFilePath,
+    const BytesChunk& indexWriteBuffer,
+    const ChunksFormat& format,
+    std::size_t step);
+
+  std::vector<SparseIndexBlock> ReadSparseIndex(const std::string& indexFilePath, const CharsChunk& readBuffer);
+
+  // Writes the chunks of the sorted file with the key to the result file and returns their count.
+  // The key is given by the values of the key fields in the key order separated by the fields delimiter.
+  // The options should be the ones the file is sorted with.
+  std::size_t LookupSortedFile(
+    const std::string& sortedFilePath,
+    const std::string& key,
+    const BytesChunk& buffer,
+    std::size_t maxWriteBufferSize,
+    const std::string& resultFilePath,
+    const SortOptions& options);
+}
+
+#endif
@@ -0,0 +1,50 @@
+﻿#ifndef __EXT_SORT_STRINGS_CHUNKS_ENUMERATOR_H__
+#define __EXT_SORT_STRINGS_CHUNKS_ENUMERATOR_H__
+
+#include <ext_sort/types.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ExtSort
+{
+  // Enumerates in-memory strings as chunks, the chunks refer to the strings.
+  class StringsChunksEnumerator : public CharsChunksEnumerator
+  {
+    std::vector<std::string>& m_strings;
+    std::size_t m_index;
+
+  public:
+    explicit StringsChunksEnumerator(std::vector<std::string>& strings)
+      : m_strings(strings)
+      , m_index(0)
+    {
+    }
+
+    virtual void SetObserver(EventsObserver) override
+    {
+    }
+
+    virtual bool Next(CharsChunk& chunk) override
+    {
+      if (m_index == m_strings.size())
+      {
+        return false;
+      }
+      auto& str = m_strings[m_index++];
+      chunk = CharsChunk(&str[0], &str[0] + str.size());
+      return true;
+    }
+
+    StringsChunksEnumerator(const StringsChunksEnumerator&) = delete;
+    StringsChunksEnumerator& operator = (const StringsChunksEnumerator&) = delete;
+  };
+
+  inline std::unique_ptr<CharsChunksEnumerator> CreateStringsChunksEnumerator(std::vector<std::string>& strings)
+  {
+    return std::make_unique<StringsChunksEnumerator>(strings);
+  }
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define __EXT_SORT_TYPES_H__
 
 #include <utils/enumerator.h>
+#include <utils/writer.h>
 
 #include <string>
 
@@ -72,10 +73,56 @@ namespace ExtSort
     /////////////////////////////////////////////////////////////////////////////
   }
 
+  template <typename T>
+  int Compare(const Chunk<T>& lhs, const Chunk<T>& rhs)
+  {
+    const auto lhsCount = lhs.ObjectsCount();
+    const auto rhsCount = rhs.ObjectsCount();
+    const auto cmpRes = std::char_traits<T>::compare(lhs.begin, rhs.begin, lhsCount < rhsCount ? lhsCount : rhsCount);
+    if (cmpRes != 0)
+    {
+      return cmpRes;
+    }
+    return lhsCount < rhsCount ? -1 : (rhsCount < lhsCount ? 1 : 0);
+  }
+
   using Byte = char;
   using BytesChunk = Chunk<Byte>;
   using CharsChunk = Chunk<char>;
   using CharsChunksEnumerator = Utils::Enumerator<CharsChunk>;
+  using CharsChunksWriter = Utils::Writer<CharsChunk>;
+
+  // A chunk with a key parsed once when the chunk is read.
+  template <typename Key>
+  struct KeyedChunk
+  {
+    using KeyType = Key;
+
+    CharsChunk chunk;
+    Key key;
+  };
+
+  inline CharsChunk& GetChunk(CharsChunk& chunk)
+  {
+    return chunk;
+  }
+
+  inline const CharsChunk& GetChunk(const CharsChunk& chunk)
+  {
+    return chunk;
+  }
+
+  template <typename Key>
+  CharsChunk& GetChunk(KeyedChunk<Key>& keyedChunk)
+  {
+    return keyedChunk.chunk;
+  }
+
+  template <typename Key>
+  const CharsChunk& GetChunk(const KeyedChunk<Key>& keyedChunk)
+  {
+    return keyedChunk.chunk;
+  }
 
   static_assert(sizeof(CharsChunk::ObjType) == 1 || sizeof(CharsChunk::ObjType) % 2 == 0, "Objects align issue.");
 }
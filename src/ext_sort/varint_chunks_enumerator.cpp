@@ -0,0 +1,161 @@
+﻿#include <ext_sort/varint_chunks_enumerator.h>
+#include <ext_sort/ext_sort_utils.h>
+#include <ext_sort/file_chunks_enumerator.h>
+
+#include <utils/empty_enumerator.h>
+#include <utils/err.h>
+#include <utils/fs/fs.h>
+#include <utils/metrics.h>
+#include <utils/trace.h>
+#include <utils/varint.h>
+
+#include <cstring>
+
+namespace ExtSort
+{
+  namespace
+  {
+    class VarintChunksEnumerator : public CharsChunksEnumerator
+    {
+      using Char = CharsChunk::ObjType;
+      using UChar = unsigned char;
+      using EventsObserver = CharsChunksEnumerator::EventsObserver;
+
+      const std::size_t m_bufferCapacity;
+      Char* const m_bufferDataPtr;
+      Char* m_cursor;
+      Char* m_end;
+      Utils::Fs::Size m_bytesLeft;
+      EventsObserver m_observer;
+      Utils::Fs::FileUniquePtr m_file;
+
+    public:
+      VarintChunksEnumerator(const std::string& sourceFilePath,
+                             const CharsChunk& buffer,
+                             const Utils::Fs::FileRange& range)
+        : m_bufferCapacity(buffer.ObjectsCount())
+        , m_bufferDataPtr(buffer.begin)
+        , m_cursor(buffer.begin)
+        , m_end(buffer.begin)
+        , m_bytesLeft(range.GetSize())
+      {
+        CheckChunk(buffer);
+
+        ERR_THROW_IF(m_bufferCapacity < Utils::MAX_VARINT_SIZE, "Invalid argument (buffer capacity is too small).");
+
+        m_file = Utils::Fs::OpenFile(sourceFilePath, "rb");
+        const auto disableBufferResult = setvbuf(m_file.get(), nullptr, _IONBF, 0);
+        ERR_THROW_IF(disableBufferResult != 0, "Failed to disable buffering (error = " + std::to_string(disableBufferResult) + ").");
+        if (range.begin != 0)
+        {
+          Utils::Fs::SeekFile(m_file.get(), range.begin);
+        }
+      }
+
+      virtual void SetObserver(EventsObserver observer) override
+      {
+        m_observer = observer;
+      }
+
+      virtual bool Next(CharsChunk& chunk) override
+      {
+        while (!TakeChunk(chunk))
+        {
+          if (m_bytesLeft == 0)
+          {
+            ERR_THROW_IF(m_cursor != m_end, "Unexpected end of file. A whole record is expected.");
+            return false;
+          }
+          ReadBuffer();
+        }
+        return true;
+      }
+
+    private:
+      // Only the prefix is decoded, the payload is not touched.
+      bool TakeChunk(CharsChunk& chunk)
+      {
+        std::uint64_t size = 0;
+        const auto prefixSize = Utils::DecodeVarint((const UChar*)m_cursor, (const UChar*)m_end, size);
+        if (prefixSize == 0)
+        {
+          ERR_THROW_IF(static_cast<std::size_t>(m_end - m_cursor) >= Utils::MAX_VARINT_SIZE, "Bad record size prefix.");
+          return false;
+        }
+
+        auto* const payload = m_cursor + prefixSize;
+        if (static_cast<std::uint64_t>(m_end - payload) < size)
+        {
+          ERR_THROW_IF(size > m_bufferCapacity - prefixSize, "Record length is exceeded max length (length = " + std::to_string(size) + ", max length = " + std::to_string(m_bufferCapacity - prefixSize) + ").");
+          return false;
+        }
+
+        chunk.begin = payload;
+        chunk.end = payload + size;
+        m_cursor = chunk.end;
+        return true;
+      }
+
+      // A partially read record is moved to the buffer begin.
+      void ReadBuffer()
+      {
+        if (m_observer)
+        {
+          m_observer(FileChunksEnumeratorEvents::BEFORE_READ_BUFFER);
+        }
+
+        const auto tailSize = static_cast<std::size_t>(m_end - m_cursor);
+        std::memmove(m_bufferDataPtr, m_cursor, tailSize);
+
+        FILE* file = m_file.get();
+        auto bufferSize = m_bufferCapacity - tailSize;
+        if (static_cast<Utils::Fs::Size>(bufferSize) > m_bytesLeft)
+        {
+          bufferSize = static_cast<std::size_t>(m_bytesLeft);
+        }
+        std::size_t read = 0;
+        {
+          Utils::Metrics::ScopedDuration readDuration("read_us");
+          Utils::Trace::ScopedSpan readSpan("read");
+          read = fread(m_bufferDataPtr + tailSize, sizeof(Char), bufferSize, file);
+        }
+        Utils::Metrics::Add("bytes_read", read * sizeof(Char));
+        if (read != bufferSize)
+        {
+          if (const auto ferr = ferror(file))
+          {
+            ERR_THROW("Failed to read file data (error = " + std::to_string(ferr) + ").");
+          }
+          ERR_THROW("Unexpected end of file (bytes left = " + std::to_string(m_bytesLeft) + ").");
+        }
+        m_bytesLeft -= read;
+
+        m_cursor = m_bufferDataPtr;
+        m_end = m_bufferDataPtr + tailSize + read;
+      }
+
+      VarintChunksEnumerator(const VarintChunksEnumerator&) = delete;
+      VarintChunksEnumerator& operator = (const VarintChunksEnumerator&) = delete;
+    };
+  }
+
+  std::unique_ptr<CharsChunksEnumerator> CreateVarintChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer)
+  {
+    return CreateVarintChunksEnumerator(sourceFilePath, buffer, Utils::Fs::FileRange{ 0, Utils::Fs::GetSize(sourceFilePath) });
+  }
+
+  std::unique_ptr<CharsChunksEnumerator> CreateVarintChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    const Utils::Fs::FileRange& range)
+  {
+    if (range.GetSize() == 0)
+    {
+      return std::make_unique<Utils::EmptyEnumerator<CharsChunk>>();
+    }
+
+    return std::make_unique<VarintChunksEnumerator>(sourceFilePath, buffer, range);
+  }
+}
@@ -0,0 +1,26 @@
+﻿#ifndef __EXT_SORT_VARINT_CHUNKS_ENUMERATOR_H__
+#define __EXT_SORT_VARINT_CHUNKS_ENUMERATOR_H__
+
+#include <ext_sort/types.h>
+
+#include <utils/fs/fs.h>
+
+#include <memory>
+#include <string>
+
+namespace ExtSort
+{
+  // Enumerates chunks prefixed by their varint encoded sizes. Chunks are the payloads only.
+  // Raises the FileChunksEnumeratorEvents::BEFORE_READ_BUFFER event.
+  std::unique_ptr<CharsChunksEnumerator> CreateVarintChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer);
+
+  // The range should start at a size prefix and contain whole chunks.
+  std::unique_ptr<CharsChunksEnumerator> CreateVarintChunksEnumerator(
+    const std::string& sourceFilePath,
+    const CharsChunk& buffer,
+    const Utils::Fs::FileRange& range);
+}
+
+#endif
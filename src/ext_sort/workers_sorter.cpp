@@ -0,0 +1,219 @@
+﻿#include <ext_sort/workers_sorter.h>
+
+#include <ext_sort/chunks_format.h>
+#include <ext_sort/ext_sort_utils.h>
+#include <ext_sort/records.h>
+#include <ext_sort/strings_chunks_enumerator.h>
+
+#include <utils/err.h>
+#include <utils/hex.h>
+#include <utils/log/log.h>
+#include <utils/metrics.h>
+#include <utils/process.h>
+#include <utils/trace.h>
+
+#include <algorithm>
+#include <chrono>
+#include <ostream>
+#include <sstream>
+
+namespace ExtSort
+{
+  namespace
+  {
+    const char* const RUN_TAG = "run";
+    const char* const SPLITTER_TAG = "splitter";
+    const char* const METRIC_TAG = "metric";
+    const char* const SPAN_TAG = "span";
+
+    // Every worker reports shards - 1 splitters, the pooled splitters of a rank are grouped
+    // after sorting, so the middle one of every group is taken.
+    template <typename Records>
+    std::vector<std::string> SelectSplitters(std::vector<std::string> candidates, const SortOptions& options)
+    {
+      using Record = typename Records::Record;
+
+      std::vector<std::string> splitters;
+      if (options.shards <= 1)
+      {
+        return splitters;
+      }
+      if (candidates.empty())
+      {
+        splitters.resize(options.shards - 1);
+        return splitters;
+      }
+
+      std::vector<Record> records;
+      auto enumerator = Records::CreateEnumerator(CreateStringsChunksEnumerator(candidates), options.key);
+      Record record;
+      while (enumerator->Next(record))
+      {
+        records.push_back(record);
+      }
+      std::sort(records.begin(), records.end(), typename Records::Less());
+
+      const auto groups = options.shards - 1;
+      for (std::size_t group = 0; group != groups; ++group)
+      {
+        const auto& chunk = GetChunk(records[(2 * group + 1) * records.size() / (2 * groups)]);
+        splitters.emplace_back(chunk.begin, chunk.end);
+      }
+      return splitters;
+    }
+
+    class WorkersSorter : public Sorter
+    {
+      const WorkerCommandBuilder m_commandBuilder;
+      const std::size_t m_workersCount;
+      const SortOptions m_options;
+      std::vector<std::string> m_splitterCandidates;
+
+    public:
+      WorkersSorter(
+        WorkerCommandBuilder commandBuilder,
+        std::size_t workersCount,
+        const SortOptions& options)
+        : m_commandBuilder(std::move(commandBuilder))
+        , m_workersCount(workersCount)
+        , m_options(options)
+      {
+        ERR_THROW_IF_NOT(m_commandBuilder, "Invalid argument (command builder is null).");
+        ERR_THROW_IF(m_workersCount == 0, "Invalid argument (workers count is 0).");
+      }
+
+      virtual std::vector<std::string> Sort(const std::string& sourceFilePath) override
+      {
+        return Sort(sourceFilePath, Utils::Fs::FileRange{ 0, Utils::Fs::GetSize(sourceFilePath) });
+      }
+
+      virtual std::vector<std::string> Sort(const std::string& sourceFilePath, const Utils::Fs::FileRange& range) override
+      {
+        Utils::Log::ScopedInfoLog sortScope("WorkersSorter::Sort");
+
+        const auto startTime = std::chrono::system_clock::now();
+
+        LOG_I("source file path = '%s'", sourceFilePath.c_str());
+        LOG_I("source file size = %s", FormatDataSize(static_cast<std::size_t>(range.GetSize())).c_str());
+
+        auto ranges = SplitFileRange(sourceFilePath, range, m_workersCount, m_options.format);
+        if (ranges.empty())
+        {
+          ranges.push_back(range);
+        }
+        LOG_I("workers count    = %s", std::to_string(ranges.size()).c_str());
+
+        std::vector<std::unique_ptr<Utils::ChildProcess>> workers;
+        for (std::size_t i = 0; i != ranges.size(); ++i)
+        {
+          LOG_I("worker %s range = [%s, %s)", std::to_string(i).c_str(), std::to_string(ranges[i].begin).c_str(), std::to_string(ranges[i].end).c_str());
+          workers.push_back(Utils::StartChildProcess(m_commandBuilder(sourceFilePath, ranges[i], i)));
+        }
+
+        Utils::Metrics::Add("workers", workers.size());
+        Utils::Metrics::ScopedDuration waitDuration("wait_us");
+        Utils::Trace::ScopedSpan waitSpan("wait");
+
+        // Runs are collected in the order of the ranges, so the stable order is kept.
+        std::vector<std::string> resultFilePaths;
+        m_splitterCandidates.clear();
+        for (auto& worker : workers)
+        {
+          std::string line;
+          while (worker->ReadLine(line))
+          {
+            const auto tagEnd = line.find(' ');
+            ERR_THROW_IF(tagEnd == std::string::npos, "Bad worker output (line = '" + line + "').");
+            const auto tag = line.substr(0, tagEnd);
+            const auto value = line.substr(tagEnd + 1);
+            if (tag == RUN_TAG)
+            {
+              resultFilePaths.push_back(value);
+            }
+            else if (tag == SPLITTER_TAG)
+            {
+              m_splitterCandidates.push_back(Utils::DecodeHex(value));
+            }
+            else if (tag == METRIC_TAG)
+            {
+              // The counters of the workers are summed.
+              const auto nameEnd = value.find(' ');
+              ERR_THROW_IF(nameEnd == std::string::npos, "Bad worker output (line = '" + line + "').");
+              Utils::Metrics::Add(value.substr(0, nameEnd).c_str(), std::stoull(value.substr(nameEnd + 1)));
+            }
+            else if (tag == SPAN_TAG)
+            {
+              Utils::Trace::Event event;
+              std::string name;
+              std::istringstream fields(value);
+              ERR_THROW_IF_NOT(fields >> name >> event.process >> event.thread >> event.begin >> event.duration, "Bad worker output (line = '" + line + "').");
+              event.name = Utils::DecodeHex(name);
+              Utils::Trace::AddEvent(event);
+            }
+            else
+            {
+              ERR_THROW("Bad worker output (line = '" + line + "').");
+            }
+          }
+          worker->Wait();
+        }
+
+        LOG_I("DONE: 100%%");
+        LOG_I("Sort file time = %s", FormatDuration(std::chrono::system_clock::now() - startTime).c_str());
+
+        return resultFilePaths;
+      }
+
+      virtual std::vector<std::string> GetSplitters() const override
+      {
+        return DispatchRecords(m_options.key, [this](auto records)
+        {
+          return SelectSplitters<decltype(records)>(m_splitterCandidates, m_options);
+        });
+      }
+
+      WorkersSorter(const WorkersSorter&) = delete;
+      WorkersSorter& operator = (const WorkersSorter&) = delete;
+    };
+  }
+
+  std::unique_ptr<Sorter> CreateWorkersSorter(
+    WorkerCommandBuilder commandBuilder,
+    std::size_t workersCount,
+    const SortOptions& options)
+  {
+    return std::make_unique<WorkersSorter>(std::move(commandBuilder), workersCount, options);
+  }
+
+  void WriteWorkerResult(
+    const std::vector<std::string>& sortedFilePaths,
+    const std::vector<std::string>& splitters,
+    std::ostream& out)
+  {
+    for (const auto& filePath : sortedFilePaths)
+    {
+      out << RUN_TAG << ' ' << filePath << '\n';
+    }
+    // Splitters may contain any bytes, so they are hex encoded.
+    for (const auto& splitter : splitters)
+    {
+      out << SPLITTER_TAG << ' ' << Utils::EncodeHex(splitter) << '\n';
+    }
+    if (Utils::Metrics::IsEnabled())
+    {
+      for (const auto& counter : Utils::Metrics::GetCounters(Utils::Metrics::GetPhase()))
+      {
+        out << METRIC_TAG << ' ' << counter.first << ' ' << counter.second << '\n';
+      }
+    }
+    // The spans of the worker are shown as another process of the coordinator trace.
+    if (Utils::Trace::IsEnabled())
+    {
+      for (const auto& event : Utils::Trace::GetEvents())
+      {
+        out << SPAN_TAG << ' ' << Utils::EncodeHex(event.name) << ' ' << event.process << ' ' << event.thread << ' ' << event.begin << ' ' << event.duration << '\n';
+      }
+    }
+    out.flush();
+  }
+}
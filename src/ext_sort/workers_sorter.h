@@ -0,0 +1,37 @@
+﻿#ifndef __EXT_SORT_WORKERS_SORTER_H__
+#define __EXT_SORT_WORKERS_SORTER_H__
+
+#include <ext_sort/sort_options.h>
+#include <ext_sort/sorter.h>
+
+#include <utils/fs/fs.h>
+
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ExtSort
+{
+  // Returns the command line of a worker process sorting the range of the file.
+  using WorkerCommandBuilder = std::function<std::vector<std::string>(
+    const std::string& filePath,
+    const Utils::Fs::FileRange& range,
+    std::size_t workerIndex)>;
+
+  // Splits the source file into byte ranges at chunk boundaries and sorts them by worker processes.
+  // A worker reports its sorted runs and splitters by WriteWorkerResult to the standard output,
+  // the metrics of its current phase and its trace spans are reported too when they are collected.
+  std::unique_ptr<Sorter> CreateWorkersSorter(
+    WorkerCommandBuilder commandBuilder,
+    std::size_t workersCount,
+    const SortOptions& options);
+
+  void WriteWorkerResult(
+    const std::vector<std::string>& sortedFilePaths,
+    const std::vector<std::string>& splitters,
+    std::ostream& out);
+}
+
+#endif
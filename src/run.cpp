@@ -1,8 +1,14 @@
 ﻿#include <run.h>
 #include <predef.h>
 
+#include <ext_sort/checkpoint.h>
+#include <ext_sort/fixed_records_sorter.h>
 #include <ext_sort/merge_sort_sorter.h>
 #include <ext_sort/multi_files_per_phase_merger.h>
+#include <ext_sort/sort_merge_joiner.h>
+#include <ext_sort/sorted_file_verifier.h>
+#include <ext_sort/sparse_index.h>
+#include <ext_sort/workers_sorter.h>
 
 #include <utils/arg.h>
 #include <utils/err.h>
@@ -12,28 +18,107 @@
 #include <utils/log/log_registry.h>
 #include <utils/log/log_exception.h>
 #include <utils/log/loggers/ostream_logger.h>
+#include <utils/log/loggers/threadsafe_logger.h>
+#include <utils/memory.h>
+#include <utils/metrics.h>
+#include <utils/page_buffer.h>
 #include <utils/str_conv.h>
+#include <utils/trace.h>
 
 #include <algorithm>
 #include <chrono>
+#include <iostream>
 #include <iomanip>
 #include <memory>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 namespace
 {
   const char* const ARG_USAGE_REQUEST       = "?";
+  const char* const ARG_MODE                = "mode";
   const char* const ARG_INPUT_FILE_PATH     = "input";
   const char* const ARG_OUTPUT_FILE_PATH    = "output";
   const char* const ARG_TEMP_DIR_PATH       = "temp_dir";
   const char* const ARG_MAX_MEMORY_USAGE_MB = "max_memory_usage_Mb";
+  const char* const ARG_MAX_HEAP_USAGE_MB   = "max_heap_usage_Mb";
   const char* const ARG_MAX_WRITE_BUFFER_KB = "max_write_buffer_Kb";
   const char* const ARG_REMOVE_TEMP_FILES   = "remove_temp_files";
+  const char* const ARG_LIMIT               = "limit";
+  const char* const ARG_UNIQUE              = "unique";
+  const char* const ARG_KEY                 = "key";
+  const char* const ARG_FIELD_DELIM         = "field_delim";
+  const char* const ARG_KEY_TYPE            = "key_type";
+  const char* const ARG_REVERSE             = "reverse";
+  const char* const ARG_STABLE              = "stable";
+  const char* const ARG_RECORDS_FORMAT      = "records_format";
+  const char* const ARG_RECORD_SIZE         = "record_size";
+  const char* const ARG_KEY_OFFSET          = "key_offset";
+  const char* const ARG_KEY_SIZE            = "key_size";
+  const char* const ARG_JOIN_INPUT          = "join_input";
+  const char* const ARG_JOIN_TYPE           = "join_type";
+  const char* const ARG_AGGREGATE           = "aggregate";
+  const char* const ARG_VALUE_FIELD         = "value_field";
+  const char* const ARG_OUTPUT_SHARDS       = "output_shards";
+  const char* const ARG_WORKERS             = "workers";
+  const char* const ARG_INPUT_BEGIN         = "input_begin";
+  const char* const ARG_INPUT_END           = "input_end";
+  const char* const ARG_INDEX_STEP          = "index_step";
+  const char* const ARG_LOOKUP_KEY          = "lookup_key";
+  const char* const ARG_APPEND              = "append";
+  const char* const ARG_CHECKPOINT          = "checkpoint";
+  const char* const ARG_RESUME              = "resume";
+  const char* const ARG_MERGE_FAN_IN        = "merge_fan_in";
+  const char* const ARG_THREADS             = "threads";
+  const char* const ARG_CHECKSUM_INPUT      = "checksum_input";
+  const char* const ARG_METRICS_FILE        = "metrics_file";
+  const char* const ARG_TRACE_FILE          = "trace_file";
+  const char* const ARG_LOG_LEVEL           = "log_level";
+  const char* const ARG_HUGE_PAGES          = "huge_pages";
+  const char* const ARG_APP_PATH            = "app_path";
 
+  const char* const DEFAULT_MODE                = "sort";
   const char* const DEFAULT_MAX_MEMORY_USAGE_MB = "16";
+  const char* const DEFAULT_MAX_HEAP_USAGE_MB   = "0";
   const char* const DEFAULT_MAX_WRITE_BUFFER_KB = "128";
   const char* const DEFAULT_REMOVE_TEMP_FILES   = "1";
   const char* const DEFAULT_TEMP_DIR_PATH       = "./temp/";
+  const char* const DEFAULT_LIMIT               = "0";
+  const char* const DEFAULT_UNIQUE              = "0";
+  const char* const DEFAULT_KEY                 = "";
+  const char* const DEFAULT_FIELD_DELIM         = "\\t";
+  const char* const DEFAULT_KEY_TYPE            = "string";
+  const char* const DEFAULT_REVERSE             = "0";
+  const char* const DEFAULT_STABLE              = "0";
+  const char* const DEFAULT_RECORDS_FORMAT      = "lines";
+  const char* const DEFAULT_RECORD_SIZE         = "0";
+  const char* const DEFAULT_KEY_OFFSET          = "0";
+  const char* const DEFAULT_KEY_SIZE            = "0";
+  const char* const DEFAULT_JOIN_INPUT          = "";
+  const char* const DEFAULT_JOIN_TYPE           = "inner";
+  const char* const DEFAULT_AGGREGATE           = "none";
+  const char* const DEFAULT_VALUE_FIELD         = "0";
+  const char* const DEFAULT_OUTPUT_SHARDS       = "1";
+  const char* const DEFAULT_WORKERS             = "0";
+  const char* const DEFAULT_INPUT_BEGIN         = "0";
+  const char* const DEFAULT_INPUT_END           = "0";
+  const char* const DEFAULT_INDEX_STEP          = "0";
+  const char* const DEFAULT_LOOKUP_KEY          = "";
+  const char* const DEFAULT_APPEND              = "";
+  const char* const DEFAULT_CHECKPOINT          = "0";
+  const char* const DEFAULT_RESUME              = "";
+  const char* const DEFAULT_MERGE_FAN_IN        = "0";
+  const char* const DEFAULT_THREADS             = "0";
+  const char* const DEFAULT_CHECKSUM_INPUT      = "";
+  const char* const DEFAULT_METRICS_FILE        = "";
+  const char* const DEFAULT_TRACE_FILE          = "";
+  const char* const DEFAULT_LOG_LEVEL           = "info";
+  const char* const DEFAULT_HUGE_PAGES          = "0";
+
+  // A checkpointed merge has phases of up to this count of files, so a resume does not repeat the merged ones.
+  const std::size_t CHECKPOINT_MERGE_FAN_IN = 16;
 
   class Usage
   {
@@ -46,10 +131,43 @@ namespace
     {
       //m_args.SetDefault(ARG_INPUT_FILE_PATH     , "input");
       //m_args.SetDefault(ARG_OUTPUT_FILE_PATH    , "output");
+      m_args.SetDefault(ARG_MODE                , DEFAULT_MODE);
       m_args.SetDefault(ARG_TEMP_DIR_PATH       , DEFAULT_TEMP_DIR_PATH);
       m_args.SetDefault(ARG_MAX_MEMORY_USAGE_MB , DEFAULT_MAX_MEMORY_USAGE_MB);
+      m_args.SetDefault(ARG_MAX_HEAP_USAGE_MB   , DEFAULT_MAX_HEAP_USAGE_MB);
       m_args.SetDefault(ARG_MAX_WRITE_BUFFER_KB , DEFAULT_MAX_WRITE_BUFFER_KB);
       m_args.SetDefault(ARG_REMOVE_TEMP_FILES   , DEFAULT_REMOVE_TEMP_FILES);
+      m_args.SetDefault(ARG_LIMIT               , DEFAULT_LIMIT);
+      m_args.SetDefault(ARG_UNIQUE              , DEFAULT_UNIQUE);
+      m_args.SetDefault(ARG_KEY                 , DEFAULT_KEY);
+      m_args.SetDefault(ARG_FIELD_DELIM         , DEFAULT_FIELD_DELIM);
+      m_args.SetDefault(ARG_KEY_TYPE            , DEFAULT_KEY_TYPE);
+      m_args.SetDefault(ARG_REVERSE             , DEFAULT_REVERSE);
+      m_args.SetDefault(ARG_STABLE              , DEFAULT_STABLE);
+      m_args.SetDefault(ARG_RECORDS_FORMAT      , DEFAULT_RECORDS_FORMAT);
+      m_args.SetDefault(ARG_RECORD_SIZE         , DEFAULT_RECORD_SIZE);
+      m_args.SetDefault(ARG_KEY_OFFSET          , DEFAULT_KEY_OFFSET);
+      m_args.SetDefault(ARG_KEY_SIZE            , DEFAULT_KEY_SIZE);
+      m_args.SetDefault(ARG_JOIN_INPUT          , DEFAULT_JOIN_INPUT);
+      m_args.SetDefault(ARG_JOIN_TYPE           , DEFAULT_JOIN_TYPE);
+      m_args.SetDefault(ARG_AGGREGATE           , DEFAULT_AGGREGATE);
+      m_args.SetDefault(ARG_VALUE_FIELD         , DEFAULT_VALUE_FIELD);
+      m_args.SetDefault(ARG_OUTPUT_SHARDS       , DEFAULT_OUTPUT_SHARDS);
+      m_args.SetDefault(ARG_WORKERS             , DEFAULT_WORKERS);
+      m_args.SetDefault(ARG_INPUT_BEGIN         , DEFAULT_INPUT_BEGIN);
+      m_args.SetDefault(ARG_INPUT_END           , DEFAULT_INPUT_END);
+      m_args.SetDefault(ARG_INDEX_STEP          , DEFAULT_INDEX_STEP);
+      m_args.SetDefault(ARG_LOOKUP_KEY          , DEFAULT_LOOKUP_KEY);
+      m_args.SetDefault(ARG_APPEND              , DEFAULT_APPEND);
+      m_args.SetDefault(ARG_CHECKPOINT          , DEFAULT_CHECKPOINT);
+      m_args.SetDefault(ARG_RESUME              , DEFAULT_RESUME);
+      m_args.SetDefault(ARG_MERGE_FAN_IN        , DEFAULT_MERGE_FAN_IN);
+      m_args.SetDefault(ARG_THREADS             , DEFAULT_THREADS);
+      m_args.SetDefault(ARG_CHECKSUM_INPUT      , DEFAULT_CHECKSUM_INPUT);
+      m_args.SetDefault(ARG_METRICS_FILE        , DEFAULT_METRICS_FILE);
+      m_args.SetDefault(ARG_TRACE_FILE          , DEFAULT_TRACE_FILE);
+      m_args.SetDefault(ARG_LOG_LEVEL           , DEFAULT_LOG_LEVEL);
+      m_args.SetDefault(ARG_HUGE_PAGES          , DEFAULT_HUGE_PAGES);
 
       m_appName = m_args.GetArgument("app_path");
       auto lastSeparatorPos = m_appName.find_last_of(Utils::Fs::GetPathSeparator());
@@ -79,19 +197,85 @@ namespace
       oss << m_appName
           << " " << ARG_INPUT_FILE_PATH
           << " " << ARG_OUTPUT_FILE_PATH
+          << " [" << ARG_MODE << "]"
           << " [" << ARG_TEMP_DIR_PATH << "]"
           << " [" << ARG_MAX_MEMORY_USAGE_MB << "]"
+          << " [" << ARG_MAX_HEAP_USAGE_MB << "]"
           << " [" << ARG_MAX_WRITE_BUFFER_KB << "]"
           << " [" << ARG_REMOVE_TEMP_FILES << "]"
+          << " [" << ARG_LIMIT << "]"
+          << " [" << ARG_UNIQUE << "]"
+          << " [" << ARG_KEY << "]"
+          << " [" << ARG_FIELD_DELIM << "]"
+          << " [" << ARG_KEY_TYPE << "]"
+          << " [" << ARG_REVERSE << "]"
+          << " [" << ARG_STABLE << "]"
+          << " [" << ARG_RECORDS_FORMAT << "]"
+          << " [" << ARG_RECORD_SIZE << "]"
+          << " [" << ARG_KEY_OFFSET << "]"
+          << " [" << ARG_KEY_SIZE << "]"
+          << " [" << ARG_JOIN_INPUT << "]"
+          << " [" << ARG_JOIN_TYPE << "]"
+          << " [" << ARG_AGGREGATE << "]"
+          << " [" << ARG_VALUE_FIELD << "]"
+          << " [" << ARG_OUTPUT_SHARDS << "]"
+          << " [" << ARG_WORKERS << "]"
+          << " [" << ARG_INPUT_BEGIN << "]"
+          << " [" << ARG_INPUT_END << "]"
+          << " [" << ARG_INDEX_STEP << "]"
+          << " [" << ARG_LOOKUP_KEY << "]"
+          << " [" << ARG_APPEND << "]"
+          << " [" << ARG_CHECKPOINT << "]"
+          << " [" << ARG_RESUME << "]"
+          << " [" << ARG_MERGE_FAN_IN << "]"
+          << " [" << ARG_THREADS << "]"
+          << " [" << ARG_CHECKSUM_INPUT << "]"
+          << " [" << ARG_METRICS_FILE << "]"
+          << " [" << ARG_TRACE_FILE << "]"
+          << " [" << ARG_LOG_LEVEL << "]"
+          << " [" << ARG_HUGE_PAGES << "]"
           << std::endl << std::endl;
 
       oss << "Where:" << std::endl;
       oss << "  " << ARG_INPUT_FILE_PATH      << " - file path to be sorted (must exists)." << std::endl;
       oss << "  " << ARG_OUTPUT_FILE_PATH     << " - result file path (must NOT exists)." << std::endl;
+      oss << "  " << ARG_MODE                 << " - sort, join, lookup, verify or worker: the sorted " << ARG_INPUT_FILE_PATH << " and " << ARG_JOIN_INPUT << " are merged into chunks with equal keys in the join mode, the lookup mode writes chunks of the indexed sorted " << ARG_INPUT_FILE_PATH << " with the " << ARG_LOOKUP_KEY << ", the verify mode checks the order of " << ARG_INPUT_FILE_PATH << " and fails if it is not sorted, a worker sorts a range of " << ARG_INPUT_FILE_PATH << " into runs and reports them to the standard output (default value is '" + std::string(DEFAULT_MODE) + "')." << std::endl;
       oss << "  " << ARG_TEMP_DIR_PATH        << " - path to a directory for tempopary files (default value is '" + std::string(DEFAULT_TEMP_DIR_PATH) + "')." << std::endl;
       oss << "  " << ARG_MAX_MEMORY_USAGE_MB  << " - max memory usage in Mb (default value is '" + std::string(DEFAULT_MAX_MEMORY_USAGE_MB) + "')." << std::endl;
+      oss << "  " << ARG_MAX_HEAP_USAGE_MB    << " - part of " << ARG_MAX_MEMORY_USAGE_MB << " reserved for the heap allocations: merge queues, paths, logger queues and threads, the sort buffer gets the rest and an allocation over the reserve fails the sort, 0 means the heap is only accounted and the sort buffer gets all of " << ARG_MAX_MEMORY_USAGE_MB << " (default value is '" + std::string(DEFAULT_MAX_HEAP_USAGE_MB) + "')." << std::endl;
       oss << "  " << ARG_MAX_WRITE_BUFFER_KB  << " - max write buffer size in Kb (default value is '" + std::string(DEFAULT_MAX_WRITE_BUFFER_KB) + "')." << std::endl;
       oss << "  " << ARG_REMOVE_TEMP_FILES    << " - set to 1 to remove all temporary files (default value is '" + std::string(DEFAULT_REMOVE_TEMP_FILES) + "')." << std::endl;
+      oss << "  " << ARG_LIMIT                << " - max lines count in the result, 0 means no limit (default value is '" + std::string(DEFAULT_LIMIT) + "')." << std::endl;
+      oss << "  " << ARG_UNIQUE               << " - set to 1 to remove duplicated lines (default value is '" + std::string(DEFAULT_UNIQUE) + "')." << std::endl;
+      oss << "  " << ARG_KEY                  << " - comma separated 1-based numbers of key fields, up to " << ExtSort::MAX_KEY_FIELDS << " fields, empty means the whole line (default value is '" + std::string(DEFAULT_KEY) + "')." << std::endl;
+      oss << "  " << ARG_FIELD_DELIM          << " - fields delimiter: a char, '\\t', '\\s' (space), '\\\\' or '\\xHH' (default value is '" + std::string(DEFAULT_FIELD_DELIM) + "')." << std::endl;
+      oss << "  " << ARG_KEY_TYPE             << " - key type: string, integer, float, hex or version; typed keys use a single key field (default value is '" + std::string(DEFAULT_KEY_TYPE) + "')." << std::endl;
+      oss << "  " << ARG_REVERSE              << " - set to 1 to sort in the descending order (default value is '" + std::string(DEFAULT_REVERSE) + "')." << std::endl;
+      oss << "  " << ARG_STABLE               << " - set to 1 to keep the input order of lines with equal keys (default value is '" + std::string(DEFAULT_STABLE) + "')." << std::endl;
+      oss << "  " << ARG_RECORDS_FORMAT       << " - records format: lines, fixed (binary records of the " << ARG_RECORD_SIZE << " size) or varint (binary records prefixed by varint sizes) (default value is '" + std::string(DEFAULT_RECORDS_FORMAT) + "')." << std::endl;
+      oss << "  " << ARG_RECORD_SIZE          << " - size of fixed width records (default value is '" + std::string(DEFAULT_RECORD_SIZE) + "')." << std::endl;
+      oss << "  " << ARG_KEY_OFFSET           << " - key offset in a fixed width record (default value is '" + std::string(DEFAULT_KEY_OFFSET) + "')." << std::endl;
+      oss << "  " << ARG_KEY_SIZE             << " - key size in a fixed width record, 0 means up to the record end (default value is '" + std::string(DEFAULT_KEY_SIZE) + "')." << std::endl;
+      oss << "  " << ARG_JOIN_INPUT           << " - right file path to be joined in the join mode, joined lines are 'left" << ARG_FIELD_DELIM << "right' (default value is '" + std::string(DEFAULT_JOIN_INPUT) + "')." << std::endl;
+      oss << "  " << ARG_JOIN_TYPE            << " - inner or left: the left join also writes left lines without matches (default value is '" + std::string(DEFAULT_JOIN_TYPE) + "')." << std::endl;
+      oss << "  " << ARG_AGGREGATE            << " - none, count or sum: lines with equal keys are replaced by the first one with the count or the sum appended as the last field (default value is '" + std::string(DEFAULT_AGGREGATE) + "')." << std::endl;
+      oss << "  " << ARG_VALUE_FIELD          << " - 1-based number of the field to sum (default value is '" + std::string(DEFAULT_VALUE_FIELD) + "')." << std::endl;
+      oss << "  " << ARG_OUTPUT_SHARDS        << " - count of key range partitioned result files '" << ARG_OUTPUT_FILE_PATH << ".N' merged in parallel, 1 means a single " << ARG_OUTPUT_FILE_PATH << " (default value is '" + std::string(DEFAULT_OUTPUT_SHARDS) + "')." << std::endl;
+      oss << "  " << ARG_WORKERS              << " - count of worker processes sorting byte ranges of the input, they split " << ARG_MAX_MEMORY_USAGE_MB << " and the buffer of this process is not touched until they are done, 0 means sorting in this process (default value is '" + std::string(DEFAULT_WORKERS) + "')." << std::endl;
+      oss << "  " << ARG_INPUT_BEGIN          << " - begin of the input range sorted in the worker mode (default value is '" + std::string(DEFAULT_INPUT_BEGIN) + "')." << std::endl;
+      oss << "  " << ARG_INPUT_END            << " - end of the input range sorted in the worker mode, 0 means the file end (default value is '" + std::string(DEFAULT_INPUT_END) + "')." << std::endl;
+      oss << "  " << ARG_INDEX_STEP           << " - every Nth chunk of the result is indexed in the '" << ARG_OUTPUT_FILE_PATH << ".idx' sparse index, 0 means no index (default value is '" + std::string(DEFAULT_INDEX_STEP) + "')." << std::endl;
+      oss << "  " << ARG_LOOKUP_KEY           << " - key to look up: values of the key fields in the key order separated by " << ARG_FIELD_DELIM << ", the other arguments should be the ones the file is sorted with (default value is '" + std::string(DEFAULT_LOOKUP_KEY) + "')." << std::endl;
+      oss << "  " << ARG_APPEND               << " - path to a file sorted with the same arguments, only " << ARG_INPUT_FILE_PATH << " is sorted and then merged with it in a single pass, the file is kept (default value is '" + std::string(DEFAULT_APPEND) + "')." << std::endl;
+      oss << "  " << ARG_CHECKPOINT           << " - set to 1 to record the completed sort phases and merge tasks in a manifest of the temp dir, so a killed sort can be resumed (default value is '" + std::string(DEFAULT_CHECKPOINT) + "')." << std::endl;
+      oss << "  " << ARG_RESUME               << " - path to the temp dir of a killed checkpointed sort to be resumed with the same arguments, the partial results are overwritten (default value is '" + std::string(DEFAULT_RESUME) + "')." << std::endl;
+      oss << "  " << ARG_MERGE_FAN_IN         << " - max count of files merged at once, more runs are merged in several phases and every intermediate merge is recorded by a checkpoint, 0 means all the runs at once or " << CHECKPOINT_MERGE_FAN_IN << " with a checkpoint, sharded results are merged at once (default value is '" + std::string(DEFAULT_MERGE_FAN_IN) + "')." << std::endl;
+      oss << "  " << ARG_THREADS              << " - count of threads checking ranges of the file in the verify mode and pre-faulting the huge pages buffer, 0 means the count of hardware threads (default value is '" + std::string(DEFAULT_THREADS) + "')." << std::endl;
+      oss << "  " << ARG_CHECKSUM_INPUT       << " - path to the unsorted file, the verify mode fails if the order independent checksum of its chunks differs, so it is not applicable to results with removed or aggregated chunks (default value is '" + std::string(DEFAULT_CHECKSUM_INPUT) + "')." << std::endl;
+      oss << "  " << ARG_METRICS_FILE         << " - path to the JSON file of the sort metrics: bytes, lines and times of every phase, merge fan-in and peak memory, empty means no metrics (default value is '" + std::string(DEFAULT_METRICS_FILE) + "')." << std::endl;
+      oss << "  " << ARG_TRACE_FILE           << " - path to the Chrome trace event JSON file of the log scopes and the read, sort and write spans of every thread and worker, empty means no trace (default value is '" + std::string(DEFAULT_TRACE_FILE) + "')." << std::endl;
+      oss << "  " << ARG_LOG_LEVEL            << " - max level of the logged messages: error, warning, info, debug, the levels above the compiled max level are never logged (default value is '" + std::string(DEFAULT_LOG_LEVEL) + "')." << std::endl;
+      oss << "  " << ARG_HUGE_PAGES           << " - set to 1 to back the sort buffer by huge pages, reserved or transparent ones, and to pre-fault it by " << ARG_THREADS << " at the start (default value is '" + std::string(DEFAULT_HUGE_PAGES) + "')." << std::endl;
 
       Utils::Log::GetLogger().Add(oss.str().c_str(), Utils::Log::LOG_LEVEL_INFO);
     }
@@ -102,6 +286,11 @@ namespace
       return m_args.GetArgument<T>(argName);
     }
 
+    Utils::Arguments::ArgsMap GetAllArguments() const
+    {
+      return m_args.GetAllArguments();
+    }
+
     void LogArgs() const
     {
       const auto& argsMap = m_args.GetAllArguments();
@@ -121,6 +310,182 @@ namespace
     }
   };
 
+  enum class Mode
+  {
+    SORT,
+    JOIN,
+    LOOKUP,
+    VERIFY,
+    WORKER,
+  };
+
+  Mode ParseMode(const std::string& value)
+  {
+    if (value == "sort")
+    {
+      return Mode::SORT;
+    }
+    if (value == "join")
+    {
+      return Mode::JOIN;
+    }
+    if (value == "lookup")
+    {
+      return Mode::LOOKUP;
+    }
+    if (value == "verify")
+    {
+      return Mode::VERIFY;
+    }
+    if (value == "worker")
+    {
+      return Mode::WORKER;
+    }
+    ERR_THROW_TYPED(std::invalid_argument, "Bad mode (value = '" + value + "').");
+    return Mode::SORT;
+  }
+
+  std::vector<std::size_t> ParseKeyFields(const std::string& value)
+  {
+    std::vector<std::size_t> fields;
+    std::istringstream iss(value);
+    std::string field;
+    while (std::getline(iss, field, ','))
+    {
+      const auto fieldNumber = Utils::FromString<std::size_t>(field);
+      ERR_THROW_IF(fieldNumber == 0, "Key field numbers are 1-based (value = '" + value + "').");
+      fields.push_back(fieldNumber);
+    }
+    return fields;
+  }
+
+  ExtSort::KeyType ParseKeyType(const std::string& value)
+  {
+    if (value == "string")
+    {
+      return ExtSort::KeyType::STRING;
+    }
+    if (value == "integer")
+    {
+      return ExtSort::KeyType::INTEGER;
+    }
+    if (value == "float")
+    {
+      return ExtSort::KeyType::FLOAT;
+    }
+    if (value == "hex")
+    {
+      return ExtSort::KeyType::HEX;
+    }
+    if (value == "version")
+    {
+      return ExtSort::KeyType::VERSION;
+    }
+    ERR_THROW_TYPED(std::invalid_argument, "Bad key type (value = '" + value + "').");
+    return ExtSort::KeyType::STRING;
+  }
+
+  char ParseChar(const std::string& value)
+  {
+    if (value.size() == 1)
+    {
+      return value.front();
+    }
+    if (value == "\\t")
+    {
+      return '\t';
+    }
+    if (value == "\\s")
+    {
+      return ' ';
+    }
+    if (value == "\\\\")
+    {
+      return '\\';
+    }
+    if (value.size() == 4 && value.compare(0, 2, "\\x") == 0)
+    {
+      std::size_t pos = 0;
+      const auto code = std::stoul(value.substr(2), &pos, 16);
+      ERR_THROW_IF(pos != 2, "Bad char code (value = '" + value + "').");
+      return static_cast<char>(code);
+    }
+    ERR_THROW_TYPED(std::invalid_argument, "Bad char (value = '" + value + "').");
+    return 0;
+  }
+
+  ExtSort::ChunksFormat::Type ParseRecordsFormat(const std::string& value)
+  {
+    if (value == "lines")
+    {
+      return ExtSort::ChunksFormat::Type::DELIMITED;
+    }
+    if (value == "fixed")
+    {
+      return ExtSort::ChunksFormat::Type::FIXED_SIZE;
+    }
+    if (value == "varint")
+    {
+      return ExtSort::ChunksFormat::Type::VARINT_PREFIXED;
+    }
+    ERR_THROW_TYPED(std::invalid_argument, "Bad records format (value = '" + value + "').");
+    return ExtSort::ChunksFormat::Type::DELIMITED;
+  }
+
+  Utils::Log::Level ParseLogLevel(const std::string& value)
+  {
+    if (value == "error")
+    {
+      return Utils::Log::LOG_LEVEL_ERROR;
+    }
+    if (value == "warning")
+    {
+      return Utils::Log::LOG_LEVEL_WARNING;
+    }
+    if (value == "info")
+    {
+      return Utils::Log::LOG_LEVEL_INFO;
+    }
+    if (value == "debug")
+    {
+      return Utils::Log::LOG_LEVEL_DEBUG;
+    }
+    ERR_THROW_TYPED(std::invalid_argument, "Bad log level (value = '" + value + "').");
+    return Utils::Log::LOG_LEVEL_INFO;
+  }
+
+  ExtSort::JoinType ParseJoinType(const std::string& value)
+  {
+    if (value == "inner")
+    {
+      return ExtSort::JoinType::INNER;
+    }
+    if (value == "left")
+    {
+      return ExtSort::JoinType::LEFT;
+    }
+    ERR_THROW_TYPED(std::invalid_argument, "Bad join type (value = '" + value + "').");
+    return ExtSort::JoinType::INNER;
+  }
+
+  ExtSort::Aggregation::Type ParseAggregationType(const std::string& value)
+  {
+    if (value == "none")
+    {
+      return ExtSort::Aggregation::Type::NONE;
+    }
+    if (value == "count")
+    {
+      return ExtSort::Aggregation::Type::COUNT;
+    }
+    if (value == "sum")
+    {
+      return ExtSort::Aggregation::Type::SUM;
+    }
+    ERR_THROW_TYPED(std::invalid_argument, "Bad aggregate (value = '" + value + "').");
+    return ExtSort::Aggregation::Type::NONE;
+  }
+
   struct LogHolder
   {
     ~LogHolder()
@@ -132,6 +497,10 @@ namespace
   template <class Container>
   void LogSortedFiles(const Container& sortedFiles)
   {
+    if (!Utils::Log::IsEnabled(Utils::Log::LOG_LEVEL_INFO))
+    {
+      return;
+    }
     std::ostringstream oss;
     oss << "Sorted files (" << sortedFiles.size() << "):" << std::endl;
     for (const auto& file : sortedFiles)
@@ -141,8 +510,55 @@ namespace
     Utils::Log::GetLogger().Add(oss.str().c_str(), Utils::Log::LOG_LEVEL_INFO);
   }
 
+  // The peak RSS includes the code, the stacks and the worker processes, so it is compared with the budget, not enforced.
+  // The RSS of the start is not a part of the budget, and the code paged in later still adds a few Mb,
+  // so an excess is not a warning.
+  void LogMemoryUsage(std::uint64_t startMemory, std::uint64_t memoryLimit)
+  {
+    const auto peakMemory = Utils::Metrics::GetPeakMemoryUsage();
+    LOG_I("Peak memory: RSS = %s, start RSS = %s, heap = %s, limit = %s",
+      std::to_string(peakMemory).c_str(),
+      std::to_string(startMemory).c_str(),
+      std::to_string(Utils::Memory::GetPeakHeapBytes()).c_str(),
+      std::to_string(memoryLimit).c_str());
+    if (peakMemory > startMemory + memoryLimit)
+    {
+      LOG_I("Peak RSS exceeds the start RSS and %s by %s bytes", ARG_MAX_MEMORY_USAGE_MB, std::to_string(peakMemory - startMemory - memoryLimit).c_str());
+    }
+  }
+
+  // The merge compare time is the part of the merge tasks time which is not spent in reads and writes.
+  void WriteMetrics(const std::string& filePath, std::size_t bufferSize, std::uint64_t memoryLimit, std::chrono::system_clock::duration totalDuration)
+  {
+    {
+      Utils::Metrics::ScopedPhase metricsPhase("merge");
+      const auto taskTime = Utils::Metrics::Get("merge", "task_us");
+      const auto ioTime = Utils::Metrics::Get("merge", "read_us") + Utils::Metrics::Get("merge", "write_us");
+      if (taskTime != 0)
+      {
+        Utils::Metrics::Add("compare_us", taskTime > ioTime ? taskTime - ioTime : 0);
+      }
+    }
+
+    std::ostringstream json;
+    json << "{\"total_us\": " << std::chrono::duration_cast<std::chrono::microseconds>(totalDuration).count()
+      << ", \"peak_memory_bytes\": " << Utils::Metrics::GetPeakMemoryUsage()
+      << ", \"peak_heap_bytes\": " << Utils::Memory::GetPeakHeapBytes()
+      << ", \"memory_limit_bytes\": " << memoryLimit
+      << ", \"buffer_bytes\": " << bufferSize
+      << ", \"phases\": " << Utils::Metrics::ToJson()
+      << "}\n";
+    const auto data = json.str();
+    const auto file = Utils::Fs::OpenFile(filePath, "wb");
+    ERR_THROW_IF(fwrite(data.data(), data.size(), 1, file.get()) != 1, "Failed to write the metrics (path = '" + filePath + "').");
+    ERR_THROW_IF(fflush(file.get()) != 0, "Failed to flush the metrics (path = '" + filePath + "').");
+  }
+
   void Run(Utils::Arguments args)
   {
+    const auto startTime = std::chrono::system_clock::now();
+    const auto startMemory = Utils::Metrics::GetPeakMemoryUsage();
+
     Usage usage(args);
 
     if (usage.HasUsageRequestArg())
@@ -151,23 +567,86 @@ namespace
       return;
     }
 
+    // The coordinator reads the standard output of a worker, so a worker logs to the standard error.
+    if (usage.GetArgument<std::string>(ARG_MODE) == "worker")
+    {
+      Utils::Log::SetLogger(Utils::Log::CreateOutStreamLogger(std::cerr));
+    }
+    Utils::Log::SetLevel(ParseLogLevel(usage.GetArgument<std::string>(ARG_LOG_LEVEL)));
+
     usage.LogArgs();
 
+    Mode mode = Mode::SORT;
     std::string inputFilePath;
     std::string outputFilePath;
     std::string tempDirPath;
     std::size_t maxMemoryUsageMb;
+    std::size_t maxHeapUsageMb = 0;
     std::size_t maxWriteBufferKb;
     bool removeTempFiles = false;
+    std::size_t recordSize = 0;
+    std::size_t keyOffset = 0;
+    std::size_t keySize = 0;
+    std::string joinInputFilePath;
+    ExtSort::JoinType joinType = ExtSort::JoinType::INNER;
+    ExtSort::SortOptions options;
+    std::size_t workersCount = 0;
+    Utils::Fs::Size inputBegin = 0;
+    Utils::Fs::Size inputEnd = 0;
+    std::string lookupKey;
+    std::string appendFilePath;
+    bool checkpointing = false;
+    std::string resumeTempDirPath;
+    std::size_t mergeFanIn = 0;
+    std::size_t threadsCount = 0;
+    std::string checksumInputFilePath;
+    std::string metricsFilePath;
+    std::string traceFilePath;
+    bool hugePages = false;
 
     try
     {
+      mode             = ParseMode(usage.GetArgument<std::string>(ARG_MODE));
       inputFilePath    = usage.GetArgument<std::string>(ARG_INPUT_FILE_PATH);
-      outputFilePath   = usage.GetArgument<std::string>(ARG_OUTPUT_FILE_PATH);
+      if (mode != Mode::WORKER && mode != Mode::VERIFY)
+      {
+        outputFilePath = usage.GetArgument<std::string>(ARG_OUTPUT_FILE_PATH);
+      }
       tempDirPath      = usage.GetArgument<std::string>(ARG_TEMP_DIR_PATH);
       maxMemoryUsageMb = usage.GetArgument<std::size_t>(ARG_MAX_MEMORY_USAGE_MB);
+      maxHeapUsageMb   = usage.GetArgument<std::size_t>(ARG_MAX_HEAP_USAGE_MB);
       maxWriteBufferKb = usage.GetArgument<std::size_t>(ARG_MAX_WRITE_BUFFER_KB);
       removeTempFiles  = usage.GetArgument<bool>(ARG_REMOVE_TEMP_FILES);
+      options.limit           = usage.GetArgument<std::size_t>(ARG_LIMIT);
+      options.unique          = usage.GetArgument<bool>(ARG_UNIQUE);
+      options.key.fields      = ParseKeyFields(usage.GetArgument<std::string>(ARG_KEY));
+      options.key.fieldsDelim = ParseChar(usage.GetArgument<std::string>(ARG_FIELD_DELIM));
+      options.key.type        = ParseKeyType(usage.GetArgument<std::string>(ARG_KEY_TYPE));
+      options.key.reverse     = usage.GetArgument<bool>(ARG_REVERSE);
+      options.stable          = usage.GetArgument<bool>(ARG_STABLE);
+      options.format.type     = ParseRecordsFormat(usage.GetArgument<std::string>(ARG_RECORDS_FORMAT));
+      recordSize              = usage.GetArgument<std::size_t>(ARG_RECORD_SIZE);
+      keyOffset               = usage.GetArgument<std::size_t>(ARG_KEY_OFFSET);
+      keySize                 = usage.GetArgument<std::size_t>(ARG_KEY_SIZE);
+      joinInputFilePath       = usage.GetArgument<std::string>(ARG_JOIN_INPUT);
+      joinType                = ParseJoinType(usage.GetArgument<std::string>(ARG_JOIN_TYPE));
+      options.aggregation.type       = ParseAggregationType(usage.GetArgument<std::string>(ARG_AGGREGATE));
+      options.aggregation.valueField = usage.GetArgument<std::size_t>(ARG_VALUE_FIELD);
+      options.shards                 = usage.GetArgument<std::size_t>(ARG_OUTPUT_SHARDS);
+      workersCount                   = usage.GetArgument<std::size_t>(ARG_WORKERS);
+      inputBegin                     = usage.GetArgument<Utils::Fs::Size>(ARG_INPUT_BEGIN);
+      inputEnd                       = usage.GetArgument<Utils::Fs::Size>(ARG_INPUT_END);
+      options.indexStep              = usage.GetArgument<std::size_t>(ARG_INDEX_STEP);
+      lookupKey                      = usage.GetArgument<std::string>(ARG_LOOKUP_KEY);
+      appendFilePath                 = usage.GetArgument<std::string>(ARG_APPEND);
+      checkpointing                  = usage.GetArgument<bool>(ARG_CHECKPOINT);
+      resumeTempDirPath              = usage.GetArgument<std::string>(ARG_RESUME);
+      mergeFanIn                     = usage.GetArgument<std::size_t>(ARG_MERGE_FAN_IN);
+      threadsCount                   = usage.GetArgument<std::size_t>(ARG_THREADS);
+      checksumInputFilePath          = usage.GetArgument<std::string>(ARG_CHECKSUM_INPUT);
+      metricsFilePath                = usage.GetArgument<std::string>(ARG_METRICS_FILE);
+      traceFilePath                  = usage.GetArgument<std::string>(ARG_TRACE_FILE);
+      hugePages                      = usage.GetArgument<bool>(ARG_HUGE_PAGES);
     }
     catch (...)
     {
@@ -176,58 +655,343 @@ namespace
       return;
     }
 
+    // The results of a resumed sort are partial, they are overwritten.
+    const auto resume = !resumeTempDirPath.empty();
     ERR_THROW_IF_NOT(Utils::Fs::IsExists(inputFilePath)   , "Input file not exists (path = '" + inputFilePath + "').");
-    ERR_THROW_IF_NOT(!Utils::Fs::IsExists(outputFilePath) , "Output file already exists (path = '" + outputFilePath + "').");
+    ERR_THROW_IF_NOT(mode == Mode::WORKER || mode == Mode::VERIFY || resume || !Utils::Fs::IsExists(outputFilePath), "Output file already exists (path = '" + outputFilePath + "').");
     ERR_THROW_IF_NOT(maxMemoryUsageMb >= 1                , std::string(ARG_MAX_MEMORY_USAGE_MB) + " should be >= 1.");
+    ERR_THROW_IF_NOT(maxHeapUsageMb < maxMemoryUsageMb    , std::string(ARG_MAX_HEAP_USAGE_MB) + " should be < " + ARG_MAX_MEMORY_USAGE_MB + ".");
     ERR_THROW_IF_NOT(maxWriteBufferKb >= 1                , std::string(ARG_MAX_WRITE_BUFFER_KB) + " should be >= 1.");
+    ERR_THROW_IF(options.key.fields.size() > ExtSort::MAX_KEY_FIELDS, "Too many key fields (max = " + std::to_string(ExtSort::MAX_KEY_FIELDS) + ").");
+    ERR_THROW_IF(options.format.type == ExtSort::ChunksFormat::Type::DELIMITED && options.key.fieldsDelim == options.format.delim, std::string(ARG_FIELD_DELIM) + " should differ from the lines delimiter.");
+    ERR_THROW_IF(options.key.type != ExtSort::KeyType::STRING && options.key.fields.size() > 1, std::string(ARG_KEY_TYPE) + " requires a single key field.");
+    const auto fixedSize = options.format.type == ExtSort::ChunksFormat::Type::FIXED_SIZE;
+    ERR_THROW_IF(fixedSize != (recordSize != 0), std::string(ARG_RECORD_SIZE) + " should be set for the fixed records format only.");
+    if (fixedSize)
+    {
+      ERR_THROW_IF(!options.key.fields.empty(), std::string(ARG_KEY) + " is not supported for fixed width records, use " + ARG_KEY_OFFSET + " and " + ARG_KEY_SIZE + ".");
+      ERR_THROW_IF(options.key.type != ExtSort::KeyType::STRING, std::string(ARG_KEY_TYPE) + " is not supported for fixed width records.");
+      ERR_THROW_IF(keyOffset >= recordSize, std::string(ARG_KEY_OFFSET) + " should be less than " + ARG_RECORD_SIZE + ".");
+      ERR_THROW_IF(keyOffset + keySize > recordSize, "The key should be within the record.");
+
+      options.format.chunkSize = recordSize;
+      options.key.rangeOffset = keyOffset;
+      options.key.rangeSize = keySize != 0 ? keySize : recordSize - keyOffset;
+    }
+    else
+    {
+      ERR_THROW_IF(keyOffset != 0 || keySize != 0, std::string(ARG_KEY_OFFSET) + " and " + ARG_KEY_SIZE + " are supported for fixed width records only.");
+    }
+
+    if (options.aggregation.type != ExtSort::Aggregation::Type::NONE)
+    {
+      ERR_THROW_IF(options.format.type != ExtSort::ChunksFormat::Type::DELIMITED, std::string(ARG_AGGREGATE) + " is supported for lines only.");
+      ERR_THROW_IF(options.unique, std::string(ARG_AGGREGATE) + " cannot be combined with " + ARG_UNIQUE + ".");
+      ERR_THROW_IF(mode == Mode::JOIN, std::string(ARG_AGGREGATE) + " is not supported in the join mode.");
+    }
+    ERR_THROW_IF((options.aggregation.type == ExtSort::Aggregation::Type::SUM) != (options.aggregation.valueField != 0), std::string(ARG_VALUE_FIELD) + " should be set for the sum aggregate only.");
+
+    if (mode == Mode::JOIN)
+    {
+      ERR_THROW_IF_NOT(Utils::Fs::IsExists(joinInputFilePath), "Join input file not exists (path = '" + joinInputFilePath + "').");
+      ERR_THROW_IF(options.limit != 0, std::string(ARG_LIMIT) + " is not supported in the join mode.");
+      ERR_THROW_IF(options.unique, std::string(ARG_UNIQUE) + " is not supported in the join mode.");
+      ERR_THROW_IF(fixedSize, "Fixed width records are not supported in the join mode.");
+    }
+
+    if (options.indexStep != 0)
+    {
+      ERR_THROW_IF(mode == Mode::JOIN, std::string(ARG_INDEX_STEP) + " is not supported in the join mode.");
+      ERR_THROW_IF(mode == Mode::SORT && !resume && Utils::Fs::IsExists(ExtSort::GetSparseIndexFilePath(outputFilePath)), "Index file already exists (path = '" + ExtSort::GetSparseIndexFilePath(outputFilePath) + "').");
+    }
+    ERR_THROW_IF(mode != Mode::LOOKUP && !lookupKey.empty(), std::string(ARG_LOOKUP_KEY) + " is supported in the lookup mode only.");
+    if (mode == Mode::VERIFY)
+    {
+      ERR_THROW_IF(!checksumInputFilePath.empty() && !Utils::Fs::IsExists(checksumInputFilePath), "Checksum input file not exists (path = '" + checksumInputFilePath + "').");
+    }
+    else
+    {
+      ERR_THROW_IF(!checksumInputFilePath.empty(), std::string(ARG_CHECKSUM_INPUT) + " is supported in the verify mode only.");
+    }
+    if (threadsCount == 0)
+    {
+      threadsCount = (std::max)(1u, std::thread::hardware_concurrency());
+    }
+    if (!metricsFilePath.empty())
+    {
+      ERR_THROW_IF(mode != Mode::SORT && mode != Mode::JOIN && mode != Mode::WORKER, std::string(ARG_METRICS_FILE) + " is supported in the sort and join modes only.");
+      Utils::Metrics::Enable();
+    }
+    if (!traceFilePath.empty())
+    {
+      ERR_THROW_IF(mode != Mode::SORT && mode != Mode::JOIN && mode != Mode::WORKER, std::string(ARG_TRACE_FILE) + " is supported in the sort and join modes only.");
+      Utils::Trace::Enable();
+    }
+    if (!appendFilePath.empty())
+    {
+      ERR_THROW_IF(mode != Mode::SORT, std::string(ARG_APPEND) + " is supported in the sort mode only.");
+      ERR_THROW_IF_NOT(Utils::Fs::IsExists(appendFilePath), "Append file not exists (path = '" + appendFilePath + "').");
+    }
 
-    const auto uniqueTempDirPath = Utils::Fs::AppendPath(tempDirPath, std::to_string(std::chrono::system_clock::now().time_since_epoch().count()));
-    ERR_THROW_IF(Utils::Fs::IsExists(uniqueTempDirPath), "Temp dir already exists (path = '" + uniqueTempDirPath + "').");
-    Utils::Fs::EnsureDirExists(uniqueTempDirPath);
+    if (mode == Mode::WORKER)
+    {
+      const auto inputSize = Utils::Fs::GetSize(inputFilePath);
+      if (inputEnd == 0)
+      {
+        inputEnd = inputSize;
+      }
+      ERR_THROW_IF(inputBegin > inputEnd || inputEnd > inputSize, "Bad input range (begin = " + std::to_string(inputBegin) + ", end = " + std::to_string(inputEnd) + ", file size = " + std::to_string(inputSize) + ").");
+      ERR_THROW_IF(workersCount != 0, std::string(ARG_WORKERS) + " is not supported in the worker mode.");
+    }
+    else
+    {
+      ERR_THROW_IF(inputBegin != 0 || inputEnd != 0, std::string(ARG_INPUT_BEGIN) + " and " + ARG_INPUT_END + " are supported in the worker mode only.");
+    }
+    // The workers sort at the same time, so they split the budget.
+    const auto workerMemoryUsageMb = workersCount != 0 ? maxMemoryUsageMb / workersCount : maxMemoryUsageMb;
+    ERR_THROW_IF(workerMemoryUsageMb <= maxHeapUsageMb, std::string(ARG_MAX_MEMORY_USAGE_MB) + " is too small for the " + ARG_WORKERS + " (worker budget = " + std::to_string(workerMemoryUsageMb) + " Mb, " + ARG_MAX_HEAP_USAGE_MB + " = " + std::to_string(maxHeapUsageMb) + ").");
+
+    if (resume)
+    {
+      checkpointing = true;
+      ERR_THROW_IF_NOT(Utils::Fs::IsExists(resumeTempDirPath), "Resumed temp dir not exists (path = '" + resumeTempDirPath + "').");
+    }
+    ERR_THROW_IF(checkpointing && mode != Mode::SORT && mode != Mode::JOIN, std::string(ARG_CHECKPOINT) + " and " + ARG_RESUME + " are supported in the sort and join modes only.");
+    ERR_THROW_IF(mergeFanIn == 1, std::string(ARG_MERGE_FAN_IN) + " should be 0 or >= 2.");
+    if (mergeFanIn == 0 && checkpointing)
+    {
+      mergeFanIn = CHECKPOINT_MERGE_FAN_IN;
+    }
 
-    const auto maxMemoryUsageB = maxMemoryUsageMb << 20;
+    std::vector<std::string> shardFilePaths;
+    ERR_THROW_IF_NOT(options.shards >= 1, std::string(ARG_OUTPUT_SHARDS) + " should be >= 1.");
+    if (options.shards > 1 && mode != Mode::WORKER && mode != Mode::VERIFY)
+    {
+      ERR_THROW_IF(mode == Mode::JOIN, std::string(ARG_OUTPUT_SHARDS) + " is not supported in the join mode.");
+      ERR_THROW_IF(options.limit != 0, std::string(ARG_OUTPUT_SHARDS) + " cannot be combined with " + ARG_LIMIT + ".");
+      for (std::size_t shard = 0; shard != options.shards; ++shard)
+      {
+        shardFilePaths.push_back(outputFilePath + "." + std::to_string(shard));
+        ERR_THROW_IF_NOT(resume || !Utils::Fs::IsExists(shardFilePaths.back()), "Output file already exists (path = '" + shardFilePaths.back() + "').");
+      }
+      // Shards are merged by several threads, which log without waiting for the output.
+      Utils::Log::SetLogger(Utils::Log::CreateThreadsafeAsyncLogger(Utils::Log::CreateCoutLogger()));
+    }
+
+    // The heap reserve is a part of the budget, so the buffer and the heap together stay within it.
+    const auto bufferSizeB = (maxMemoryUsageMb - maxHeapUsageMb) << 20;
+    const auto memoryLimit = static_cast<std::uint64_t>(maxMemoryUsageMb) << 20;
     const auto maxWriteBufferB = maxWriteBufferKb << 10;
 
-    const auto mallocDeleter = [](void* ptr)
+    // The sorter accesses the buffer randomly, huge pages reduce its TLB misses.
+    // The buffer is not touched while workers sort, so it takes no memory until the merge.
+    const auto bufferPtr = Utils::CreatePageBuffer(bufferSizeB, hugePages);
+    if (hugePages && workersCount == 0)
+    {
+      LOG_SCOPE_I("Prefault buffer");
+      LOG_I("Pages: %s", Utils::ToString(bufferPtr->GetPages()));
+      Utils::PrefaultPages(bufferPtr->GetData(), bufferPtr->GetSize(), threadsCount);
+    }
+    Utils::Memory::SetHeapLimit(static_cast<std::uint64_t>(maxHeapUsageMb) << 20);
+
+    ExtSort::BytesChunk buffer;
+    buffer.begin = (ExtSort::BytesChunk::ObjType*)bufferPtr->GetData();
+    buffer.end = buffer.begin + bufferSizeB / ExtSort::BytesChunk::SizeOfObject();
+
+    if (mode == Mode::LOOKUP)
+    {
+      LOG_SCOPE_I("LOOKUP");
+      const auto found = ExtSort::LookupSortedFile(inputFilePath, lookupKey, buffer, maxWriteBufferB, outputFilePath, options);
+      LOG_I("Found chunks = %s", std::to_string(found).c_str());
+      LOG_I("DONE");
+      LOG_I("RESULT: %s", outputFilePath.c_str());
+      return;
+    }
+
+    if (mode == Mode::VERIFY)
+    {
+      LOG_SCOPE_I("VERIFY");
+      const auto result = ExtSort::VerifySortedFile(inputFilePath, buffer, threadsCount, options);
+      LOG_I("Chunks = %s", std::to_string(result.chunksCount).c_str());
+      ERR_THROW_IF_NOT(result.sorted, "File is not sorted (first unsorted chunk number = " + std::to_string(result.unsortedChunkIndex + 1) + ").");
+      if (!checksumInputFilePath.empty())
+      {
+        const auto inputChecksum = ExtSort::GetChunksChecksum(checksumInputFilePath, buffer, threadsCount, options.format);
+        ERR_THROW_IF(inputChecksum != result.checksum, "Checksum mismatch (input = '" + checksumInputFilePath + "').");
+        LOG_I("Checksum matches the input.");
+      }
+      LOG_I("DONE");
+      return;
+    }
+
+    const auto uniqueTempDirPath = resume
+      ? resumeTempDirPath
+      : Utils::Fs::AppendPath(tempDirPath, std::to_string(std::chrono::system_clock::now().time_since_epoch().count()));
+    if (!resume)
+    {
+      ERR_THROW_IF(Utils::Fs::IsExists(uniqueTempDirPath), "Temp dir already exists (path = '" + uniqueTempDirPath + "').");
+      Utils::Fs::EnsureDirExists(uniqueTempDirPath);
+    }
+
+    std::unique_ptr<ExtSort::Checkpoint> checkpoint;
+    if (checkpointing)
     {
-      if (ptr)
+      LOG_SCOPE_I("CHECKPOINT");
+      LOG_I("Temp dir: '%s'", uniqueTempDirPath.c_str());
+      checkpoint = std::make_unique<ExtSort::Checkpoint>(uniqueTempDirPath, buffer);
+      if (resume)
       {
-        free(ptr);
+        ERR_THROW_IF_NOT(checkpoint->IsResumed(), "Resumed temp dir has no manifest (path = '" + uniqueTempDirPath + "').");
+        ERR_THROW_IF(checkpoint->IsDone(), "Resumed sort is already done (temp dir = '" + uniqueTempDirPath + "').");
+        ERR_THROW_IF(checkpoint->GetOutputFilePath() != outputFilePath, "Resumed sort has another output (path = '" + checkpoint->GetOutputFilePath() + "').");
+
+        const auto resultFilePaths = shardFilePaths.empty() ? std::vector<std::string>{ outputFilePath } : shardFilePaths;
+        for (const auto& resultFilePath : resultFilePaths)
+        {
+          for (const auto& filePath : { resultFilePath, ExtSort::GetSparseIndexFilePath(resultFilePath) })
+          {
+            if (Utils::Fs::IsExists(filePath))
+            {
+              LOG_I("Remove partial result: '%s'", filePath.c_str());
+              Utils::Fs::RemoveFile(filePath);
+            }
+          }
+        }
       }
+      else
+      {
+        checkpoint->SetOutputFilePath(outputFilePath);
+      }
+    }
+
+    const auto createSorter = [&](const std::string& fileNamePrefix)
+    {
+      if (workersCount != 0)
+      {
+        // Workers get the same arguments except the ones describing the files and the budget.
+        const auto workerCommandBuilder = [&, fileNamePrefix](const std::string& filePath, const Utils::Fs::FileRange& range, std::size_t workerIndex)
+        {
+          std::vector<std::string> command;
+          command.push_back(usage.GetArgument<std::string>(ARG_APP_PATH));
+          command.push_back(std::string(ARG_MODE) + "=worker");
+          command.push_back(std::string(ARG_INPUT_FILE_PATH) + "=" + filePath);
+          command.push_back(std::string(ARG_INPUT_BEGIN) + "=" + std::to_string(range.begin));
+          command.push_back(std::string(ARG_INPUT_END) + "=" + std::to_string(range.end));
+          command.push_back(std::string(ARG_TEMP_DIR_PATH) + "=" + Utils::Fs::AppendPath(uniqueTempDirPath, fileNamePrefix + "_worker_" + std::to_string(workerIndex)));
+          command.push_back(std::string(ARG_MAX_MEMORY_USAGE_MB) + "=" + std::to_string(workerMemoryUsageMb));
+          for (const auto& arg : usage.GetAllArguments())
+          {
+            const auto& name = arg.first;
+            if (name != ARG_APP_PATH && name != ARG_MODE && name != ARG_INPUT_FILE_PATH && name != ARG_OUTPUT_FILE_PATH && name != ARG_TEMP_DIR_PATH
+              && name != ARG_WORKERS && name != ARG_INPUT_BEGIN && name != ARG_INPUT_END && name != ARG_JOIN_INPUT && name != ARG_APPEND
+              && name != ARG_CHECKPOINT && name != ARG_RESUME && name != ARG_MAX_MEMORY_USAGE_MB)
+            {
+              command.push_back(name + "=" + arg.second);
+            }
+          }
+          return command;
+        };
+        return ExtSort::CreateWorkersSorter(workerCommandBuilder, workersCount, options);
+      }
+
+      auto filePathsEnumerator = Utils::Fs::CreateSimpleFilePathsEnumerator(uniqueTempDirPath, fileNamePrefix, "");
+      return fixedSize
+        ? ExtSort::CreateFixedRecordsSorter(std::move(filePathsEnumerator), buffer, maxWriteBufferB, options)
+        : ExtSort::CreateMergeSortSorter(std::move(filePathsEnumerator), buffer, maxWriteBufferB, options);
     };
-    std::unique_ptr<void, decltype(mallocDeleter)> bufferPtr(malloc(maxMemoryUsageB), mallocDeleter);
-    ERR_THROW_IF_NOT(bufferPtr, "Failed to allocate " + std::to_string(maxMemoryUsageMb) + "Mb.");
-    
-    ExtSort::BytesChunk buffer;
-    buffer.begin = (ExtSort::BytesChunk::ObjType*)bufferPtr.get();
-    buffer.end = buffer.begin + maxMemoryUsageB / ExtSort::BytesChunk::SizeOfObject();
 
-    const char linesDelim = '\n';
+    if (mode == Mode::WORKER)
+    {
+      LOG_SCOPE_I("SORT");
+      // The metrics and the trace are reported to the coordinator with the runs.
+      Utils::Metrics::ScopedPhase metricsPhase("sort");
+      const auto sorter = createSorter("sort");
+      const auto sortedFiles = sorter->Sort(inputFilePath, Utils::Fs::FileRange{ inputBegin, inputEnd });
+      LogSortedFiles(sortedFiles);
+      ExtSort::WriteWorkerResult(sortedFiles, sorter->GetSplitters(), std::cout);
+      // The coordinator merges and removes the runs.
+      LOG_I("DONE");
+      return;
+    }
 
-    std::set<std::string> sortedFiles;
+    std::vector<std::string> splitters;
+    const auto sortFile = [&](const std::string& filePath, const std::string& fileNamePrefix)
     {
       LOG_SCOPE_I("SORT");
-      auto filePathsEnumerator = Utils::Fs::CreateSimpleFilePathsEnumerator(uniqueTempDirPath, "sort", "");
-      const auto sorter = ExtSort::CreateMergeSortSorter(
-        std::move(filePathsEnumerator), buffer, maxWriteBufferB, linesDelim);
-      sortedFiles = sorter->Sort(inputFilePath);
+      Utils::Metrics::ScopedPhase metricsPhase(fileNamePrefix);
+      std::vector<std::string> sortedFiles;
+      if (checkpoint && checkpoint->GetSortedFiles(fileNamePrefix, sortedFiles, splitters))
+      {
+        LOG_I("Sorted files are restored from the checkpoint.");
+        LogSortedFiles(sortedFiles);
+        return sortedFiles;
+      }
+
+      const auto sorter = createSorter(fileNamePrefix);
+      sortedFiles = sorter->Sort(filePath);
+      splitters = sorter->GetSplitters();
+      LogSortedFiles(sortedFiles);
+      if (checkpoint)
+      {
+        checkpoint->AddSortedFiles(fileNamePrefix, sortedFiles, splitters);
+      }
+      return sortedFiles;
+    };
+
+    auto sortedFiles = sortFile(inputFilePath, "sort");
+    if (!appendFilePath.empty())
+    {
+      // The sorted file goes first, so the stable order puts the new chunks after the old ones.
+      sortedFiles.insert(sortedFiles.begin(), appendFilePath);
     }
 
-    LogSortedFiles(sortedFiles);
+    if (mode == Mode::JOIN)
+    {
+      const auto joinSortedFiles = sortFile(joinInputFilePath, "join_sort");
 
+      LOG_SCOPE_I("JOIN");
+      Utils::Metrics::ScopedPhase metricsPhase("join");
+      // The checkpointed runs are kept until the sort is done.
+      auto filePathsEnumerator = Utils::Fs::CreateSimpleFilePathsEnumerator(uniqueTempDirPath, "join", "");
+      const auto joiner = ExtSort::CreateSortMergeJoiner(std::move(filePathsEnumerator), buffer, maxWriteBufferB, removeTempFiles && !checkpoint, options, joinType);
+      joiner->Join(sortedFiles, joinSortedFiles, outputFilePath);
+    }
+    else
     {
       LOG_SCOPE_I("MERGE");
+      Utils::Metrics::ScopedPhase metricsPhase("merge");
       auto filePathsEnumerator = Utils::Fs::CreateSimpleFilePathsEnumerator(uniqueTempDirPath, "merge", "");
       auto merger = ExtSort::CreateMultiFilesPerPhaseMerger(
         std::move(filePathsEnumerator),
         buffer,
-        sortedFiles.size(),
+        // The shards are split in a single phase.
+        mergeFanIn != 0 && shardFilePaths.empty() ? mergeFanIn : sortedFiles.size(),
         maxWriteBufferB,
-        linesDelim,
-        removeTempFiles);
-      merger->Merge(sortedFiles, outputFilePath);
+        // The runs are removed with the temp dir, the append file is kept.
+        removeTempFiles && appendFilePath.empty() && !checkpoint,
+        options);
+      if (checkpoint)
+      {
+        sortedFiles = checkpoint->GetMergeSources(sortedFiles);
+        merger->SetObserver([&](const std::vector<std::string>& sourceFilePaths, const std::string& resultFilePath)
+        {
+          checkpoint->AddMergeTask(sourceFilePaths, resultFilePath);
+        });
+      }
+      if (shardFilePaths.empty())
+      {
+        merger->Merge(sortedFiles, outputFilePath);
+      }
+      else
+      {
+        merger->Merge(sortedFiles, splitters, shardFilePaths);
+      }
     }
 
+    if (checkpoint)
+    {
+      checkpoint->SetDone();
+    }
 
     if (removeTempFiles)
     {
@@ -235,8 +999,30 @@ namespace
       Utils::Fs::RemoveDir(uniqueTempDirPath);
     }
 
+    if (!metricsFilePath.empty())
+    {
+      LOG_I("Write metrics: '%s'", metricsFilePath.c_str());
+      WriteMetrics(metricsFilePath, buffer.BytesCount(), memoryLimit, std::chrono::system_clock::now() - startTime);
+    }
+    if (!traceFilePath.empty())
+    {
+      LOG_I("Write trace: '%s'", traceFilePath.c_str());
+      Utils::Trace::WriteJson(traceFilePath);
+    }
+
+    LogMemoryUsage(startMemory, memoryLimit);
     LOG_I("DONE");
-    LOG_I("RESULT: %s", outputFilePath.c_str());
+    if (shardFilePaths.empty())
+    {
+      LOG_I("RESULT: %s", outputFilePath.c_str());
+    }
+    else
+    {
+      for (const auto& shardFilePath : shardFilePaths)
+      {
+        LOG_I("RESULT: %s", shardFilePath.c_str());
+      }
+    }
   }
 }
 
@@ -252,6 +1038,8 @@ int Run(int argc, char** argv)
   }
   catch (...)
   {
+    // The failure may be the heap limit, which would fail the logging too.
+    Utils::Memory::SetHeapLimit(0);
     Utils::Log::LogCurrentException("FAILED");
   }
   return result;
@@ -159,6 +159,17 @@ namespace Fs
     return std::move(file);
   }
 
+  void SeekFile(FILE* file, Size offset)
+  {
+    ERR_THROW_IF(file == nullptr, "Invalid argument (file is null).");
+    #ifdef PREDEF_OS_WINDOWS
+      const auto err = _fseeki64(file, offset, SEEK_SET);
+    #else
+      const auto err = fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+    #endif
+    ERR_THROW_IF(err != 0, "Failed to seek file (offset = " + std::to_string(offset) + ").");
+  }
+
   void EnsureDirExists(const std::string& path)
   {
     // TODO: do not use system.
@@ -23,12 +23,25 @@ namespace Utils
     typedef std::streamsize Size;
     static_assert(sizeof(Size) >= 8, "Bad stream size type.");
 
+    // Bytes [begin, end) of a file.
+    struct FileRange
+    {
+      Size begin;
+      Size end;
+
+      Size GetSize() const
+      {
+        return end - begin;
+      }
+    };
+
     char GetPathSeparator();
     bool IsPathSeparator(char ch);
     std::string AppendPath(const std::string& parent, const std::string& child);
     bool IsExists(const std::string& path);
     Size GetSize(const std::string& path);
     FileUniquePtr OpenFile(const std::string& filePath, const char* mode);
+    void SeekFile(FILE* file, Size offset);
     void EnsureDirExists(const std::string& path);
     void MoveFile(const std::string& source, const std::string& target);
     void RemoveFile(const std::string& filePath);
@@ -0,0 +1,102 @@
+﻿#ifndef __UTILS_HASH_H__
+#define __UTILS_HASH_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Utils
+{
+  // A streaming non-cryptographic 64-bit hash consuming 8-byte words, used to detect damaged files.
+  // The result does not depend on how the data is split into updates.
+  class Hash64
+  {
+    static const std::uint64_t PRIME_1 = 0x9e3779b185ebca87ULL;
+    static const std::uint64_t PRIME_2 = 0xc2b2ae3d27d4eb4fULL;
+
+    std::uint64_t m_state;
+    std::uint64_t m_size;
+    unsigned char m_tail[sizeof(std::uint64_t)];
+    std::size_t m_tailSize;
+
+  public:
+    explicit Hash64(std::uint64_t seed = 0)
+      : m_state(seed ^ PRIME_1)
+      , m_size(0)
+      , m_tailSize(0)
+    {
+    }
+
+    void Update(const void* data, std::size_t size)
+    {
+      const auto* bytes = static_cast<const unsigned char*>(data);
+      m_size += size;
+
+      if (m_tailSize != 0)
+      {
+        const auto toCopy = size < sizeof(m_tail) - m_tailSize ? size : sizeof(m_tail) - m_tailSize;
+        std::memcpy(m_tail + m_tailSize, bytes, toCopy);
+        m_tailSize += toCopy;
+        bytes += toCopy;
+        size -= toCopy;
+        if (m_tailSize != sizeof(m_tail))
+        {
+          return;
+        }
+        AddWord(LoadWord(m_tail));
+        m_tailSize = 0;
+      }
+
+      for (; size >= sizeof(std::uint64_t); bytes += sizeof(std::uint64_t), size -= sizeof(std::uint64_t))
+      {
+        AddWord(LoadWord(bytes));
+      }
+
+      std::memcpy(m_tail, bytes, size);
+      m_tailSize = size;
+    }
+
+    std::uint64_t GetValue() const
+    {
+      auto state = m_state;
+      if (m_tailSize != 0)
+      {
+        unsigned char word[sizeof(std::uint64_t)] = {};
+        std::memcpy(word, m_tail, m_tailSize);
+        state = Mix(state, LoadWord(word));
+      }
+      state ^= m_size;
+
+      state ^= state >> 33;
+      state *= PRIME_2;
+      state ^= state >> 29;
+      state *= PRIME_1;
+      state ^= state >> 32;
+      return state;
+    }
+
+  private:
+    static std::uint64_t LoadWord(const unsigned char* bytes)
+    {
+      std::uint64_t word;
+      std::memcpy(&word, bytes, sizeof(word));
+      return word;
+    }
+
+    static std::uint64_t Mix(std::uint64_t state, std::uint64_t word)
+    {
+      word *= PRIME_2;
+      word = (word << 31) | (word >> 33);
+      word *= PRIME_1;
+      state ^= word;
+      return ((state << 27) | (state >> 37)) * PRIME_1 + PRIME_2;
+    }
+
+    void AddWord(std::uint64_t word)
+    {
+      m_state = Mix(m_state, word);
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,52 @@
+﻿#ifndef __UTILS_HEX_H__
+#define __UTILS_HEX_H__
+
+#include <utils/err.h>
+
+#include <algorithm>
+#include <string>
+
+namespace Utils
+{
+  inline std::string EncodeHex(const std::string& data)
+  {
+    const char* const digits = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(data.size() * 2);
+    for (const auto ch : data)
+    {
+      const auto byte = static_cast<unsigned char>(ch);
+      hex += digits[byte >> 4];
+      hex += digits[byte & 0xf];
+    }
+    return hex;
+  }
+
+  inline std::string DecodeHex(const std::string& hex)
+  {
+    const auto digit = [&hex](char ch) -> int
+    {
+      if (ch >= '0' && ch <= '9')
+      {
+        return ch - '0';
+      }
+      if (ch >= 'a' && ch <= 'f')
+      {
+        return ch - 'a' + 10;
+      }
+      ERR_THROW("Bad hex string (value = '" + hex + "').");
+      return 0;
+    };
+
+    ERR_THROW_IF(hex.size() % 2 != 0, "Bad hex string (value = '" + hex + "').");
+    std::string data;
+    data.reserve(hex.size() / 2);
+    for (std::size_t i = 0; i != hex.size(); i += 2)
+    {
+      data += static_cast<char>(digit(hex[i]) << 4 | digit(hex[i + 1]));
+    }
+    return data;
+  }
+}
+
+#endif
@@ -3,6 +3,7 @@
 #include <utils/log/log.h>
 #include <utils/log/log_registry.h>
 
+#include <atomic>
 #include <cstdio>
 #include <cstdarg>
 
@@ -10,6 +11,21 @@ namespace Utils
 {
 namespace Log
 {
+  namespace
+  {
+    std::atomic<Level> g_level(LOG_LEVEL_DEBUG);
+  }
+
+  void SetLevel(Level level)
+  {
+    g_level.store(level, std::memory_order_relaxed);
+  }
+
+  Level GetLevel()
+  {
+    return g_level.load(std::memory_order_relaxed);
+  }
+
   void LogData(Level level, const char* fmt, ...)
   {
     char buffer[1024] = { 0 };
@@ -26,7 +42,10 @@ namespace Log
 
   void LogString(Level level, const char* str)
   {
-    Log::GetLogger().Add(str, level);
+    if (IsEnabled(level))
+    {
+      Log::GetLogger().Add(str, level);
+    }
   }
 
   void LogString(Level level, const std::string& str)
@@ -7,10 +7,26 @@
 
 #include <string>
 
+// Messages of the levels above it are removed at compile time: 0 - errors, 1 - warnings, 2 - info, 3 - debug.
+#ifndef UTILS_LOG_MAX_LEVEL
+#  define UTILS_LOG_MAX_LEVEL 3
+#endif
+
 namespace Utils
 {
   namespace Log
   {
+    const Level MAX_LEVEL = static_cast<Level>(UTILS_LOG_MAX_LEVEL);
+
+    // Messages of the levels above the runtime level are skipped before their arguments are evaluated.
+    void SetLevel(Level level);
+    Level GetLevel();
+
+    inline bool IsEnabled(Level level)
+    {
+      return level <= MAX_LEVEL && level <= GetLevel();
+    }
+
     void LogData(Level level, const char* fmt, ...);
     void LogString(Level level, const char* str);
     void LogString(Level level, const std::string& str);
@@ -37,9 +53,19 @@ namespace Utils
 #define LOG_FN LOG_SCOPE(__FUNCTION__)
 
 
-#define LOG_E(...) ::Utils::Log::LogData(::Utils::Log::LOG_LEVEL_ERROR,   __VA_ARGS__)
-#define LOG_W(...) ::Utils::Log::LogData(::Utils::Log::LOG_LEVEL_WARNING, __VA_ARGS__)
-#define LOG_I(...) ::Utils::Log::LogData(::Utils::Log::LOG_LEVEL_INFO,    __VA_ARGS__)
-#define LOG_D(...) ::Utils::Log::LogData(::Utils::Log::LOG_LEVEL_DEBUG,   __VA_ARGS__)
+#define LOG_DATA(level, ...)                     \
+  do                                             \
+  {                                              \
+    if (::Utils::Log::IsEnabled(level))          \
+    {                                            \
+      ::Utils::Log::LogData(level, __VA_ARGS__); \
+    }                                            \
+  }                                              \
+  while (false)
+
+#define LOG_E(...) LOG_DATA(::Utils::Log::LOG_LEVEL_ERROR,   __VA_ARGS__)
+#define LOG_W(...) LOG_DATA(::Utils::Log::LOG_LEVEL_WARNING, __VA_ARGS__)
+#define LOG_I(...) LOG_DATA(::Utils::Log::LOG_LEVEL_INFO,    __VA_ARGS__)
+#define LOG_D(...) LOG_DATA(::Utils::Log::LOG_LEVEL_DEBUG,   __VA_ARGS__)
 
 #endif
@@ -1,17 +1,21 @@
 ﻿#include <utils/log/loggers/threadsafe_logger.h>
 #include <utils/err.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <cstring>
 #include <map>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <sstream>
 #include <stdexcept>
 #include <thread>
 #include <utility>
+#include <vector>
 
 namespace Utils
 {
@@ -19,155 +23,208 @@ namespace Log
 {
   namespace
   {
-    struct LogItem
+    // The thread id is formatted once per thread.
+    const std::string& GetThreadIdText()
     {
+      thread_local const std::string threadIdText = []()
+      {
+        std::ostringstream oss;
+        oss << std::this_thread::get_id();
+        return oss.str();
+      }();
+      return threadIdText;
+    }
+
+    void AddLogItem(Logger& logger,
+                    const char* text,
+                    Level level,
+                    std::chrono::system_clock::time_point timePoint,
+                    const std::string& threadId,
+                    const char* meta,
+                    unsigned indent,
+                    std::string& prefix)
+    {
+      prefix.clear();
+      prefix += '[';
+      prefix += std::to_string(std::chrono::system_clock::to_time_t(timePoint));
+      prefix += "] : [";
+      prefix += threadId;
+      prefix += "] : ";
+      if (meta && *meta)
+      {
+        prefix += meta;
+        prefix += " : ";
+      }
+      logger.Add(text ? text : "(null)", level, prefix.c_str(), indent);
+    }
+
+
+    // A fixed size piece of a log message, a long message takes several consecutive records.
+    struct LogRecord
+    {
+      enum class Type : std::uint8_t
+      {
+        MESSAGE,
+        PUSH_INDENT,
+        POP_INDENT,
+      };
+
+      static const std::size_t DATA_SIZE = 224;
+
       std::chrono::system_clock::time_point timePoint;
-      std::thread::id threadId;
-      std::string meta;
-      std::string text;
+      Type type;
       Level level;
+      bool last;
+      std::uint16_t dataSize;
+      // The meta and the text of the message separated by the zero char.
+      char data[DATA_SIZE];
+    };
 
-      LogItem()
-        : timePoint(std::chrono::system_clock::now())
-        , threadId(std::this_thread::get_id())
+    // A single producer single consumer queue of the records of a thread.
+    // The producer owns m_head and the consumer owns m_tail, they are on different cache lines.
+    // A ring released by its exiting thread is reused by a new thread once the consumer drains it.
+    class LogRing
+    {
+      static const std::size_t CAPACITY = 64;
+      static const std::size_t CACHE_LINE_SIZE = 64;
+
+      std::vector<LogRecord> m_records;
+      std::string m_threadId;
+      // Used by the consumer only: the indent and the records of a message which is not pushed completely yet.
+      unsigned m_indent;
+      std::string m_message;
+      std::atomic_bool m_released;
+      char m_headPadding[CACHE_LINE_SIZE];
+      std::atomic<std::size_t> m_head;
+      char m_tailPadding[CACHE_LINE_SIZE];
+      std::atomic<std::size_t> m_tail;
+
+    public:
+      LogRing()
+        : m_records(CAPACITY)
+        , m_indent(0)
+        , m_released(false)
+        , m_head(0)
+        , m_tail(0)
       {
       }
 
-      LogItem(const char* theText, Level theLevel)
-        : timePoint(std::chrono::system_clock::now())
-        , threadId(std::this_thread::get_id())
-        , text(theText ? theText : "(null)")
-        , level(theLevel)
+      // Called by a new producer while the ring is not visible to the consumer.
+      void Acquire(const std::string& threadId)
       {
+        m_threadId = threadId;
+        m_indent = 0;
+        m_message.clear();
+        m_released = false;
       }
 
-      LogItem(const char* theMeta, const char* theText, Level theLevel)
-        : timePoint(std::chrono::system_clock::now())
-        , threadId(std::this_thread::get_id())
-        , meta(theMeta ? theMeta : "")
-        , text(theText ? theText : "(null)")
-        , level(theLevel)
+      // Called by the producer after its last push.
+      void Release()
       {
+        m_released.store(true, std::memory_order_release);
       }
 
-      LogItem(LogItem&& other)
-        : timePoint(std::move(other.timePoint))
-        , threadId(std::move(other.threadId))
-        , meta(std::move(other.meta))
-        , text(std::move(other.text))
-        , level(std::move(other.level))
+      // The consumer checks the released flag before the ring is empty, so no record of the producer is missed.
+      bool IsDrained() const
       {
+        return m_released.load(std::memory_order_acquire) && Front() == nullptr;
       }
 
-      LogItem& operator = (LogItem&& other)
+      const std::string& GetThreadId() const
       {
-        if (this != &other)
-        {
-          timePoint = std::move(other.timePoint);
-          threadId = std::move(other.threadId);
-          meta = std::move(other.meta);
-          text = std::move(other.text);
-          level = std::move(other.level);
-        }
-        return *this;
+        return m_threadId;
       }
-    };
 
-    void AddLogItem(Logger& logger, const LogItem& logItem, unsigned indent)
-    {
-      std::ostringstream oss;
-      oss << '[' << std::chrono::system_clock::to_time_t(logItem.timePoint) << "] : ";
-      oss << '[' << logItem.threadId << "] : ";
-      if (!logItem.meta.empty())
+      unsigned& GetIndent()
       {
-        oss << logItem.meta << " : ";
+        return m_indent;
       }
-      logger.Add(logItem.text.c_str(),
-                 logItem.level,
-                 oss.str().c_str(),
-                 indent);
-    }
-
 
-    class ThreadsafeAsyncLogger : public Logger
-    {
-      struct AsyncLogItem : public LogItem
+      std::string& GetMessage()
       {
-        enum class Type
-        {
-          UNKNOWN,
-          COMMAND,
-          MESSAGE,
-        };
+        return m_message;
+      }
 
-        enum class Command
-        {
-          UNKNOWN,
-          PUSH_INDENT,
-          POP_INDENT,
-        };
-
-        Type type;
-        Command command;
-
-        AsyncLogItem(Type theType, Command theCommand)
-          : LogItem()
-          , type(theType)
-          , command(theCommand)
+      // Returns nullptr when the ring is full.
+      LogRecord* BeginPush()
+      {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == CAPACITY)
         {
+          return nullptr;
         }
+        return &m_records[head % CAPACITY];
+      }
 
-        AsyncLogItem(const char* theText, Level theLevel, Type theType)
-          : LogItem(theText, theLevel)
-          , type(theType)
-          , command(Command::UNKNOWN)
-        {
-        }
+      // Returns true if the ring was empty before the push.
+      bool EndPush()
+      {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        m_head.store(head + 1, std::memory_order_release);
+        return head == m_tail.load(std::memory_order_acquire);
+      }
 
-        AsyncLogItem(const char* theMeta, const char* theText, Level theLevel, Type theType)
-          : LogItem(theMeta, theText, theLevel)
-          , type(theType)
-          , command(Command::UNKNOWN)
+      // Returns nullptr when the ring is empty.
+      const LogRecord* Front() const
+      {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
         {
+          return nullptr;
         }
+        return &m_records[tail % CAPACITY];
+      }
+
+      void Pop()
+      {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      }
+
+      LogRing(const LogRing&) = delete;
+      LogRing& operator = (const LogRing&) = delete;
+    };
 
-        AsyncLogItem(AsyncLogItem&& other)
-          : LogItem(std::move(other))
-          , type(other.type)
-          , command(other.command)
-        {
-        }
 
-        AsyncLogItem& operator = (AsyncLogItem&& other)
+    // Every producer thread writes preformatted records into its own ring, so logging takes no locks
+    // and makes no allocations after the first message of a thread. The log thread drains the rings.
+    // The order of messages is kept within a thread only.
+    class ThreadsafeAsyncLogger : public Logger
+    {
+      // The rings of a thread are found by the logger id, so a new logger at the same address is not confused with a destroyed one.
+      // The rings are released at the thread exit, a ring outlives its logger while the thread holds it.
+      struct ThreadRings
+      {
+        std::vector<std::pair<std::uint64_t, std::shared_ptr<LogRing>>> rings;
+
+        ~ThreadRings()
         {
-          LogItem::operator = (std::move(other));
-          if (this != &other)
+          for (const auto& ring : rings)
           {
-            threadId = std::move(other.threadId);
-            type = std::move(other.type);
-            command = std::move(other.command);
+            ring.second->Release();
           }
-          return *this;
         }
       };
 
-      using LogItemQueue = std::queue<AsyncLogItem>;
-      using ThreadIndentMap = std::map<std::thread::id, unsigned>;
+      static const std::chrono::milliseconds WAKEUP_PERIOD;
 
       std::unique_ptr<Logger> m_logger;
-      std::mutex m_pushQueueGuard;
+      const std::uint64_t m_id;
+      std::mutex m_ringsGuard;
+      std::vector<std::shared_ptr<LogRing>> m_rings;
+      std::vector<std::shared_ptr<LogRing>> m_freeRings;
+      std::mutex m_wakeupGuard;
       std::condition_variable m_wakeupEvent;
-      std::unique_ptr<LogItemQueue> m_pushQueue;
-      std::unique_ptr<LogItemQueue> m_popQueue;
+      std::atomic_bool m_pending;
       std::atomic_bool m_stopLogThread;
       std::thread m_logThread;
-      ThreadIndentMap m_threadIndents;
+      // Used by the log thread only.
+      std::string m_prefix;
 
     public:
       explicit ThreadsafeAsyncLogger(std::unique_ptr<Logger> logger)
         : m_logger(std::move(logger))
-        , m_pushQueue(std::make_unique<LogItemQueue>())
-        , m_popQueue(std::make_unique<LogItemQueue>())
+        , m_id(GetNextId())
+        , m_pending(false)
         , m_stopLogThread(false)
       {
         ERR_THROW_IF(m_logger.get() == nullptr, "Null logger.");
@@ -180,36 +237,147 @@ namespace Log
         m_wakeupEvent.notify_one();
         m_logThread.join();
 
-        ProcessLogs(*m_popQueue);
-        ProcessLogs(*m_pushQueue);
+        while (ProcessLogs())
+        {
+        }
       }
 
       virtual void Add(const char* log, Level level) override
       {
-        PushLogItem(AsyncLogItem(log, level, AsyncLogItem::Type::MESSAGE));
+        PushMessage(nullptr, log, level);
       }
 
       virtual void Add(const char* log, Level level, const char* meta, unsigned) override
       {
-        PushLogItem(AsyncLogItem(meta, log, level, AsyncLogItem::Type::MESSAGE));
+        PushMessage(meta, log, level);
       }
 
       virtual void PushIndent() override
       {
-        PushLogItem(AsyncLogItem(AsyncLogItem::Type::COMMAND, AsyncLogItem::Command::PUSH_INDENT));
+        PushCommand(LogRecord::Type::PUSH_INDENT);
       }
 
       virtual void PopIndent() override
       {
-        PushLogItem(AsyncLogItem(AsyncLogItem::Type::COMMAND, AsyncLogItem::Command::POP_INDENT));
+        PushCommand(LogRecord::Type::POP_INDENT);
       }
 
     private:
-      void PushLogItem(AsyncLogItem&& logItem)
+      static std::uint64_t GetNextId()
       {
-        std::lock_guard<std::mutex> guard(m_pushQueueGuard);
-        m_pushQueue->push(std::move(logItem));
-        m_wakeupEvent.notify_one();
+        static std::atomic<std::uint64_t> nextId(0);
+        return ++nextId;
+      }
+
+      LogRing& GetThreadRing()
+      {
+        thread_local ThreadRings threadRings;
+        for (const auto& threadRing : threadRings.rings)
+        {
+          if (threadRing.first == m_id)
+          {
+            return *threadRing.second;
+          }
+        }
+
+        std::lock_guard<std::mutex> guard(m_ringsGuard);
+        std::shared_ptr<LogRing> ring;
+        if (m_freeRings.empty())
+        {
+          ring = std::make_shared<LogRing>();
+        }
+        else
+        {
+          ring = std::move(m_freeRings.back());
+          m_freeRings.pop_back();
+        }
+        ring->Acquire(GetThreadIdText());
+        m_rings.push_back(ring);
+        threadRings.rings.emplace_back(m_id, ring);
+        return *ring;
+      }
+
+      // Waits for the log thread when the ring is full, so no message is lost.
+      LogRecord& BeginPush(LogRing& ring)
+      {
+        for (;;)
+        {
+          if (auto record = ring.BeginPush())
+          {
+            return *record;
+          }
+          Wakeup();
+          std::this_thread::yield();
+        }
+      }
+
+      void EndPush(LogRing& ring)
+      {
+        if (ring.EndPush())
+        {
+          Wakeup();
+        }
+      }
+
+      void Wakeup()
+      {
+        if (!m_pending.load(std::memory_order_relaxed) && !m_pending.exchange(true))
+        {
+          m_wakeupEvent.notify_one();
+        }
+      }
+
+      void PushCommand(LogRecord::Type type)
+      {
+        auto& ring = GetThreadRing();
+        auto& record = BeginPush(ring);
+        record.type = type;
+        record.last = true;
+        record.dataSize = 0;
+        EndPush(ring);
+      }
+
+      void PushMessage(const char* meta, const char* text, Level level)
+      {
+        const auto timePoint = std::chrono::system_clock::now();
+        if (!meta)
+        {
+          meta = "";
+        }
+        if (!text)
+        {
+          text = "(null)";
+        }
+        // The zero char after the meta separates it from the text.
+        const char* const parts[] = { meta, text };
+        const std::size_t partSizes[] = { strlen(meta) + 1, strlen(text) };
+
+        auto& ring = GetThreadRing();
+        std::size_t part = 0;
+        std::size_t partOffset = 0;
+        do
+        {
+          auto& record = BeginPush(ring);
+          record.timePoint = timePoint;
+          record.type = LogRecord::Type::MESSAGE;
+          record.level = level;
+          record.dataSize = 0;
+          while (part != 2 && record.dataSize != LogRecord::DATA_SIZE)
+          {
+            const auto size = (std::min)(partSizes[part] - partOffset, LogRecord::DATA_SIZE - record.dataSize);
+            memcpy(record.data + record.dataSize, parts[part] + partOffset, size);
+            record.dataSize = static_cast<std::uint16_t>(record.dataSize + size);
+            partOffset += size;
+            if (partOffset == partSizes[part])
+            {
+              ++part;
+              partOffset = 0;
+            }
+          }
+          record.last = part == 2;
+          EndPush(ring);
+        }
+        while (part != 2);
       }
 
       void LogThread()
@@ -218,14 +386,12 @@ namespace Log
         {
           while (!m_stopLogThread)
           {
-            ProcessLogs(*m_popQueue);
-
-            if (m_popQueue->empty() && !m_stopLogThread)
+            if (!ProcessLogs())
             {
-              std::unique_lock<std::mutex> guard(m_pushQueueGuard);
-              m_wakeupEvent.wait_for(guard, std::chrono::seconds(5), [this] { return !m_pushQueue->empty() || m_stopLogThread; });
-              // The m_popQueue is empty here. So the swap is correct event if the m_pushQueue is empty.
-              std::swap(m_pushQueue, m_popQueue);
+              // A wakeup may be missed between the check and the wait, the period bounds the delay.
+              std::unique_lock<std::mutex> guard(m_wakeupGuard);
+              m_wakeupEvent.wait_for(guard, WAKEUP_PERIOD, [this] { return m_pending || m_stopLogThread; });
+              m_pending = false;
             }
           }
         }
@@ -234,66 +400,99 @@ namespace Log
         }
       }
 
-      void ProcessLogs(LogItemQueue& logs)
+      std::vector<LogRing*> GetRings()
       {
-        while (!logs.empty())
+        std::lock_guard<std::mutex> guard(m_ringsGuard);
+        std::vector<LogRing*> rings;
+        for (const auto& ring : m_rings)
         {
-          ProcessLog(logs.front());
-          logs.pop();
+          rings.push_back(ring.get());
         }
+        return rings;
       }
 
-      void ProcessLog(const AsyncLogItem& logItem)
+      // Returns false if there were no logs. The drained rings of the exited threads are moved to the free list.
+      bool ProcessLogs()
       {
-        switch (logItem.type)
+        bool processed = false;
+        bool drained = false;
+        for (auto ring : GetRings())
         {
-          case AsyncLogItem::Type::COMMAND:
-            ProcessLogCommand(logItem);
-            break;
-
-          case AsyncLogItem::Type::MESSAGE:
-            ProcessLogMessage(logItem);
-            break;
-
-          default:
-            assert(!"Unexpected log item type.");
-            break;
+          processed = ProcessLogs(*ring) || processed;
+          drained = drained || ring->IsDrained();
         }
+        if (drained)
+        {
+          std::lock_guard<std::mutex> guard(m_ringsGuard);
+          const auto freeRingsBegin = std::partition(m_rings.begin(), m_rings.end(), [](const std::shared_ptr<LogRing>& ring)
+          {
+            return !ring->IsDrained();
+          });
+          m_freeRings.insert(m_freeRings.end(), freeRingsBegin, m_rings.end());
+          m_rings.erase(freeRingsBegin, m_rings.end());
+        }
+        return processed;
       }
 
-      void ProcessLogCommand(const AsyncLogItem& logItem)
+      // A message is processed when all its records are pushed.
+      bool ProcessLogs(LogRing& ring)
       {
-        switch (logItem.command)
+        bool processed = false;
+        while (const LogRecord* record = ring.Front())
         {
-          case AsyncLogItem::Command::PUSH_INDENT:
-            ++m_threadIndents[logItem.threadId];
-            break;
-
-          case AsyncLogItem::Command::POP_INDENT:
+          processed = true;
+          switch (record->type)
           {
-            unsigned& indent = m_threadIndents[logItem.threadId];
-            if (indent > 0)
-            {
-              --indent;
-            }
-            break;
+            case LogRecord::Type::PUSH_INDENT:
+              ++ring.GetIndent();
+              break;
+
+            case LogRecord::Type::POP_INDENT:
+              if (ring.GetIndent() > 0)
+              {
+                --ring.GetIndent();
+              }
+              break;
+
+            case LogRecord::Type::MESSAGE:
+              ring.GetMessage().append(record->data, record->dataSize);
+              if (record->last)
+              {
+                ProcessLogMessage(ring, *record);
+                ring.GetMessage().clear();
+              }
+              break;
+
+            default:
+              assert(!"Unexpected log record type.");
+              break;
           }
-
-          default:
-            assert(!"Unexpected log item command.");
-            break;
+          ring.Pop();
         }
+        return processed;
       }
 
-      void ProcessLogMessage(const LogItem& logItem)
+      void ProcessLogMessage(LogRing& ring, const LogRecord& lastRecord)
       {
-        AddLogItem(*m_logger, logItem, m_threadIndents[logItem.threadId]);
+        const auto& message = ring.GetMessage();
+        const auto metaEnd = message.find('\0');
+        assert(metaEnd != std::string::npos && "No meta end.");
+        AddLogItem(*m_logger,
+                   message.c_str() + metaEnd + 1,
+                   lastRecord.level,
+                   lastRecord.timePoint,
+                   ring.GetThreadId(),
+                   message.c_str(),
+                   ring.GetIndent(),
+                   m_prefix);
       }
 
       ThreadsafeAsyncLogger(const ThreadsafeAsyncLogger&) = delete;
       ThreadsafeAsyncLogger& operator = (const ThreadsafeAsyncLogger&) = delete;
     };
 
+    const std::chrono::milliseconds ThreadsafeAsyncLogger::WAKEUP_PERIOD(10);
+
 
     class ThreadsafeSyncLogger : public Logger
     {
@@ -301,6 +500,7 @@ namespace Log
 
       std::unique_ptr<Logger> m_logger;
       ThreadIndentMap m_threadIndents;
+      std::string m_prefix;
       std::mutex m_mutex;
 
     public:
@@ -312,18 +512,12 @@ namespace Log
 
       virtual void Add(const char* log, Level level) override
       {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        LogItem logItem(log, level);
-        const auto indent = m_threadIndents[logItem.threadId];
-        AddLogItem(*m_logger, std::move(logItem), indent);
+        Add(log, level, nullptr);
       }
 
       virtual void Add(const char* log, Level level, const char* meta, unsigned) override
       {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        LogItem logItem(meta, log, level);
-        const auto indent = m_threadIndents[logItem.threadId];
-        AddLogItem(*m_logger, std::move(logItem), indent);
+        Add(log, level, meta);
       }
 
       virtual void PushIndent() override
@@ -342,6 +536,16 @@ namespace Log
         }
       }
 
+    private:
+      void Add(const char* log, Level level, const char* meta)
+      {
+        const auto timePoint = std::chrono::system_clock::now();
+        const auto& threadId = GetThreadIdText();
+        std::lock_guard<std::mutex> guard(m_mutex);
+        const auto indent = m_threadIndents[std::this_thread::get_id()];
+        AddLogItem(*m_logger, log, level, timePoint, threadId, meta, indent, m_prefix);
+      }
+
       ThreadsafeSyncLogger(const ThreadsafeSyncLogger&) = delete;
       ThreadsafeSyncLogger& operator = (const ThreadsafeSyncLogger&) = delete;
     };
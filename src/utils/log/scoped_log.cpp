@@ -1,4 +1,5 @@
 ﻿#include <utils/log/scoped_log.h>
+#include <utils/log/log.h>
 #include <utils/log/log_registry.h>
 
 #include <exception>
@@ -9,9 +10,15 @@ namespace Log
 {
   ScopedLog::ScopedLog(Level level, const std::string& name, Logger* logger)
     : m_level(level)
+    , m_enabled(IsEnabled(level))
     , m_name(name)
     , m_logger(logger)
+    , m_span(name)
   {
+    if (!m_enabled)
+    {
+      return;
+    }
     Logger& log = m_logger ? *m_logger : GetLogger();
     log.Add(("+ " + m_name).c_str(), m_level);
     log.PushIndent();
@@ -19,6 +26,10 @@ namespace Log
 
   ScopedLog::~ScopedLog()
   {
+    if (!m_enabled)
+    {
+      return;
+    }
     Logger& logger = m_logger ? *m_logger : GetLogger();
     logger.PopIndent();
     const char* prefix = std::uncaught_exception() ? "!-" : "- ";
@@ -2,6 +2,7 @@
 #define __UTILS_LOG_SCOPED_LOG_H__
 
 #include <utils/log/log_level.h>
+#include <utils/trace.h>
 
 #include <string>
 
@@ -14,8 +15,11 @@ namespace Utils
     class ScopedLog
     {
       const Level m_level;
+      // The level is checked once, so the indents are balanced if the runtime level is changed in the scope.
+      const bool m_enabled;
       const std::string m_name;
       Logger* const m_logger;
+      const Trace::ScopedSpan m_span;
 
     public:
       ScopedLog(Level level, const std::string& name, Logger* logger = nullptr);
@@ -0,0 +1,149 @@
+﻿#include <utils/memory.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace Utils
+{
+  namespace Memory
+  {
+    namespace
+    {
+      // The header keeps the allocation size and the alignment of the returned pointer.
+      const std::size_t HEADER_SIZE = alignof(std::max_align_t) < sizeof(std::size_t) ? sizeof(std::size_t) : alignof(std::max_align_t);
+
+      std::atomic<std::uint64_t> g_heapBytes(0);
+      std::atomic<std::uint64_t> g_peakHeapBytes(0);
+      std::atomic<std::uint64_t> g_heapLimit(0);
+
+      void UpdatePeak(std::uint64_t bytes)
+      {
+        auto peak = g_peakHeapBytes.load(std::memory_order_relaxed);
+        while (peak < bytes && !g_peakHeapBytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed))
+        {
+        }
+      }
+
+      void* Allocate(std::size_t size) noexcept
+      {
+        const auto blockSize = HEADER_SIZE + (size != 0 ? size : 1);
+        const auto bytes = g_heapBytes.fetch_add(blockSize, std::memory_order_relaxed) + blockSize;
+        const auto limit = g_heapLimit.load(std::memory_order_relaxed);
+        if (limit != 0 && bytes > limit)
+        {
+          g_heapBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+          return nullptr;
+        }
+
+        auto* const block = static_cast<unsigned char*>(std::malloc(blockSize));
+        if (block == nullptr)
+        {
+          g_heapBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+          return nullptr;
+        }
+        UpdatePeak(bytes);
+        *reinterpret_cast<std::size_t*>(block) = blockSize;
+        return block + HEADER_SIZE;
+      }
+
+      void* AllocateOrThrow(std::size_t size)
+      {
+        for (;;)
+        {
+          if (auto* const ptr = Allocate(size))
+          {
+            return ptr;
+          }
+          const auto handler = std::get_new_handler();
+          if (!handler)
+          {
+            throw std::bad_alloc();
+          }
+          handler();
+        }
+      }
+
+      void Deallocate(void* ptr) noexcept
+      {
+        if (ptr == nullptr)
+        {
+          return;
+        }
+        auto* const block = static_cast<unsigned char*>(ptr) - HEADER_SIZE;
+        g_heapBytes.fetch_sub(*reinterpret_cast<std::size_t*>(block), std::memory_order_relaxed);
+        std::free(block);
+      }
+    }
+
+    std::uint64_t GetHeapBytes()
+    {
+      return g_heapBytes.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t GetPeakHeapBytes()
+    {
+      return g_peakHeapBytes.load(std::memory_order_relaxed);
+    }
+
+    void SetHeapLimit(std::uint64_t limit)
+    {
+      g_heapLimit.store(limit, std::memory_order_relaxed);
+    }
+
+    std::uint64_t GetHeapLimit()
+    {
+      return g_heapLimit.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void* operator new(std::size_t size)
+{
+  return Utils::Memory::AllocateOrThrow(size);
+}
+
+void* operator new[](std::size_t size)
+{
+  return Utils::Memory::AllocateOrThrow(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return Utils::Memory::Allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return Utils::Memory::Allocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+  Utils::Memory::Deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+  Utils::Memory::Deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+  Utils::Memory::Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+  Utils::Memory::Deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  Utils::Memory::Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+  Utils::Memory::Deallocate(ptr);
+}
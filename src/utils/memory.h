@@ -0,0 +1,22 @@
+﻿#ifndef __UTILS_MEMORY_H__
+#define __UTILS_MEMORY_H__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Utils
+{
+  // Accounting of the memory allocated by the global operator new of the process.
+  // Every allocation is counted with its size header, so all containers, strings and queues share one budget.
+  namespace Memory
+  {
+    std::uint64_t GetHeapBytes();
+    std::uint64_t GetPeakHeapBytes();
+
+    // An allocation exceeding the limit throws std::bad_alloc, 0 means no limit.
+    void SetHeapLimit(std::uint64_t limit);
+    std::uint64_t GetHeapLimit();
+  }
+}
+
+#endif
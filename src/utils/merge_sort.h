@@ -24,15 +24,16 @@ namespace Utils
       auto j = first;
       auto k = middle + 1u;
 
+      // Equal elements are taken from the left part first, so the sort is stable.
       while (i <= middle && k <= last)
       {
-        if (less(buf[i], buf[k]))
+        if (less(buf[k], buf[i]))
         {
-          arr[j++] = buf[i++];
+          arr[j++] = buf[k++];
         }
         else
         {
-          arr[j++] = buf[k++];
+          arr[j++] = buf[i++];
         }
       }
 
@@ -0,0 +1,209 @@
+﻿#include <predef.h>
+
+#include <utils/metrics.h>
+
+#include <atomic>
+#include <mutex>
+#include <sstream>
+
+#ifdef PREDEF_OS_WINDOWS
+  #include <windows.h>
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+namespace Utils
+{
+  namespace Metrics
+  {
+    namespace
+    {
+      const char* const DEFAULT_PHASE = "main";
+
+      struct Phase
+      {
+        std::string name;
+        std::vector<std::pair<std::string, std::uint64_t>> counters;
+      };
+
+      class Registry
+      {
+        std::mutex m_mutex;
+        std::vector<Phase> m_phases;
+
+      public:
+        template <typename Updater>
+        void Update(const std::string& phase, const char* counter, Updater update)
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          auto& value = GetCounter(GetPhase(phase), counter);
+          value = update(value);
+        }
+
+        std::vector<std::pair<std::string, std::uint64_t>> GetCounters(const std::string& phase)
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          for (const auto& p : m_phases)
+          {
+            if (p.name == phase)
+            {
+              return p.counters;
+            }
+          }
+          return {};
+        }
+
+        std::string ToJson()
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          std::ostringstream json;
+          json << "{";
+          for (std::size_t i = 0; i != m_phases.size(); ++i)
+          {
+            json << (i != 0 ? ", " : "") << "\"" << m_phases[i].name << "\": {";
+            const auto& counters = m_phases[i].counters;
+            for (std::size_t j = 0; j != counters.size(); ++j)
+            {
+              json << (j != 0 ? ", " : "") << "\"" << counters[j].first << "\": " << counters[j].second;
+            }
+            json << "}";
+          }
+          json << "}";
+          return json.str();
+        }
+
+      private:
+        Phase& GetPhase(const std::string& name)
+        {
+          for (auto& phase : m_phases)
+          {
+            if (phase.name == name)
+            {
+              return phase;
+            }
+          }
+          m_phases.push_back(Phase{ name, {} });
+          return m_phases.back();
+        }
+
+        static std::uint64_t& GetCounter(Phase& phase, const char* name)
+        {
+          for (auto& counter : phase.counters)
+          {
+            if (counter.first == name)
+            {
+              return counter.second;
+            }
+          }
+          phase.counters.emplace_back(name, 0);
+          return phase.counters.back().second;
+        }
+      };
+
+      std::atomic<bool> g_enabled(false);
+
+      thread_local std::string g_phase = DEFAULT_PHASE;
+
+      Registry& GetRegistry()
+      {
+        static Registry registry;
+        return registry;
+      }
+    }
+
+    void Enable()
+    {
+      g_enabled = true;
+    }
+
+    bool IsEnabled()
+    {
+      return g_enabled.load(std::memory_order_relaxed);
+    }
+
+    std::string GetPhase()
+    {
+      return g_phase;
+    }
+
+    ScopedPhase::ScopedPhase(const std::string& phase)
+      : m_prevPhase(g_phase)
+    {
+      g_phase = phase;
+    }
+
+    ScopedPhase::~ScopedPhase()
+    {
+      g_phase = m_prevPhase;
+    }
+
+    void Add(const char* counter, std::uint64_t value)
+    {
+      if (IsEnabled())
+      {
+        GetRegistry().Update(g_phase, counter, [value](std::uint64_t current) { return current + value; });
+      }
+    }
+
+    void SetMax(const char* counter, std::uint64_t value)
+    {
+      if (IsEnabled())
+      {
+        GetRegistry().Update(g_phase, counter, [value](std::uint64_t current) { return current < value ? value : current; });
+      }
+    }
+
+    std::uint64_t Get(const std::string& phase, const std::string& counter)
+    {
+      for (const auto& c : GetCounters(phase))
+      {
+        if (c.first == counter)
+        {
+          return c.second;
+        }
+      }
+      return 0;
+    }
+
+    std::vector<std::pair<std::string, std::uint64_t>> GetCounters(const std::string& phase)
+    {
+      return GetRegistry().GetCounters(phase);
+    }
+
+    std::uint64_t GetPeakMemoryUsage()
+    {
+      #ifdef PREDEF_OS_WINDOWS
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+          return 0;
+        }
+        return static_cast<std::uint64_t>(counters.PeakWorkingSetSize);
+      #else
+        // The children peak is the peak of the largest waited child, which is the worker processes.
+        std::uint64_t peak = 0;
+        for (const auto who : { RUSAGE_SELF, RUSAGE_CHILDREN })
+        {
+          rusage usage;
+          if (getrusage(who, &usage) == 0)
+          {
+            // Linux reports kilobytes, macOS reports bytes.
+            #ifdef __APPLE__
+              const auto bytes = static_cast<std::uint64_t>(usage.ru_maxrss);
+            #else
+              const auto bytes = static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+            #endif
+            peak = peak < bytes ? bytes : peak;
+          }
+        }
+        return peak;
+      #endif
+    }
+
+    std::string ToJson()
+    {
+      return GetRegistry().ToJson();
+    }
+  }
+}
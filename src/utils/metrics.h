@@ -0,0 +1,86 @@
+﻿#ifndef __UTILS_METRICS_H__
+#define __UTILS_METRICS_H__
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Utils
+{
+  // Named counters grouped by phases, collected only when enabled.
+  // A counter is added to the current phase of the calling thread, durations are counted in microseconds.
+  namespace Metrics
+  {
+    using Clock = std::chrono::steady_clock;
+
+    void Enable();
+    bool IsEnabled();
+
+    // Threads started in a phase are expected to set the phase of their parent.
+    std::string GetPhase();
+
+    class ScopedPhase
+    {
+      const std::string m_prevPhase;
+
+    public:
+      explicit ScopedPhase(const std::string& phase);
+      ~ScopedPhase();
+
+      ScopedPhase(const ScopedPhase&) = delete;
+      ScopedPhase& operator = (const ScopedPhase&) = delete;
+    };
+
+    void Add(const char* counter, std::uint64_t value);
+    void SetMax(const char* counter, std::uint64_t value);
+
+    template <typename Duration>
+    void AddDuration(const char* counter, Duration duration)
+    {
+      Add(counter, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count()));
+    }
+
+    // Returns 0 for a counter that is not collected.
+    std::uint64_t Get(const std::string& phase, const std::string& counter);
+    std::vector<std::pair<std::string, std::uint64_t>> GetCounters(const std::string& phase);
+
+    class ScopedDuration
+    {
+      const char* const m_counter;
+      const bool m_enabled;
+      Clock::time_point m_startTime;
+
+    public:
+      explicit ScopedDuration(const char* counter)
+        : m_counter(counter)
+        , m_enabled(IsEnabled())
+      {
+        if (m_enabled)
+        {
+          m_startTime = Clock::now();
+        }
+      }
+
+      ~ScopedDuration()
+      {
+        if (m_enabled)
+        {
+          AddDuration(m_counter, Clock::now() - m_startTime);
+        }
+      }
+
+      ScopedDuration(const ScopedDuration&) = delete;
+      ScopedDuration& operator = (const ScopedDuration&) = delete;
+    };
+
+    // The peak resident set size of the process and its waited children, 0 when it is not known.
+    std::uint64_t GetPeakMemoryUsage();
+
+    // Phases and counters are written in the order of their first update.
+    std::string ToJson();
+  }
+}
+
+#endif
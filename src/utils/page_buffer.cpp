@@ -0,0 +1,276 @@
+﻿#include <predef.h>
+
+#include <utils/page_buffer.h>
+#include <utils/err.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef PREDEF_OS_WINDOWS
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+namespace Utils
+{
+  namespace
+  {
+    const std::size_t HUGE_PAGE_SIZE = 2 << 20;
+
+    std::size_t AlignUp(std::size_t size, std::size_t alignment)
+    {
+      return (size + alignment - 1) / alignment * alignment;
+    }
+
+    class MallocPageBuffer : public PageBuffer
+    {
+      void* const m_data;
+      const std::size_t m_size;
+
+    public:
+      explicit MallocPageBuffer(std::size_t size)
+        : m_data(malloc(size))
+        , m_size(size)
+      {
+        ERR_THROW_IF_NOT(m_data, "Failed to allocate " + std::to_string(size) + " bytes.");
+      }
+
+      virtual ~MallocPageBuffer() override
+      {
+        free(m_data);
+      }
+
+      virtual void* GetData() const override
+      {
+        return m_data;
+      }
+
+      virtual std::size_t GetSize() const override
+      {
+        return m_size;
+      }
+
+      virtual Pages GetPages() const override
+      {
+        return Pages::REGULAR;
+      }
+
+      MallocPageBuffer(const MallocPageBuffer&) = delete;
+      MallocPageBuffer& operator = (const MallocPageBuffer&) = delete;
+    };
+
+    #ifdef PREDEF_OS_WINDOWS
+
+      // Large pages require the 'Lock pages in memory' privilege, without it the regular pages are allocated.
+      class VirtualPageBuffer : public PageBuffer
+      {
+        void* m_data;
+        const std::size_t m_size;
+        Pages m_pages;
+
+      public:
+        explicit VirtualPageBuffer(std::size_t size)
+          : m_data(nullptr)
+          , m_size(size)
+          , m_pages(Pages::REGULAR)
+        {
+          const auto largePageSize = GetLargePageMinimum();
+          if (largePageSize != 0)
+          {
+            m_data = VirtualAlloc(nullptr, AlignUp(size, largePageSize), MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+            m_pages = Pages::HUGE;
+          }
+          if (!m_data)
+          {
+            m_data = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            m_pages = Pages::REGULAR;
+          }
+          ERR_THROW_IF_NOT(m_data, "Failed to allocate " + std::to_string(size) + " bytes (error = " + std::to_string(GetLastError()) + ").");
+        }
+
+        virtual ~VirtualPageBuffer() override
+        {
+          VirtualFree(m_data, 0, MEM_RELEASE);
+        }
+
+        virtual void* GetData() const override
+        {
+          return m_data;
+        }
+
+        virtual std::size_t GetSize() const override
+        {
+          return m_size;
+        }
+
+        virtual Pages GetPages() const override
+        {
+          return m_pages;
+        }
+
+        VirtualPageBuffer(const VirtualPageBuffer&) = delete;
+        VirtualPageBuffer& operator = (const VirtualPageBuffer&) = delete;
+      };
+
+      std::size_t GetPageSize()
+      {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+      }
+
+    #else
+
+      // Transparent huge pages back only the aligned huge page ranges, so the mapping is aligned by trimming it.
+      class MappedPageBuffer : public PageBuffer
+      {
+        void* m_data;
+        std::size_t m_mappedSize;
+        const std::size_t m_size;
+        Pages m_pages;
+
+      public:
+        explicit MappedPageBuffer(std::size_t size)
+          : m_data(MAP_FAILED)
+          , m_mappedSize(AlignUp(size, HUGE_PAGE_SIZE))
+          , m_size(size)
+          , m_pages(Pages::REGULAR)
+        {
+          #ifdef MAP_HUGETLB
+            m_data = mmap(nullptr, m_mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (m_data != MAP_FAILED)
+            {
+              m_pages = Pages::HUGE;
+              return;
+            }
+          #endif
+
+          auto* const mapped = static_cast<char*>(mmap(nullptr, m_mappedSize + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+          ERR_THROW_IF(mapped == MAP_FAILED, "Failed to map " + std::to_string(size) + " bytes (errno = " + std::to_string(errno) + ").");
+          auto* const aligned = mapped + (HUGE_PAGE_SIZE - reinterpret_cast<std::uintptr_t>(mapped) % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+          if (aligned != mapped)
+          {
+            munmap(mapped, aligned - mapped);
+          }
+          const auto tailSize = static_cast<std::size_t>(mapped + m_mappedSize + HUGE_PAGE_SIZE - (aligned + m_mappedSize));
+          if (tailSize != 0)
+          {
+            munmap(aligned + m_mappedSize, tailSize);
+          }
+          m_data = aligned;
+
+          #ifdef MADV_HUGEPAGE
+            if (madvise(m_data, m_mappedSize, MADV_HUGEPAGE) == 0)
+            {
+              m_pages = Pages::TRANSPARENT_HUGE;
+            }
+          #endif
+        }
+
+        virtual ~MappedPageBuffer() override
+        {
+          munmap(m_data, m_mappedSize);
+        }
+
+        virtual void* GetData() const override
+        {
+          return m_data;
+        }
+
+        virtual std::size_t GetSize() const override
+        {
+          return m_size;
+        }
+
+        virtual Pages GetPages() const override
+        {
+          return m_pages;
+        }
+
+        MappedPageBuffer(const MappedPageBuffer&) = delete;
+        MappedPageBuffer& operator = (const MappedPageBuffer&) = delete;
+      };
+
+      std::size_t GetPageSize()
+      {
+        const auto pageSize = sysconf(_SC_PAGESIZE);
+        return pageSize > 0 ? static_cast<std::size_t>(pageSize) : 4096;
+      }
+
+    #endif
+  }
+
+  std::unique_ptr<PageBuffer> CreatePageBuffer(std::size_t size, bool hugePages)
+  {
+    ERR_THROW_IF(size == 0, "Invalid argument (size is 0).");
+    if (!hugePages)
+    {
+      return std::make_unique<MallocPageBuffer>(size);
+    }
+    #ifdef PREDEF_OS_WINDOWS
+      return std::make_unique<VirtualPageBuffer>(size);
+    #else
+      return std::make_unique<MappedPageBuffer>(size);
+    #endif
+  }
+
+  const char* ToString(PageBuffer::Pages pages)
+  {
+    switch (pages)
+    {
+      case PageBuffer::Pages::REGULAR:
+        return "regular";
+      case PageBuffer::Pages::TRANSPARENT_HUGE:
+        return "transparent huge";
+      case PageBuffer::Pages::HUGE:
+        return "huge";
+    }
+    return "unknown";
+  }
+
+  void PrefaultPages(void* data, std::size_t size, std::size_t threadsCount)
+  {
+    ERR_THROW_IF(data == nullptr && size != 0, "Invalid argument (data is null).");
+    ERR_THROW_IF(threadsCount == 0, "Invalid argument (threads count is 0).");
+
+    const auto pageSize = GetPageSize();
+    const auto pagesCount = (size + pageSize - 1) / pageSize;
+    const auto pagesPerThread = (pagesCount + threadsCount - 1) / threadsCount;
+    auto* const bytes = static_cast<volatile char*>(data);
+
+    const auto prefault = [=] (std::size_t part)
+    {
+      const auto end = (std::min)(pagesCount, (part + 1) * pagesPerThread);
+      for (auto page = part * pagesPerThread; page < end; ++page)
+      {
+        bytes[page * pageSize] = 0;
+      }
+    };
+
+    // A failed thread start leaves its part to the calling thread.
+    std::vector<std::thread> threads;
+    for (std::size_t part = 1; part < threadsCount; ++part)
+    {
+      try
+      {
+        threads.emplace_back(prefault, part);
+      }
+      catch (...)
+      {
+        prefault(part);
+      }
+    }
+    prefault(0);
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+  }
+}
@@ -0,0 +1,37 @@
+﻿#ifndef __UTILS_PAGE_BUFFER_H__
+#define __UTILS_PAGE_BUFFER_H__
+
+#include <cstddef>
+#include <memory>
+
+namespace Utils
+{
+  // A buffer mapped directly by pages. Huge pages reduce the TLB misses of random accesses to a large buffer.
+  class PageBuffer
+  {
+  public:
+    enum class Pages
+    {
+      REGULAR,
+      // The kernel backs the buffer by huge pages when it finds them, e.g. MADV_HUGEPAGE of Linux.
+      TRANSPARENT_HUGE,
+      HUGE,
+    };
+
+    virtual ~PageBuffer() = default;
+
+    virtual void* GetData() const = 0;
+    virtual std::size_t GetSize() const = 0;
+    virtual Pages GetPages() const = 0;
+  };
+
+  // Reserved huge pages are tried first, then transparent huge pages, then regular ones.
+  std::unique_ptr<PageBuffer> CreatePageBuffer(std::size_t size, bool hugePages);
+
+  const char* ToString(PageBuffer::Pages pages);
+
+  // Writes every page of the buffer by several threads, so the page faults are taken at once instead of by the sort.
+  void PrefaultPages(void* data, std::size_t size, std::size_t threadsCount);
+}
+
+#endif
@@ -0,0 +1,126 @@
+﻿#ifndef __UTILS_POOL_ALLOCATOR_H__
+#define __UTILS_POOL_ALLOCATOR_H__
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+namespace Utils
+{
+  // Keeps the freed single object blocks of one size for reuse.
+  class FreeListPool
+  {
+    struct FreeBlock
+    {
+      FreeBlock* next;
+    };
+
+    std::size_t m_blockSize;
+    FreeBlock* m_freeBlocks;
+
+  public:
+    FreeListPool()
+      : m_blockSize(0)
+      , m_freeBlocks(nullptr)
+    {
+    }
+
+    ~FreeListPool()
+    {
+      while (m_freeBlocks)
+      {
+        auto* const block = m_freeBlocks;
+        m_freeBlocks = block->next;
+        ::operator delete(block);
+      }
+    }
+
+    // The first allocated size is pooled, other sizes are allocated directly.
+    void* Allocate(std::size_t size)
+    {
+      if (m_blockSize == 0 && size >= sizeof(FreeBlock))
+      {
+        m_blockSize = size;
+      }
+      if (size == m_blockSize && m_freeBlocks)
+      {
+        auto* const block = m_freeBlocks;
+        m_freeBlocks = block->next;
+        return block;
+      }
+      return ::operator new(size);
+    }
+
+    void Deallocate(void* ptr, std::size_t size) noexcept
+    {
+      if (size != m_blockSize)
+      {
+        ::operator delete(ptr);
+        return;
+      }
+      m_freeBlocks = new (ptr) FreeBlock{ m_freeBlocks };
+    }
+
+    FreeListPool(const FreeListPool&) = delete;
+    FreeListPool& operator = (const FreeListPool&) = delete;
+  };
+
+  // Allocator of node based containers with a bounded count of nodes, e.g. a merge queue:
+  // once the container is filled, erased nodes are reused by inserts without the heap.
+  // Copies share the pool, which is not thread safe.
+  template <typename T>
+  class PoolAllocator
+  {
+    template <typename U>
+    friend class PoolAllocator;
+
+    std::shared_ptr<FreeListPool> m_pool;
+
+  public:
+    using value_type = T;
+
+    PoolAllocator()
+      : m_pool(std::make_shared<FreeListPool>())
+    {
+    }
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept
+      : m_pool(other.m_pool)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+      if (n == 1)
+      {
+        return static_cast<T*>(m_pool->Allocate(sizeof(T)));
+      }
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, std::size_t n) noexcept
+    {
+      if (n == 1)
+      {
+        m_pool->Deallocate(ptr, sizeof(T));
+        return;
+      }
+      ::operator delete(ptr);
+    }
+
+    template <typename U>
+    bool operator == (const PoolAllocator<U>& other) const noexcept
+    {
+      return m_pool == other.m_pool;
+    }
+
+    template <typename U>
+    bool operator != (const PoolAllocator<U>& other) const noexcept
+    {
+      return m_pool != other.m_pool;
+    }
+  };
+}
+
+#endif
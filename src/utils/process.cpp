@@ -0,0 +1,133 @@
+﻿#include <predef.h>
+
+#include <utils/process.h>
+#include <utils/err.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace Utils
+{
+  namespace
+  {
+    #ifdef PREDEF_OS_WINDOWS
+
+      FILE* OpenPipe(const std::string& commandLine)
+      {
+        return _popen(commandLine.c_str(), "rb");
+      }
+
+      int ClosePipe(FILE* pipe)
+      {
+        return _pclose(pipe);
+      }
+
+      // Arguments are not expected to contain quotes, cmd.exe has no way to escape them.
+      std::string QuoteArgument(const std::string& arg)
+      {
+        ERR_THROW_IF(arg.find('"') != std::string::npos, "Quotes are not supported in arguments (arg = '" + arg + "').");
+        return '"' + arg + '"';
+      }
+
+    #else
+
+      FILE* OpenPipe(const std::string& commandLine)
+      {
+        return popen(commandLine.c_str(), "r");
+      }
+
+      int ClosePipe(FILE* pipe)
+      {
+        return pclose(pipe);
+      }
+
+      std::string QuoteArgument(const std::string& arg)
+      {
+        std::string quoted = "'";
+        for (const auto ch : arg)
+        {
+          if (ch == '\'')
+          {
+            quoted += "'\\''";
+          }
+          else
+          {
+            quoted += ch;
+          }
+        }
+        return quoted + "'";
+      }
+
+    #endif
+
+    class PipedChildProcess : public ChildProcess
+    {
+      const std::string m_commandLine;
+      FILE* m_pipe;
+
+    public:
+      explicit PipedChildProcess(const std::string& commandLine)
+        : m_commandLine(commandLine)
+        , m_pipe(OpenPipe(commandLine))
+      {
+        ERR_THROW_IF_NOT(m_pipe, "Failed to start a process (command = '" + m_commandLine + "').");
+      }
+
+      virtual ~PipedChildProcess()
+      {
+        if (m_pipe)
+        {
+          ClosePipe(m_pipe);
+        }
+      }
+
+      virtual bool ReadLine(std::string& line) override
+      {
+        ERR_THROW_IF_NOT(m_pipe, "The process is already finished.");
+        line.clear();
+        char buffer[4096];
+        while (fgets(buffer, sizeof(buffer), m_pipe))
+        {
+          line += buffer;
+          if (!line.empty() && line.back() == '\n')
+          {
+            line.pop_back();
+            if (!line.empty() && line.back() == '\r')
+            {
+              line.pop_back();
+            }
+            return true;
+          }
+        }
+        ERR_THROW_IF(ferror(m_pipe), "Failed to read the process output (command = '" + m_commandLine + "').");
+        return !line.empty();
+      }
+
+      virtual void Wait() override
+      {
+        ERR_THROW_IF_NOT(m_pipe, "The process is already finished.");
+        const auto exitCode = ClosePipe(m_pipe);
+        m_pipe = nullptr;
+        ERR_THROW_IF(exitCode != 0, "The process failed (exit code = " + std::to_string(exitCode) + ", command = '" + m_commandLine + "').");
+      }
+
+      PipedChildProcess(const PipedChildProcess&) = delete;
+      PipedChildProcess& operator = (const PipedChildProcess&) = delete;
+    };
+  }
+
+  std::unique_ptr<ChildProcess> StartChildProcess(const std::vector<std::string>& args)
+  {
+    ERR_THROW_IF(args.empty(), "Invalid argument (args are empty).");
+    std::string commandLine;
+    for (const auto& arg : args)
+    {
+      commandLine += commandLine.empty() ? QuoteArgument(arg) : ' ' + QuoteArgument(arg);
+    }
+    #ifdef PREDEF_OS_WINDOWS
+      // cmd.exe strips the outer quotes of a command line starting with a quote.
+      commandLine = '"' + commandLine + '"';
+    #endif
+    return std::make_unique<PipedChildProcess>(commandLine);
+  }
+}
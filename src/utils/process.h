@@ -0,0 +1,25 @@
+﻿#ifndef __UTILS_PROCESS_H__
+#define __UTILS_PROCESS_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Utils
+{
+  // A child process started by the shell with its standard output read through a pipe.
+  class ChildProcess
+  {
+  public:
+    virtual ~ChildProcess() = default;
+
+    // Returns false at the end of the output. The line delimiter is removed.
+    virtual bool ReadLine(std::string& line) = 0;
+    // Waits for the process exit and throws if the exit code is not 0.
+    virtual void Wait() = 0;
+  };
+
+  std::unique_ptr<ChildProcess> StartChildProcess(const std::vector<std::string>& args);
+}
+
+#endif
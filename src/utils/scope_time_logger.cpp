@@ -6,6 +6,7 @@ namespace Utils
   ScopeTimeLogger::ScopeTimeLogger(const std::string& scopeName)
     : m_scopeName(scopeName)
     , m_startTime(Clock::now())
+    , m_span(scopeName)
   {
   }
 
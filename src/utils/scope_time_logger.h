@@ -1,6 +1,8 @@
 ﻿#ifndef __SCOPE_TIME_LOGGER_H__
 #define __SCOPE_TIME_LOGGER_H__
 
+#include <utils/trace.h>
+
 #include <chrono>
 #include <string>
 
@@ -14,6 +16,7 @@ namespace Utils
   private:
     const std::string m_scopeName;
     Clock::time_point m_startTime;
+    const Trace::ScopedSpan m_span;
 
   public:
     explicit ScopeTimeLogger(const std::string& scopeName);
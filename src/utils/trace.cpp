@@ -0,0 +1,263 @@
+﻿#include <predef.h>
+
+#include <utils/trace.h>
+#include <utils/err.h>
+#include <utils/fs/fs.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#ifdef PREDEF_OS_WINDOWS
+  #include <process.h>
+#else
+  #include <unistd.h>
+#endif
+
+namespace Utils
+{
+  namespace Trace
+  {
+    namespace
+    {
+      class ThreadEvents
+      {
+        const std::uint64_t m_thread;
+        const std::size_t m_capacity;
+        std::vector<Event> m_events;
+        std::size_t m_next;
+        std::uint64_t m_dropped;
+
+      public:
+        ThreadEvents(std::uint64_t thread, std::size_t capacity)
+          : m_thread(thread)
+          , m_capacity(capacity)
+          , m_next(0)
+          , m_dropped(0)
+        {
+        }
+
+        std::uint64_t GetThread() const
+        {
+          return m_thread;
+        }
+
+        // The buffer grows up to the capacity, then the oldest event is overwritten.
+        Event& Push()
+        {
+          if (m_events.size() < m_capacity)
+          {
+            m_events.emplace_back();
+            return m_events.back();
+          }
+          auto& event = m_events[m_next];
+          m_next = (m_next + 1) % m_capacity;
+          ++m_dropped;
+          return event;
+        }
+
+        void Get(std::vector<Event>& events) const
+        {
+          events.insert(events.end(), m_events.begin() + m_next, m_events.end());
+          events.insert(events.end(), m_events.begin(), m_events.begin() + m_next);
+        }
+
+        std::uint64_t GetDroppedCount() const
+        {
+          return m_dropped;
+        }
+
+        ThreadEvents(const ThreadEvents&) = delete;
+        ThreadEvents& operator = (const ThreadEvents&) = delete;
+      };
+
+      // Owns the buffers of all threads, so the spans of finished threads are kept.
+      class Registry
+      {
+        std::mutex m_mutex;
+        std::vector<std::unique_ptr<ThreadEvents>> m_threads;
+
+      public:
+        ThreadEvents* AddThread(std::size_t capacity)
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_threads.push_back(std::make_unique<ThreadEvents>(m_threads.size(), capacity));
+          return m_threads.back().get();
+        }
+
+        std::vector<Event> GetEvents()
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          std::vector<Event> events;
+          for (const auto& thread : m_threads)
+          {
+            thread->Get(events);
+          }
+          return events;
+        }
+
+        std::uint64_t GetDroppedEventsCount()
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          std::uint64_t dropped = 0;
+          for (const auto& thread : m_threads)
+          {
+            dropped += thread->GetDroppedCount();
+          }
+          return dropped;
+        }
+      };
+
+      std::atomic<bool> g_enabled(false);
+      std::atomic<std::size_t> g_eventsPerThread(DEFAULT_EVENTS_PER_THREAD);
+
+      thread_local ThreadEvents* g_threadEvents = nullptr;
+
+      Registry& GetRegistry()
+      {
+        static Registry registry;
+        return registry;
+      }
+
+      ThreadEvents& GetThreadEvents()
+      {
+        if (!g_threadEvents)
+        {
+          g_threadEvents = GetRegistry().AddThread(g_eventsPerThread);
+        }
+        return *g_threadEvents;
+      }
+
+      std::uint64_t GetProcessId()
+      {
+        #ifdef PREDEF_OS_WINDOWS
+          return static_cast<std::uint64_t>(_getpid());
+        #else
+          return static_cast<std::uint64_t>(getpid());
+        #endif
+      }
+
+      std::string EscapeJson(const std::string& str)
+      {
+        std::string escaped;
+        escaped.reserve(str.size());
+        for (const auto ch : str)
+        {
+          if (ch == '"' || ch == '\\')
+          {
+            escaped += '\\';
+            escaped += ch;
+          }
+          else if (static_cast<unsigned char>(ch) < 0x20)
+          {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(ch));
+            escaped += code;
+          }
+          else
+          {
+            escaped += ch;
+          }
+        }
+        return escaped;
+      }
+    }
+
+    void Enable(std::size_t eventsPerThread)
+    {
+      ERR_THROW_IF(eventsPerThread == 0, "Invalid argument (events per thread = 0).");
+      g_eventsPerThread = eventsPerThread;
+      g_enabled = true;
+    }
+
+    bool IsEnabled()
+    {
+      return g_enabled.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t GetTime()
+    {
+      return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    void AddEvent(const Event& event)
+    {
+      if (IsEnabled())
+      {
+        GetThreadEvents().Push() = event;
+      }
+    }
+
+    ScopedSpan::ScopedSpan(const char* name)
+      : m_enabled(IsEnabled())
+      , m_begin(0)
+    {
+      if (m_enabled)
+      {
+        m_name = name;
+        m_begin = GetTime();
+      }
+    }
+
+    ScopedSpan::ScopedSpan(const std::string& name)
+      : m_enabled(IsEnabled())
+      , m_begin(0)
+    {
+      if (m_enabled)
+      {
+        m_name = name;
+        m_begin = GetTime();
+      }
+    }
+
+    ScopedSpan::~ScopedSpan()
+    {
+      if (m_enabled)
+      {
+        const auto end = GetTime();
+        static const auto processId = GetProcessId();
+        auto& threadEvents = GetThreadEvents();
+        auto& event = threadEvents.Push();
+        event.name.swap(m_name);
+        event.process = processId;
+        event.thread = threadEvents.GetThread();
+        event.begin = m_begin;
+        event.duration = end - m_begin;
+      }
+    }
+
+    std::vector<Event> GetEvents()
+    {
+      return GetRegistry().GetEvents();
+    }
+
+    std::uint64_t GetDroppedEventsCount()
+    {
+      return GetRegistry().GetDroppedEventsCount();
+    }
+
+    void WriteJson(const std::string& filePath)
+    {
+      std::ostringstream json;
+      json << "{\"traceEvents\": [";
+      const auto events = GetEvents();
+      for (std::size_t i = 0; i != events.size(); ++i)
+      {
+        const auto& event = events[i];
+        json << (i != 0 ? "," : "") << "\n"
+          << "{\"name\": \"" << EscapeJson(event.name) << "\", \"ph\": \"X\""
+          << ", \"pid\": " << event.process << ", \"tid\": " << event.thread
+          << ", \"ts\": " << event.begin << ", \"dur\": " << event.duration << "}";
+      }
+      json << "\n], \"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": " << GetDroppedEventsCount() << "}}\n";
+
+      const auto data = json.str();
+      const auto file = Utils::Fs::OpenFile(filePath, "wb");
+      ERR_THROW_IF(fwrite(data.data(), data.size(), 1, file.get()) != 1, "Failed to write the trace (path = '" + filePath + "').");
+      ERR_THROW_IF(fflush(file.get()) != 0, "Failed to flush the trace (path = '" + filePath + "').");
+    }
+  }
+}
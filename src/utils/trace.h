@@ -0,0 +1,57 @@
+﻿#ifndef __UTILS_TRACE_H__
+#define __UTILS_TRACE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Utils
+{
+  // Timeline spans recorded per thread and exported in the Chrome trace event format.
+  // Every thread records into its own ring buffer, the oldest spans are dropped when it is full.
+  namespace Trace
+  {
+    const std::size_t DEFAULT_EVENTS_PER_THREAD = 1 << 16;
+
+    // Times are microseconds of the system clock, so the spans of several processes are comparable.
+    struct Event
+    {
+      std::string name;
+      std::uint64_t process;
+      std::uint64_t thread;
+      std::uint64_t begin;
+      std::uint64_t duration;
+    };
+
+    void Enable(std::size_t eventsPerThread = DEFAULT_EVENTS_PER_THREAD);
+    bool IsEnabled();
+
+    std::uint64_t GetTime();
+
+    // Adds a span recorded elsewhere, e.g. by a worker process.
+    void AddEvent(const Event& event);
+
+    class ScopedSpan
+    {
+      const bool m_enabled;
+      std::string m_name;
+      std::uint64_t m_begin;
+
+    public:
+      explicit ScopedSpan(const char* name);
+      explicit ScopedSpan(const std::string& name);
+      ~ScopedSpan();
+
+      ScopedSpan(const ScopedSpan&) = delete;
+      ScopedSpan& operator = (const ScopedSpan&) = delete;
+    };
+
+    // The events are read when the threads recording them are done.
+    std::vector<Event> GetEvents();
+    std::uint64_t GetDroppedEventsCount();
+    void WriteJson(const std::string& filePath);
+  }
+}
+
+#endif
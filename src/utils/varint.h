@@ -0,0 +1,48 @@
+﻿#ifndef __UTILS_VARINT_H__
+#define __UTILS_VARINT_H__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Utils
+{
+  // LEB128: 7 bits per byte starting from the lowest ones, the high bit is set for all bytes but the last.
+  const std::size_t MAX_VARINT_SIZE = 10;
+
+  // Returns the number of bytes written to the out (up to MAX_VARINT_SIZE).
+  inline std::size_t EncodeVarint(std::uint64_t value, unsigned char* out)
+  {
+    std::size_t size = 0;
+    while (value >= 0x80)
+    {
+      out[size++] = static_cast<unsigned char>(value | 0x80);
+      value >>= 7;
+    }
+    out[size++] = static_cast<unsigned char>(value);
+    return size;
+  }
+
+  // Returns the number of bytes read or 0 if the [begin, end) range ends in the middle of the value.
+  // A value longer than MAX_VARINT_SIZE bytes or above 2^64 - 1 is also reported as 0 if the range is long enough.
+  inline std::size_t DecodeVarint(const unsigned char* begin, const unsigned char* end, std::uint64_t& value)
+  {
+    value = 0;
+    unsigned shift = 0;
+    for (auto* it = begin; it != end && shift < 7 * MAX_VARINT_SIZE; ++it, shift += 7)
+    {
+      // The last byte has the 64th bit only.
+      if (shift == 7 * (MAX_VARINT_SIZE - 1) && *it > 1)
+      {
+        return 0;
+      }
+      value |= static_cast<std::uint64_t>(*it & 0x7f) << shift;
+      if ((*it & 0x80) == 0)
+      {
+        return static_cast<std::size_t>(it - begin) + 1;
+      }
+    }
+    return 0;
+  }
+}
+
+#endif
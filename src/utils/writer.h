@@ -0,0 +1,20 @@
+﻿#ifndef __UTILS_WRITER__
+#define __UTILS_WRITER__
+
+namespace Utils
+{
+  template <typename T>
+  class Writer
+  {
+  public:
+    using Data = T;
+
+  public:
+    virtual ~Writer() = default;
+
+    virtual void Write(const Data& data) = 0;
+    virtual void Flush() = 0;
+  };
+}
+
+#endif
@@ -0,0 +1,346 @@
+#!/usr/bin/env python
+
+# Runs ExternalSort with its options on small generated files and compares the results with the ones computed here.
+# The files are larger than the 1 Mb memory budget, so the runs are merged. Usage: run_options_test.py [app path].
+
+import json;
+import os;
+import random;
+import shutil;
+import string;
+import subprocess;
+import sys;
+
+appPath = sys.argv[1] if len(sys.argv) > 1 else "./ExternalSort";
+testDirPath = "options_test";
+tempDirPath = os.path.join(testDirPath, "temp");
+logFilePath = os.path.join(testDirPath, "log.txt");
+
+def path(fileName):
+  return os.path.join(testDirPath, fileName);
+
+def removeFile(fileName):
+  if os.path.exists(path(fileName)):
+    os.remove(path(fileName));
+
+# The command should fail with the expected error if it is given.
+def execApp(args, expectedError = None):
+  # The first value of an argument is used, so the defaults go last.
+  cmd = "{0} {1} temp_dir={2} max_memory_usage_Mb=1".format(appPath, args, tempDirPath);
+  print("Exec command: '{0}'".format(cmd));
+  with open(logFilePath, "w") as logFile:
+    error = subprocess.call(cmd, shell = True, stdout = logFile, stderr = subprocess.STDOUT);
+  with open(logFilePath, "r") as logFile:
+    log = logFile.read();
+  if expectedError is not None and (not error or expectedError not in log):
+    print(log);
+    raise Exception("Executing did not fail with '{0}'.".format(expectedError));
+  if expectedError is None and error:
+    print(log);
+    raise Exception("Executing failed.");
+
+def sortFile(inputFileName, outputFileName, args = "", expectedError = None):
+  removeFile(outputFileName);
+  execApp("input={0} output={1} {2}".format(path(inputFileName), path(outputFileName), args), expectedError);
+
+def writeLines(fileName, lines):
+  with open(path(fileName), "w") as file:
+    for line in lines:
+      file.write(line);
+      file.write("\n");
+
+def readLines(fileName):
+  with open(path(fileName), "r") as file:
+    return [line[:-1] if line.endswith("\n") else line for line in file];
+
+def check(testName, condition):
+  if not condition:
+    raise Exception("Test '{0}' failed.".format(testName));
+  print("Test '{0}' passed.".format(testName));
+
+def checkSortedBy(testName, lines, sourceLines, key):
+  keys = [key(line) for line in lines];
+  check(testName, sorted(lines) == sorted(sourceLines) and all(keys[i - 1] <= keys[i] for i in range(1, len(keys))));
+
+def field(line, number):
+  return line.split("\t")[number - 1];
+
+random.seed(1);
+choice = string.ascii_lowercase + string.ascii_uppercase + string.digits;
+
+def randomString(maxLength):
+  return ''.join(random.choice(choice) for _ in range(random.randint(1, maxLength)));
+
+# 'key<tab>integer<tab>text' lines with repeated keys.
+def generateLines(linesCount, keysCount):
+  return ["k{0:04d}\t{1}\t{2}".format(random.randint(0, keysCount - 1), random.randint(-1000000, 1000000), randomString(60))
+          for _ in range(linesCount)];
+
+if os.path.exists(testDirPath):
+  shutil.rmtree(testDirPath);
+os.makedirs(tempDirPath);
+
+dataLines = generateLines(40000, 1000);
+writeLines("data.txt", dataLines);
+sortedLines = sorted(dataLines);
+
+def testLimit():
+  sortFile("data.txt", "limit.txt", "limit=100");
+  check("limit", readLines("limit.txt") == sortedLines[:100]);
+  sortFile("data.txt", "limit_all.txt", "limit=100000");
+  check("limit above the lines count", readLines("limit_all.txt") == sortedLines);
+
+def testUnique():
+  distinctLines = generateLines(2000, 1000);
+  writeLines("dup.txt", [random.choice(distinctLines) for _ in range(40000)]);
+  sortFile("dup.txt", "unique.txt", "unique=1");
+  check("unique", readLines("unique.txt") == sorted(set(readLines("dup.txt"))));
+
+def testKeys():
+  sortFile("data.txt", "keys.txt", "key=3,1");
+  checkSortedBy("key fields", readLines("keys.txt"), dataLines, lambda line: (field(line, 3), field(line, 1)));
+  writeLines("comma.txt", [line.replace("\t", ",") for line in dataLines]);
+  sortFile("comma.txt", "comma_sorted.txt", "key=3 field_delim=,");
+  checkSortedBy("field_delim", readLines("comma_sorted.txt"), readLines("comma.txt"), lambda line: line.split(",")[2]);
+
+def testTypedKeys():
+  sortFile("data.txt", "integer.txt", "key=2 key_type=integer");
+  checkSortedBy("integer key", readLines("integer.txt"), dataLines, lambda line: int(field(line, 2)));
+  writeLines("float.txt", ["{0}\t{1:.3e}".format(randomString(8), random.uniform(-1e6, 1e6)) for _ in range(40000)]);
+  sortFile("float.txt", "float_reverse.txt", "key=2 key_type=float reverse=1");
+  checkSortedBy("reverse float key", readLines("float_reverse.txt"), readLines("float.txt"), lambda line: -float(field(line, 2)));
+  sortFile("data.txt", "reverse.txt", "reverse=1");
+  check("reverse", readLines("reverse.txt") == sortedLines[::-1]);
+
+def testFixed():
+  records = [bytes(random.getrandbits(8) for _ in range(16)) for _ in range(100000)];
+  with open(path("fixed.dat"), "wb") as file:
+    file.write(b"".join(records));
+  sortFile("fixed.dat", "fixed_sorted.dat", "records_format=fixed record_size=16 key_offset=4 key_size=8");
+  with open(path("fixed_sorted.dat"), "rb") as file:
+    data = file.read();
+  result = [data[i:i + 16] for i in range(0, len(data), 16)];
+  checkSortedBy("fixed records", result, records, lambda record: record[4:12]);
+
+def encodeVarint(value):
+  data = bytearray();
+  while value >= 0x80:
+    data.append((value & 0x7f) | 0x80);
+    value >>= 7;
+  data.append(value);
+  return bytes(data);
+
+def decodeVarintRecords(data):
+  records = [];
+  pos = 0;
+  while pos < len(data):
+    size = 0;
+    shift = 0;
+    while True:
+      byte = data[pos];
+      pos += 1;
+      size |= (byte & 0x7f) << shift;
+      shift += 7;
+      if byte < 0x80:
+        break;
+    records.append(data[pos:pos + size]);
+    pos += size;
+  return records;
+
+def testVarint():
+  # The records contain the line delimiters and zero bytes.
+  records = [bytes(random.getrandbits(8) for _ in range(random.randint(0, 64))) for _ in range(30000)];
+  with open(path("varint.dat"), "wb") as file:
+    file.write(b"".join(encodeVarint(len(record)) + record for record in records));
+  sortFile("varint.dat", "varint_sorted.dat", "records_format=varint");
+  with open(path("varint_sorted.dat"), "rb") as file:
+    check("varint records", decodeVarintRecords(file.read()) == sorted(records));
+  sortFile("varint.dat", "varint_unique.dat", "records_format=varint unique=1");
+  with open(path("varint_unique.dat"), "rb") as file:
+    check("unique varint records", decodeVarintRecords(file.read()) == sorted(set(records)));
+
+def testStable():
+  sortFile("data.txt", "stable.txt", "key=1 stable=1");
+  check("stable", readLines("stable.txt") == sorted(dataLines, key = lambda line: field(line, 1)));
+  sortFile("data.txt", "stable_reverse.txt", "key=1 stable=1 reverse=1");
+  check("stable reverse", readLines("stable_reverse.txt") == sorted(dataLines, key = lambda line: field(line, 1), reverse = True));
+  # The runs are cut to the limit after the stable sort.
+  sortFile("data.txt", "stable_limit.txt", "key=1 stable=1 limit=100");
+  check("stable limit", readLines("stable_limit.txt") == sorted(dataLines, key = lambda line: field(line, 1))[:100]);
+
+def join(leftLines, rightLines, leftJoin):
+  rightGroups = {};
+  for line in rightLines:
+    rightGroups.setdefault(field(line, 1), []).append(line);
+  result = [];
+  for line in leftLines:
+    group = rightGroups.get(field(line, 1), []);
+    result.extend(line + "\t" + rightLine for rightLine in group);
+    if leftJoin and not group:
+      result.append(line);
+  return result;
+
+def testJoin():
+  leftLines = ["k{0:04d}\tL{1}".format(random.randint(0, 3000), i) for i in range(20000)];
+  rightLines = ["k{0:04d}\tR{1}".format(random.randint(1000, 4000), i) for i in range(20000)];
+  writeLines("left.txt", leftLines);
+  writeLines("right.txt", rightLines);
+  rightArg = "join_input={0} key=1".format(path("right.txt"));
+  sortFile("left.txt", "inner.txt", "mode=join " + rightArg);
+  check("inner join", sorted(readLines("inner.txt")) == sorted(join(leftLines, rightLines, False)));
+  sortFile("left.txt", "left_join.txt", "mode=join join_type=left " + rightArg);
+  check("left join", sorted(readLines("left_join.txt")) == sorted(join(leftLines, rightLines, True)));
+  sortFile("left.txt", "unique_join.txt", "mode=join unique=1 " + rightArg, "unique is not supported in the join mode");
+  check("unique join is rejected", True);
+  # The right group is larger than the memory budget.
+  groupLines = ["k0001\tR{0}{1}".format(i, "x" * 100) for i in range(15000)];
+  writeLines("group.txt", groupLines);
+  sortFile("left.txt", "group_join.txt", "mode=join key=1 join_input={0}".format(path("group.txt")));
+  check("join of a large group", sorted(readLines("group_join.txt")) == sorted(join(leftLines, groupLines, False)));
+
+def aggregate(lines, value):
+  groups = {};
+  for line in lines:
+    groups[field(line, 1)] = groups.get(field(line, 1), 0) + value(line);
+  return groups;
+
+def aggregated(fileName):
+  return dict((field(line, 1), int(line.split("\t")[-1])) for line in readLines(fileName));
+
+def testAggregate():
+  sortFile("data.txt", "count.txt", "key=1 aggregate=count");
+  check("count", aggregated("count.txt") == aggregate(dataLines, lambda line: 1));
+  # The sums are above 2^53, so they are exact as 64-bit integers only. Empty and not numeric values are 0.
+  sumValues = [random.choice(["", "n/a", str(random.randint(0, 10 ** 13))]) for _ in range(40000)];
+  sumLines = ["k{0:02d}\t{1}\t{2}".format(random.randint(0, 19), value, randomString(40)) for value in sumValues];
+  writeLines("sum.txt", sumLines);
+  sortFile("sum.txt", "sum_sorted.txt", "key=1 aggregate=sum value_field=2");
+  result = readLines("sum_sorted.txt");
+  check("sum", aggregated("sum_sorted.txt") == aggregate(sumLines, lambda line: int(field(line, 2)) if field(line, 2).isdigit() else 0)
+        and [field(line, 1) for line in result] == sorted(field(line, 1) for line in result));
+
+def testShards():
+  sortFile("data.txt", "shards.txt", "output_shards=3");
+  shards = [readLines("shards.txt.{0}".format(shard)) for shard in range(3)];
+  check("output shards", all(shards) and sum(shards, []) == sortedLines);
+
+def testWorkers():
+  removeFile("workers.txt");
+  execApp("input={0} output={1} workers=2 max_memory_usage_Mb=4".format(path("data.txt"), path("workers.txt")));
+  check("workers", readLines("workers.txt") == sortedLines);
+
+def testIndex():
+  sortFile("data.txt", "indexed.txt", "key=1 index_step=100");
+  indexedLines = readLines("indexed.txt");
+  checkSortedBy("index", indexedLines, dataLines, lambda line: field(line, 1));
+  check("index file", os.path.getsize(path("indexed.txt.idx")) > 0);
+  for key in [field(dataLines[0], 1), "k0000", "k9999"]:
+    sortFile("indexed.txt", "lookup.txt", "mode=lookup key=1 lookup_key={0}".format(key));
+    check("lookup of '{0}'".format(key), readLines("lookup.txt") == [line for line in indexedLines if field(line, 1) == key]);
+
+def testAppend():
+  writeLines("base.txt", sorted(dataLines[:30000]));
+  writeLines("new.txt", dataLines[30000:]);
+  sortFile("new.txt", "appended.txt", "append={0}".format(path("base.txt")));
+  check("append", readLines("appended.txt") == sortedLines);
+
+def testCheckpoint():
+  args = "checkpoint=1 merge_fan_in=2 remove_temp_files=0";
+  shutil.rmtree(tempDirPath);
+  os.makedirs(tempDirPath);
+  sortFile("data.txt", "checkpoint.txt", args);
+  check("checkpoint", readLines("checkpoint.txt") == sortedLines);
+  # The sort is cut after the first merge task, as if it was killed.
+  sortTempDirPath = os.path.join(tempDirPath, os.listdir(tempDirPath)[0]);
+  manifestFilePath = os.path.join(sortTempDirPath, "manifest.txt");
+  with open(manifestFilePath, "r") as file:
+    manifest = file.readlines();
+  firstMerged = [i for i, line in enumerate(manifest) if line.startswith("merged\t")][0];
+  with open(manifestFilePath, "w") as file:
+    file.writelines(manifest[:firstMerged + 1]);
+  sortFile("data.txt", "checkpoint.txt", "{0} resume={1}".format(args, sortTempDirPath));
+  check("resume", readLines("checkpoint.txt") == sortedLines);
+  # A recorded file which differs from the manifest fails the resume.
+  with open(manifestFilePath, "w") as file:
+    file.writelines(manifest[:firstMerged + 1]);
+  with open(manifest[firstMerged].split("\t")[1], "r+b") as file:
+    file.seek(100);
+    byte = file.read(1);
+    file.seek(100);
+    file.write(b"0" if byte != b"0" else b"1");
+  sortFile("data.txt", "checkpoint.txt", "{0} resume={1}".format(args, sortTempDirPath), "Checkpoint file checksum mismatch");
+  check("resume of a corrupted file", True);
+  shutil.rmtree(tempDirPath);
+  os.makedirs(tempDirPath);
+
+def testMergeFanIn():
+  sortFile("data.txt", "fan_in.txt", "merge_fan_in=2");
+  check("merge_fan_in", readLines("fan_in.txt") == sortedLines);
+
+def testVerify():
+  writeLines("sorted.txt", sortedLines);
+  execApp("mode=verify input={0}".format(path("sorted.txt")));
+  execApp("mode=verify input={0} checksum_input={1} threads=3".format(path("sorted.txt"), path("data.txt")));
+  check("verify", True);
+  execApp("mode=verify input={0}".format(path("data.txt")), "File is not sorted");
+  writeLines("missing.txt", sortedLines[1:]);
+  execApp("mode=verify input={0} checksum_input={1}".format(path("missing.txt"), path("data.txt")), "Checksum mismatch");
+  check("verify of an unsorted file", True);
+  execApp("mode=verify input={0} key=1 unique=1".format(path("sorted.txt")), "File is not sorted");
+  check("verify of a not unique file", True);
+
+def testMetrics():
+  sortFile("data.txt", "metrics_sorted.txt", "metrics_file={0}".format(path("metrics.json")));
+  with open(path("metrics.json"), "r") as file:
+    phases = json.load(file)["phases"];
+  check("metrics_file sort lines", phases["sort"]["lines"] == len(dataLines));
+  check("metrics_file sort runs", phases["sort"]["runs"] > 1);
+  check("metrics_file sort bytes_written", phases["sort"]["bytes_written"] > 0);
+  check("metrics_file merge lines", phases["merge"]["lines"] == len(dataLines));
+  check("metrics_file merge bytes_written", phases["merge"]["bytes_written"] > 0);
+
+def testTrace():
+  sortFile("data.txt", "trace_sorted.txt", "trace_file={0}".format(path("trace.json")));
+  with open(path("trace.json"), "r") as file:
+    events = json.load(file)["traceEvents"];
+  for name in ["read", "sort", "write", "MergeSortSorter::SortAndSave"]:
+    check("trace_file span '{0}'".format(name), any(event["name"] == name and event["ph"] == "X" for event in events));
+
+def testHeapLimit():
+  sortFile("data.txt", "heap.txt", "max_memory_usage_Mb=4 max_heap_usage_Mb=1");
+  check("max_heap_usage_Mb", readLines("heap.txt") == sortedLines);
+  sortFile("data.txt", "heap_all.txt", "max_memory_usage_Mb=4 max_heap_usage_Mb=4", "max_heap_usage_Mb should be < max_memory_usage_Mb");
+  check("max_heap_usage_Mb of the whole budget is rejected", True);
+
+def testHugePages():
+  sortFile("data.txt", "huge_pages.txt", "huge_pages=1 max_memory_usage_Mb=4");
+  check("huge_pages", readLines("huge_pages.txt") == sortedLines);
+
+tests = [
+  testLimit,
+  testUnique,
+  testKeys,
+  testTypedKeys,
+  testFixed,
+  testVarint,
+  testStable,
+  testJoin,
+  testAggregate,
+  testShards,
+  testWorkers,
+  testIndex,
+  testAppend,
+  testCheckpoint,
+  testMergeFanIn,
+  testVerify,
+  testMetrics,
+  testTrace,
+  testHeapLimit,
+  testHugePages,
+];
+
+for test in tests:
+  test();
+
+shutil.rmtree(testDirPath);
+print("DONE");